@@ -0,0 +1,62 @@
+//NOTE: A shared resource .nut file is used for these examples
+// A typical animated layout will specify fe.load_module("animate"); at the top
+// All objects used in these examples are stored in an OBJECTS table, which is created in the shared .nut file
+fe.do_nut("resources/shared.nut");
+
+OBJECTS.tutorial1.msg = "15. Pinch Benchmark";
+OBJECTS.tutorial2.msg = "50 images with their pinch and skew changing every frame. Select switches between the pinch shader and CPU geometry.\nRun with vsync off or the average frame time (top) just shows the refresh interval: vblank_mode=0 (Mesa), __GL_SYNC_TO_VBLANK=0 (NVIDIA) or a window mode (Windows).";
+
+local COLS = 10;
+local ROWS = 5;
+local W = 100;
+local H = 90;
+
+local images = [];
+for ( local i=0; i<COLS * ROWS; i++ )
+{
+    local img = fe.add_image( "resources/debug.png",
+        40 + ( i % COLS ) * ( W + 20 ),
+        70 + ( i / COLS ) * ( H + 10 ),
+        W, H );
+
+    images.push( img );
+}
+
+local stats = fe.add_text( "", 0, 15, fe.layout.width, 40 );
+stats.set_rgb( 255, 255, 0 );
+
+fe.frame_stats.reset();
+local last_stats = 0;
+
+fe.add_ticks_callback( "pinch_benchmark_tick" );
+fe.add_signal_handler( "pinch_benchmark_signal" );
+
+function pinch_benchmark_signal( signal )
+{
+    if ( signal != "select" )
+        return false;
+
+    // switch between the pinch shader and the CPU geometry, and start
+    // measuring again
+    fe.layout.gpu_pinch = !fe.layout.gpu_pinch;
+    fe.frame_stats.reset();
+    return true;
+}
+
+function pinch_benchmark_tick( ttime )
+{
+    foreach ( i, img in images )
+    {
+        local a = ttime / 500.0 + i * 0.3;
+        img.pinch_y = sin( a ) * H / 3;
+        img.skew_x = cos( a ) * W / 4;
+    }
+
+    if ( ttime - last_stats >= 1000 )
+    {
+        last_stats = ttime;
+        stats.msg = format( "%s: %d frames, average %.2f ms per frame",
+            fe.layout.gpu_pinch ? "Pinch shader" : "CPU geometry",
+            fe.frame_stats.frames, fe.frame_stats.average_ms );
+    }
+}
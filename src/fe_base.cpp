@@ -31,6 +31,7 @@ extern "C"
 #endif
 
 #include <iomanip>
+#include <cstring>
 #include "nowide/fstream.hpp"
 #include "nowide/iostream.hpp"
 
@@ -59,6 +60,7 @@ namespace {
 	nowide::ofstream g_nullstream( "/dev/null" );
 #endif
 	enum FeLogLevel g_log_level=FeLog_Info;
+	thread_local std::ostream *g_thread_log=NULL;
 
 #ifndef NO_MOVIE
 	void ffmpeg_log_callback( void *ptr, int level, const char *fmt, va_list vargs )
@@ -86,6 +88,9 @@ std::ostream &FeLog()
 	if ( g_log_level == FeLog_Silent )
 		return g_nullstream;
 
+	if ( g_thread_log )
+		return *g_thread_log;
+
 	if ( g_logfile.is_open() )
 		return g_logfile;
 	else
@@ -100,6 +105,16 @@ void fe_set_log_file( const std::string &fn )
 		g_logfile.open( fn.c_str() );
 }
 
+void fe_set_thread_log( std::ostream *s )
+{
+	g_thread_log = s;
+}
+
+bool fe_has_thread_log()
+{
+	return ( g_thread_log != NULL );
+}
+
 void fe_set_log_level( enum FeLogLevel f )
 {
 	g_log_level = f;
@@ -194,18 +209,32 @@ void FeBaseConfigurable::invalid_setting(
 bool FeBaseConfigurable::load_from_file( const std::string &filename,
 	const char *sep )
 {
-   nowide::ifstream myfile( filename.c_str() );
-
-   if ( !myfile.is_open() )
+	//
+	// Read the whole file in one go and then walk through it line by line.
+	// The line, setting and value strings are reused for every line so we
+	// aren't allocating new strings for each line of large files (romlists)
+	//
+	std::string data;
+	if ( !get_file_contents( filename, data ) )
 		return false;
 
 	const int DEBUG_MAX_LINES=200;
 	int count=0;
 
-	while ( myfile.good() )
+	std::string line, setting, value;
+	line.reserve( 512 );
+
+	const char *pos = data.c_str();
+	const char *end = pos + data.size();
+
+	while ( pos < end )
 	{
-		std::string line, setting, value;
-		getline( myfile, line );
+		const char *eol = (const char *)memchr( pos, '\n', end - pos );
+		if ( !eol )
+			eol = end;
+
+		line.assign( pos, eol - pos );
+		pos = eol + 1;
 
 		if ( line_to_setting_and_value( line, setting, value, sep ) )
 		{
@@ -224,6 +253,5 @@ bool FeBaseConfigurable::load_from_file( const std::string &filename,
 		}
 	}
 
-	myfile.close();
 	return true;
 }
@@ -48,6 +48,15 @@ enum FeLogLevel
 std::ostream &FeLog();
 std::ostream &FeDebug();
 void fe_set_log_file( const std::string & );
+
+// Redirect FeLog() output from the calling thread to the given stream.
+// Used by worker threads that need to keep their output together.  Pass
+// NULL to restore normal logging for the thread.
+void fe_set_thread_log( std::ostream * );
+
+// true if FeLog() output from the calling thread is being redirected.
+// Console progress output should be skipped on those threads
+bool fe_has_thread_log();
 void fe_set_log_level( enum FeLogLevel );
 enum FeLogLevel fe_get_log_level();
 void fe_print_version();
@@ -0,0 +1,130 @@
+/*
+ *
+ *  Attract-Mode frontend
+ *  Copyright (C) 2020 Andrew Mickelson
+ *
+ *  This file is part of Attract-Mode.
+ *
+ *  Attract-Mode is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Attract-Mode is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Attract-Mode.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "fe_batch.hpp"
+
+FeDrawBatch::FeDrawBatch()
+	: m_target( NULL ),
+	m_items( 0 ),
+	m_draws( 0 )
+{
+}
+
+void FeDrawBatch::begin( sf::RenderTarget &target )
+{
+	m_target = &target;
+	m_vertices.clear();
+}
+
+void FeDrawBatch::end()
+{
+	flush();
+	m_target = NULL;
+}
+
+void FeDrawBatch::add( const sf::VertexArray &v,
+		const sf::Transform &t,
+		const sf::RenderStates &states )
+{
+	if ( !m_target )
+		return;
+
+	unsigned int count = v.getVertexCount();
+
+	if (( v.getPrimitiveType() != sf::TrianglesStrip ) || ( count < 3 ))
+	{
+		sf::RenderStates s( states );
+		s.transform *= t;
+		draw( v, s );
+		return;
+	}
+
+	if ( !m_vertices.empty() && !same_states( states ) )
+		flush();
+
+	m_states = states;
+
+	//
+	// Unroll the strip into separate triangles so strips from different
+	// items can share one vertex list.  Positions get the item's own
+	// transform applied here, the shared transform is applied when drawn
+	//
+	for ( unsigned int i=2; i<count; i++ )
+	{
+		for ( unsigned int j=i-2; j<=i; j++ )
+		{
+			sf::Vertex vert = v[j];
+			vert.position = t.transformPoint( vert.position );
+			m_vertices.push_back( vert );
+		}
+	}
+
+	m_items++;
+}
+
+void FeDrawBatch::draw( const sf::Drawable &d, const sf::RenderStates &states )
+{
+	if ( !m_target )
+		return;
+
+	flush();
+	m_target->draw( d, states );
+
+	m_items++;
+	m_draws++;
+}
+
+void FeDrawBatch::flush()
+{
+	if ( !m_target || m_vertices.empty() )
+		return;
+
+	m_target->draw( &(m_vertices[0]), m_vertices.size(), sf::Triangles, m_states );
+	m_vertices.clear();
+
+	m_draws++;
+}
+
+void FeDrawBatch::reset_counts()
+{
+	m_items = 0;
+	m_draws = 0;
+}
+
+bool FeDrawBatch::same_states( const sf::RenderStates &s ) const
+{
+	if (( s.texture != m_states.texture )
+			|| ( s.shader != m_states.shader )
+			|| !( s.blendMode == m_states.blendMode ))
+		return false;
+
+	const float *a = s.transform.getMatrix();
+	const float *b = m_states.transform.getMatrix();
+
+	for ( int i=0; i<16; i++ )
+	{
+		if ( a[i] != b[i] )
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,72 @@
+/*
+ *
+ *  Attract-Mode frontend
+ *  Copyright (C) 2020 Andrew Mickelson
+ *
+ *  This file is part of Attract-Mode.
+ *
+ *  Attract-Mode is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Attract-Mode is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Attract-Mode.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FE_BATCH_HPP
+#define FE_BATCH_HPP
+
+#include <SFML/Graphics.hpp>
+#include <vector>
+
+//
+// Collects what is drawn to a render target so that consecutive draws
+// using the same texture, shader, blend mode and transform are submitted
+// to the GPU as one draw call.  Draw order is kept, so overlapping
+// elements still stack in their zorder.
+//
+class FeDrawBatch
+{
+public:
+	FeDrawBatch();
+
+	void begin( sf::RenderTarget &target );
+	void end();
+
+	// Queue the triangle strip v, transformed by t, to be drawn with states
+	void add( const sf::VertexArray &v,
+		const sf::Transform &t,
+		const sf::RenderStates &states );
+
+	// Draw d straight away (after anything already queued)
+	void draw( const sf::Drawable &d, const sf::RenderStates &states );
+
+	// Submit anything queued
+	void flush();
+
+	// number of items drawn and the number of draw calls used for them
+	int get_item_count() const { return m_items; };
+	int get_draw_count() const { return m_draws; };
+	void reset_counts();
+
+private:
+	FeDrawBatch( const FeDrawBatch & );
+	FeDrawBatch &operator=( const FeDrawBatch & );
+
+	bool same_states( const sf::RenderStates &s ) const;
+
+	sf::RenderTarget *m_target;
+	std::vector<sf::Vertex> m_vertices;
+	sf::RenderStates m_states;
+	int m_items;
+	int m_draws;
+};
+
+#endif
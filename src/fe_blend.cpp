@@ -22,6 +22,8 @@
 
 #include "fe_blend.hpp"
 #include "fe_util.hpp" // for FE_VERSION_INT macro
+#include "fe_base.hpp"
+#include <iostream>
 
 namespace
 {
@@ -46,9 +48,107 @@ namespace
 		"gl_FragColor = gl_Color * pixel;" \
 		"gl_FragColor.xyz *= gl_Color.w * sign(pixel.w);}";
 
+	//
+	// plane_size uniforms are: x=width and y=height of the plane in samples,
+	// z=width and w=height of the plane's texture in texels (4 samples per
+	// texel).  yuv_range is the luma offset, luma scale and chroma scale,
+	// yuv_coef is the colour matrix (v->r, u->g, v->g, u->b)
+	//
+	const char *YUV_SHADER_GLSL = \
+		"uniform sampler2D texture_y;" \
+		"uniform sampler2D texture_u;" \
+		"uniform sampler2D texture_v;" \
+		"uniform vec4 luma_size;" \
+		"uniform vec4 chroma_size;" \
+		"uniform vec3 yuv_range;" \
+		"uniform vec4 yuv_coef;" \
+		"uniform float bilinear;" \
+		"float fetch(sampler2D t, vec4 s, vec2 p){" \
+		"float tx = floor(p.x / 4.0);" \
+		"vec4 texel = texture2D(t, vec2((tx + 0.5) / s.z, (p.y + 0.5) / s.w));" \
+		"return dot(texel, vec4(equal(vec4(p.x - tx * 4.0), vec4(0.0, 1.0, 2.0, 3.0))));}" \
+		"float plane(sampler2D t, vec4 s, vec2 uv){" \
+		"vec2 p = uv * s.xy - 0.5;" \
+		"vec2 m = s.xy - 1.0;" \
+		"if (bilinear < 0.5) return fetch(t, s, clamp(floor(p + 0.5), vec2(0.0), m));" \
+		"vec2 f = fract(p);" \
+		"vec2 p0 = clamp(floor(p), vec2(0.0), m);" \
+		"vec2 p1 = clamp(floor(p) + 1.0, vec2(0.0), m);" \
+		"return mix(mix(fetch(t, s, p0), fetch(t, s, vec2(p1.x, p0.y)), f.x)," \
+		"mix(fetch(t, s, vec2(p0.x, p1.y)), fetch(t, s, p1), f.x), f.y);}" \
+		"void main(){" \
+		"vec2 uv = gl_TexCoord[0].xy;" \
+		"float y = (plane(texture_y, luma_size, uv) - yuv_range.x) * yuv_range.y;" \
+		"float u = (plane(texture_u, chroma_size, uv) - 0.5) * yuv_range.z;" \
+		"float v = (plane(texture_v, chroma_size, uv) - 0.5) * yuv_range.z;" \
+		"vec3 rgb = vec3(y + yuv_coef.x * v, y - yuv_coef.y * u - yuv_coef.z * v, y + yuv_coef.w * u);" \
+		"gl_FragColor = gl_Color * vec4(clamp(rgb, 0.0, 1.0), 1.0);}";
+
+	//
+	// The quad's vertices carry their local position in the texture
+	// coordinates.  The fragment shader inverts the bilinear mapping from the
+	// quad's corners (top left/right, bottom left/right) to find where each
+	// pixel falls in tex_rect (left, top, right, bottom in pixels), giving the
+	// same result as slicing the image into a strip of thin triangles.
+	//
+	const char *PINCH_SHADER_VERT = \
+		"varying vec2 local_pos;" \
+		"void main(){" \
+		"local_pos = gl_MultiTexCoord0.xy;" \
+		"gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;" \
+		"gl_FrontColor = gl_Color;}";
+
+	const char *PINCH_SHADER_FRAG = \
+		"uniform sampler2D texture;" \
+		"uniform vec4 corner_top;" \
+		"uniform vec4 corner_bottom;" \
+		"uniform vec4 tex_rect;" \
+		"varying vec2 local_pos;" \
+		"float cross2(vec2 a, vec2 b){ return a.x * b.y - a.y * b.x; }" \
+		"void main(){" \
+		"vec2 e = corner_top.zw - corner_top.xy;" \
+		"vec2 f = corner_bottom.xy - corner_top.xy;" \
+		"vec2 g = corner_top.xy - corner_top.zw + corner_bottom.zw - corner_bottom.xy;" \
+		"vec2 h = local_pos - corner_top.xy;" \
+		"float k2 = cross2(g, f);" \
+		"float k1 = cross2(e, f) + cross2(h, g);" \
+		"float k0 = cross2(h, e);" \
+		"float v;" \
+		"if (abs(k2) < 0.0001) v = -k0 / k1;" \
+		"else {" \
+		"float w = sqrt(max(k1 * k1 - 4.0 * k0 * k2, 0.0));" \
+		"v = (-k1 - w) / (2.0 * k2);" \
+		"if (v < 0.0 || v > 1.0) v = (-k1 + w) / (2.0 * k2);}" \
+		"vec2 n = h - f * v;" \
+		"vec2 d = e + g * v;" \
+		"float u = (abs(d.x) > abs(d.y)) ? n.x / d.x : n.y / d.y;" \
+		"vec2 p = mix(tex_rect.xy, tex_rect.zw, clamp(vec2(u, v), 0.0, 1.0));" \
+		"vec4 pixel = texture2D(texture, (gl_TextureMatrix[0] * vec4(p, 0.0, 1.0)).xy);" \
+		"gl_FragColor = gl_Color * pixel;}";
+
 	sf::Shader *default_shader_multiplied=NULL;
 	sf::Shader *default_shader_overlay=NULL;
 	sf::Shader *default_shader_premultiplied=NULL;
+	sf::Shader *yuv_shader=NULL;
+	bool yuv_shader_failed=false;
+	sf::Shader *pinch_shader=NULL;
+	bool pinch_shader_failed=false;
+	bool pinch_shader_enabled=true;
+
+	// compile s, logging how long it took.  vert can be NULL
+	bool compile_shader( sf::Shader *s, const char *label,
+		const char *vert, const char *frag )
+	{
+		sf::Clock clk;
+
+		bool retval = vert ? s->loadFromMemory( vert, frag )
+			: s->loadFromMemory( frag, sf::Shader::Fragment );
+
+		FeDebug() << "Compiled " << label << " shader in "
+			<< clk.getElapsedTime().asMilliseconds() << "ms" << std::endl;
+
+		return retval;
+	}
 };
 
 sf::BlendMode FeBlend::get_blend_mode( int blend_mode )
@@ -101,21 +201,21 @@ sf::Shader* FeBlend::get_default_shader( int blend_mode )
 			if ( !default_shader_multiplied )
 			{
 				default_shader_multiplied = new sf::Shader();
-				default_shader_multiplied->loadFromMemory( DEFAULT_SHADER_GLSL_MULTIPLIED, sf::Shader::Fragment );
+				compile_shader( default_shader_multiplied, "multiplied blend", NULL, DEFAULT_SHADER_GLSL_MULTIPLIED );
 			}
 			return default_shader_multiplied;
 		case FeBlend::Overlay:
 			if ( !default_shader_overlay )
 			{
 				default_shader_overlay = new sf::Shader();
-				default_shader_overlay->loadFromMemory( DEFAULT_SHADER_GLSL_OVERLAY, sf::Shader::Fragment );
+				compile_shader( default_shader_overlay, "overlay blend", NULL, DEFAULT_SHADER_GLSL_OVERLAY );
 			}
 			return default_shader_overlay;
 		case FeBlend::Premultiplied:
 			if ( !default_shader_premultiplied )
 			{
 				default_shader_premultiplied = new sf::Shader();
-				default_shader_premultiplied->loadFromMemory( DEFAULT_SHADER_GLSL_PREMULTIPLIED, sf::Shader::Fragment );
+				compile_shader( default_shader_premultiplied, "premultiplied blend", NULL, DEFAULT_SHADER_GLSL_PREMULTIPLIED );
 			}
 			return default_shader_premultiplied;
 		default:
@@ -123,6 +223,66 @@ sf::Shader* FeBlend::get_default_shader( int blend_mode )
 	}
 }
 
+sf::Shader* FeBlend::get_yuv_shader()
+{
+	if ( yuv_shader_failed || !sf::Shader::isAvailable() )
+		return NULL;
+
+	if ( !yuv_shader )
+	{
+		yuv_shader = new sf::Shader();
+		if ( !compile_shader( yuv_shader, "YUV conversion", NULL, YUV_SHADER_GLSL ) )
+		{
+			FeLog() << "Error compiling YUV conversion shader, using CPU conversion" << std::endl;
+
+			delete yuv_shader;
+			yuv_shader = NULL;
+			yuv_shader_failed = true;
+		}
+	}
+
+	return yuv_shader;
+}
+
+sf::Shader* FeBlend::get_pinch_shader()
+{
+	if ( !pinch_shader_enabled || pinch_shader_failed
+			|| !sf::Shader::isAvailable() )
+		return NULL;
+
+	if ( !pinch_shader )
+	{
+		pinch_shader = new sf::Shader();
+		if ( !compile_shader( pinch_shader, "pinch", PINCH_SHADER_VERT, PINCH_SHADER_FRAG ) )
+		{
+			FeLog() << "Error compiling pinch shader, using CPU geometry" << std::endl;
+
+			delete pinch_shader;
+			pinch_shader = NULL;
+			pinch_shader_failed = true;
+			return NULL;
+		}
+
+#if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
+		pinch_shader->setUniform( "texture", sf::Shader::CurrentTexture );
+#else
+		pinch_shader->setParameter( "texture", sf::Shader::CurrentTexture );
+#endif
+	}
+
+	return pinch_shader;
+}
+
+void FeBlend::set_pinch_shader_enabled( bool e )
+{
+	pinch_shader_enabled = e;
+}
+
+bool FeBlend::get_pinch_shader_enabled()
+{
+	return pinch_shader_enabled;
+}
+
 void FeBlend::clear_default_shaders()
 {
 	if ( default_shader_multiplied )
@@ -142,4 +302,16 @@ void FeBlend::clear_default_shaders()
 		delete default_shader_premultiplied;
 		default_shader_premultiplied = NULL;
 	}
+
+	if ( yuv_shader )
+	{
+		delete yuv_shader;
+		yuv_shader = NULL;
+	}
+
+	if ( pinch_shader )
+	{
+		delete pinch_shader;
+		pinch_shader = NULL;
+	}
 }
@@ -43,6 +43,32 @@ public:
 	static sf::BlendMode get_blend_mode( int blend_mode );
 	static sf::Shader* get_default_shader( int blend_mode );
 
+	//
+	// Shader that draws a video frame from separate Y, U and V plane
+	// textures, converting it to RGB.  Each plane is packed four samples to
+	// a texel (see FeMedia::get_yuv_shader()).  NULL if shaders aren't
+	// available
+	//
+	static sf::Shader* get_yuv_shader();
+
+	//
+	// Shader that draws a pinched/skewed image from a single quad (see
+	// FeSprite::draw()).  The quad's texture coordinates are its local
+	// positions.  NULL if shaders aren't available
+	//
+	static sf::Shader* get_pinch_shader();
+
+	//
+	// Turn the pinch shader off to draw pinched images with CPU geometry
+	// instead (fe.layout.gpu_pinch).  On by default
+	//
+	static void set_pinch_shader_enabled( bool );
+	static bool get_pinch_shader_enabled();
+
+	//
+	// The shaders above are created when first needed and kept until this
+	// is called (at shutdown), so they are compiled once per run
+	//
 	static void clear_default_shaders();
 };
 
@@ -22,6 +22,9 @@
 
 #include "fe_settings.hpp"
 #include "fe_util.hpp"
+#ifndef NO_MOVIE
+#include "media.hpp"
+#endif
 #include <iostream>
 #include <cstring>
 #include <SFML/Graphics/Shader.hpp>
@@ -48,6 +51,7 @@ void process_args( int argc, char *argv[],
 	std::string output_name;
 	FeFilter filter( "" );
 	bool full=false;
+	bool update=false;
 
 	int next_arg=1;
 
@@ -198,6 +202,11 @@ void process_args( int argc, char *argv[],
 			full = true;
 			next_arg++;
 		}
+		else if ( strcmp( argv[next_arg], "--update" ) == 0 )
+		{
+			update = true;
+			next_arg++;
+		}
 		else if (( strcmp( argv[next_arg], "-F" ) == 0 )
 				|| ( strcmp( argv[next_arg], "--filter" ) == 0 ))
 		{
@@ -284,6 +293,12 @@ void process_args( int argc, char *argv[],
 
 			exit(0);
 		}
+#ifndef NO_MOVIE
+		else if ( strcmp( argv[next_arg], "--check-gpu-video" ) == 0 )
+		{
+			exit( FeMedia::check_gpu_conversion() ? 0 : 1 );
+		}
+#endif
 #ifndef SFML_SYSTEM_WINDOWS
 		else if ( strcmp( argv[next_arg], "--console" ) == 0 )
 		{
@@ -319,6 +334,9 @@ void process_args( int argc, char *argv[],
 				<< "     Apply the specified filter rules exception when creating romlist" << std::endl
 				<< "  --full" << std::endl
 				<< "     Use with --build-romlist to include all possible roms [MAME only]" << std::endl
+				<< "  --update" << std::endl
+				<< "     Use with --build-romlist and --output to only process roms that are new" << std::endl
+				<< "     or have changed since the output romlist was last built" << std::endl
 				<< "  -o, --output <romlist>" << std::endl
 				<< "     Specify the name of the romlist to create, overwriting any existing"
 				<< std::endl << std::endl
@@ -335,6 +353,10 @@ void process_args( int argc, char *argv[],
 				<< "     Write log info to the specified file" << std::endl
 				<< "  --loglevel (silent,info,debug)" << std::endl
 				<< "     Set logging level" << std::endl
+#ifndef NO_MOVIE
+				<< "  --check-gpu-video" << std::endl
+				<< "     Check that GPU video colour conversion works with this OpenGL driver" << std::endl
+#endif
 #ifndef SFML_SYSTEM_WINDOWS
 				<< "  --console" << std::endl
 				<< "     Enable script console" << std::endl
@@ -350,7 +372,7 @@ void process_args( int argc, char *argv[],
 		FeSettings feSettings( config_path, cmdln_font );
 		feSettings.load_from_file( feSettings.get_config_dir() + FE_CFG_FILE );
 
-		int retval = feSettings.build_romlist( task_list, output_name, filter, full );
+		int retval = feSettings.build_romlist( task_list, output_name, filter, full, update );
 		exit( retval ? 0 : 1 );
 	}
 }
@@ -2031,6 +2031,27 @@ void FeMiscMenu::get_options( FeConfigContext &ctx )
 	ctx.add_optl( Opt::LIST, "Video Decoder", vid_dec, "_help_video_decoder" );
 	ctx.back_opt().append_vlist( decoders );
 
+	ctx.add_optl( Opt::EDIT,
+			"Video Start Delay",
+			ctx.fe_settings.get_info( FeSettings::VideoStartDelay ),
+			"_help_video_start_delay" );
+
+	ctx.add_optl( Opt::LIST,
+			"GPU Video Colour Conversion",
+			ctx.fe_settings.get_info_bool( FeSettings::GpuVideoConversion ) ? bool_opts[0] : bool_opts[1],
+			"_help_gpu_video_conversion" );
+	ctx.back_opt().append_vlist( bool_opts );
+
+	ctx.add_optl( Opt::EDIT,
+			"Video Read Buffer Size",
+			ctx.fe_settings.get_info( FeSettings::VideoIOBufferKBytes ),
+			"_help_video_io_buffer_kbytes" );
+
+	ctx.add_optl( Opt::EDIT,
+			"Audio Buffer Length",
+			ctx.fe_settings.get_info( FeSettings::AudioBufferMs ),
+			"_help_audio_buffer_ms" );
+
 	ctx.add_optl( Opt::EDIT,
 			"Image Cache Size",
 			ctx.fe_settings.get_info( FeSettings::ImageCacheMBytes ),
@@ -2131,6 +2152,18 @@ bool FeMiscMenu::save( FeConfigContext &ctx )
 	ctx.fe_settings.set_info( FeSettings::VideoDecoder,
 			ctx.opt_list[i++].get_value() );
 
+	ctx.fe_settings.set_info( FeSettings::VideoStartDelay,
+			ctx.opt_list[i++].get_value() );
+
+	ctx.fe_settings.set_info( FeSettings::GpuVideoConversion,
+			ctx.opt_list[i++].get_vindex() == 0 ? FE_CFG_YES_STR : FE_CFG_NO_STR );
+
+	ctx.fe_settings.set_info( FeSettings::VideoIOBufferKBytes,
+			ctx.opt_list[i++].get_value() );
+
+	ctx.fe_settings.set_info( FeSettings::AudioBufferMs,
+			ctx.opt_list[i++].get_value() );
+
 	ctx.fe_settings.set_info( FeSettings::ImageCacheMBytes,
 			ctx.opt_list[i++].get_value() );
 
@@ -30,6 +30,7 @@
 #include "image_loader.hpp"
 
 #include <cstring>
+#include <cmath>
 
 #ifndef NO_MOVIE
 #include "media.hpp"
@@ -152,6 +153,29 @@ bool FeBaseTextureContainer::is_swf() const
 	return false;
 }
 
+const sf::Shader *FeBaseTextureContainer::get_conversion_shader()
+{
+	return NULL;
+}
+
+void FeBaseTextureContainer::on_texture_shared()
+{
+}
+
+void FeBaseTextureContainer::on_size_queried()
+{
+}
+
+sf::IntRect FeBaseTextureContainer::get_texture_rect()
+{
+	sf::Vector2u s = get_texture().getSize();
+	return sf::IntRect( 0, 0, s.x, s.y );
+}
+
+void FeBaseTextureContainer::leave_atlas()
+{
+}
+
 float FeBaseTextureContainer::get_sample_aspect_ratio() const
 {
 	return 1.0;
@@ -188,6 +212,11 @@ bool FeBaseTextureContainer::tick( FeSettings *feSettings, bool play_movies )
 	return false;
 }
 
+bool FeBaseTextureContainer::get_next_tick_due( sf::Time &t )
+{
+	return false;
+}
+
 FeTextureContainer *FeBaseTextureContainer::get_derived_texture_container()
 {
 	return NULL;
@@ -210,6 +239,20 @@ void FeBaseTextureContainer::notify_texture_change()
 		(*itr)->texture_changed();
 }
 
+void FeBaseTextureContainer::notify_texture_moved( const sf::Vector2i &old_origin )
+{
+	for ( std::vector<FeImage *>::iterator itr=m_images.begin();
+			itr != m_images.end(); ++itr )
+		(*itr)->texture_moved( old_origin );
+}
+
+void FeBaseTextureContainer::notify_texture_update()
+{
+	for ( std::vector<FeImage *>::iterator itr=m_images.begin();
+			itr != m_images.end(); ++itr )
+		(*itr)->flag_redraw();
+}
+
 void FeBaseTextureContainer::release_audio( bool )
 {
 }
@@ -226,12 +269,19 @@ namespace
 	// been experienced at 2 when returning from games).
 	//
 	const int PLAY_COUNT=5;
+
+	//
+	// Video target sizes are rounded up to a multiple of this, so that an
+	// image being resized doesn't make the decoder reallocate every frame
+	//
+	const unsigned int TARGET_STEP=64;
 };
 
 FeTextureContainer::FeTextureContainer(
 	bool is_artwork,
 	const std::string &art_name )
-	: m_index_offset( 0 ),
+	: m_atlas_region( NULL ),
+	m_index_offset( 0 ),
 	m_filter_offset( 0 ),
 	m_current_rom_index( -1 ),
 	m_current_filter_index( -1 ),
@@ -243,7 +293,14 @@ FeTextureContainer::FeTextureContainer(
 	m_mipmap( false ),
 	m_smooth( false ),
 	m_frame_displayed( false ),
+	m_texture_shared( false ),
+	m_size_queried( false ),
+	m_movie_target( 0, 0 ),
 	m_entry( NULL )
+#ifndef NO_MOVIE
+	, m_video_entry( NULL ),
+	m_video_pending( false )
+#endif
 {
 	if ( is_artwork )
 	{
@@ -262,6 +319,8 @@ FeTextureContainer::FeTextureContainer(
 FeTextureContainer::~FeTextureContainer()
 {
 #ifndef NO_MOVIE
+	cancel_pending_video();
+
 	if ( m_movie )
 	{
 		delete m_movie;
@@ -277,11 +336,13 @@ FeTextureContainer::~FeTextureContainer()
 	}
 #endif
 
+	FeImageLoader &il = FeImageLoader::get_ref();
+
 	if ( m_entry )
-	{
-		FeImageLoader &il = FeImageLoader::get_ref();
 		il.release_entry( &m_entry );
-	}
+
+	if ( m_atlas_region )
+		il.release_atlas_region( &m_atlas_region );
 }
 
 bool FeTextureContainer::get_visible() const
@@ -296,6 +357,8 @@ bool FeTextureContainer::fix_masked_image()
 {
 	bool retval=false;
 
+	leave_atlas();
+
 	sf::Image tmp_img = m_texture.copyToImage();
 	sf::Vector2u tmp_s = tmp_img.getSize();
 
@@ -386,6 +449,195 @@ bool FeTextureContainer::load_with_ffmpeg(
 	m_file_name = loaded_name;
 	return true;
 }
+
+void FeTextureContainer::update_movie_display_hints()
+{
+	//
+	// Priority is how much of the screen this video covers, larger videos
+	// get decoded first when the CPU is busy.
+	//
+	// The target size lets the decoder convert frames straight to the size
+	// they are displayed at.  Only done when every visible image is sized
+	// by the layout, doesn't preserve its aspect ratio and draws the whole
+	// texture without a shader, and no script has read the texture size, so
+	// that anything depending on the video's native size is left alone.
+	//
+	// Converting to RGB on the GPU is only allowed if nothing but the
+	// images drawing this video with a plain blend mode uses the texture.
+	//
+	float area( 0.f );
+	sf::Vector2f target( 0.f, 0.f );
+	bool native = m_size_queried;
+	bool gpu = !m_texture_shared && !m_mipmap && !m_texture.isRepeated()
+		&& sf::Shader::isAvailable();
+
+	FePresent *fep = FePresent::script_get_fep();
+	float scale_x = fep ? std::max( fep->get_layout_scale_x(), 1.f ) : 1.f;
+	float scale_y = fep ? std::max( fep->get_layout_scale_y(), 1.f ) : 1.f;
+
+	for ( std::vector<FeImage *>::iterator itr=m_images.begin();
+			itr != m_images.end(); ++itr )
+	{
+		if ( !(*itr)->FeBasePresentable::get_visible() )
+			continue;
+
+		const sf::Vector2f &s = (*itr)->getSize();
+		area += std::fabs( s.x * s.y );
+
+		sf::Vector2u ts = m_texture.getSize();
+		if ( (*itr)->get_shader()
+				|| ( (*itr)->getTextureRect() != sf::IntRect( 0, 0, ts.x, ts.y ) ))
+		{
+			native = true;
+			gpu = false;
+		}
+		else if (( s.x <= 0.f ) || ( s.y <= 0.f )
+				|| (*itr)->get_preserve_aspect_ratio() )
+			native = true;
+
+		switch ( (*itr)->get_blend_mode() )
+		{
+			case FeBlend::Alpha:
+			case FeBlend::Add:
+			case FeBlend::Subtract:
+			case FeBlend::None:
+				break;
+			default:
+				gpu = false; // blend mode draws with its own shader
+				break;
+		}
+
+		target.x = std::max( target.x, s.x * scale_x );
+		target.y = std::max( target.y, s.y * scale_y );
+	}
+
+	m_movie->set_priority( area );
+	m_movie->set_gpu_conversion_allowed( gpu );
+
+	sf::Vector2u t( 0, 0 );
+	if ( !native )
+	{
+		t.x = ( (unsigned int)std::ceil( target.x ) + TARGET_STEP - 1 ) / TARGET_STEP * TARGET_STEP;
+		t.y = ( (unsigned int)std::ceil( target.y ) + TARGET_STEP - 1 ) / TARGET_STEP * TARGET_STEP;
+
+		//
+		// Grow straight away so the video stays sharp, but only shrink once
+		// the image is a good bit smaller than what we are converting to
+		//
+		if (( m_movie_target.x > 0 ) && ( t.x <= m_movie_target.x ) && ( t.y <= m_movie_target.y )
+				&& ( t.x * 4 > m_movie_target.x * 3 ) && ( t.y * 4 > m_movie_target.y * 3 ))
+			t = m_movie_target;
+	}
+
+	if ( t != m_movie_target )
+	{
+		m_movie_target = t;
+		m_movie->set_target_size( t );
+	}
+}
+
+bool FeTextureContainer::defer_video(
+	FeSettings *feSettings,
+	const std::string &path,
+	const std::string &filename )
+{
+	if (( feSettings->video_start_delay() <= 0 )
+			|| !FeMedia::is_supported_media_file( filename ))
+		return false;
+
+#ifndef NO_SWF
+	if ( tail_compare( filename, FE_SWF_EXT ) )
+		return false;
+#endif
+
+	std::string loaded_name;
+	if ( is_supported_archive( path ) )
+	{
+		loaded_name = path + "|" + filename;
+		if ( !file_exists( path ) )
+			return false;
+	}
+	else
+	{
+		loaded_name = path + filename;
+		if ( !file_exists( loaded_name ) )
+			return false;
+	}
+
+	// already showing it
+	if ( loaded_name.compare( m_file_name ) == 0 )
+		return false;
+
+	m_pending_path = path;
+	m_pending_file = filename;
+	m_pending_name = loaded_name;
+	m_video_pending = true;
+	m_pending_clock.restart();
+	return true;
+}
+
+void FeTextureContainer::tick_pending_video( FeSettings *feSettings )
+{
+	FeImageLoader &il = FeImageLoader::get_ref();
+
+	if ( !m_video_entry )
+	{
+		if ( m_pending_clock.getElapsedTime().asMilliseconds()
+				< feSettings->video_start_delay() )
+			return;
+
+		if ( is_supported_archive( m_pending_path ) )
+			m_video_entry = il.load_video( m_pending_path, m_pending_file );
+		else
+			m_video_entry = il.load_video( "", m_pending_path + m_pending_file );
+
+		return;
+	}
+
+	if ( !il.check_video_loaded( m_video_entry ) )
+		return;
+
+	FeMedia *m = m_video_entry->take_media();
+	il.release_video_entry( &m_video_entry );
+	m_video_pending = false;
+
+	if ( !m )
+		return;
+
+	//
+	// Keep showing the static artwork (if there is any) until the video's
+	// first frame is ready.  The video draws to m_texture, so artwork in the
+	// texture atlas is moved there first
+	//
+	leave_atlas();
+	bool showing_art = !m_entry && ( m_texture.getSize().x > 0 );
+
+	clear();
+
+	m_movie = m;
+	m_movie->set_display_texture( &m_texture );
+
+	if ( m_video_flags & VF_NoAutoStart )
+		m_movie_status = 0;
+	else
+		m_movie_status = 1;
+
+	m_frame_displayed = showing_art;
+	m_texture.setSmooth( m_smooth );
+
+	m_file_name = m_pending_name;
+}
+
+void FeTextureContainer::cancel_pending_video()
+{
+	if ( m_video_entry )
+	{
+		FeImageLoader &il = FeImageLoader::get_ref();
+		il.release_video_entry( &m_video_entry );
+	}
+
+	m_video_pending = false;
+}
 #endif
 
 bool FeTextureContainer::try_to_load(
@@ -468,8 +720,10 @@ bool FeTextureContainer::try_to_load(
 
 	FeImageLoader &il = FeImageLoader::get_ref();
 	unsigned char *data = NULL;
+	bool in_archive = is_supported_archive( path );
+	std::string temp = filename;
 
-	if ( is_supported_archive( path ) )
+	if ( in_archive )
 	{
 		loaded_name = path + "|" + filename;
 		if ( loaded_name.compare( m_file_name ) == 0 )
@@ -484,7 +738,6 @@ bool FeTextureContainer::try_to_load(
 		}
 
 		FeZipStream zs( path );
-		std::string temp = filename;
 
 		if ( !zs.open( filename ) )
 		{
@@ -497,9 +750,6 @@ bool FeTextureContainer::try_to_load(
 				loaded_name = path + "|" + temp;
 			}
 		}
-
-		if ( il.load_image_from_archive( path, temp, &m_entry ) )
-			data = m_entry->get_data();
 	}
 	else
 	{
@@ -514,12 +764,34 @@ bool FeTextureContainer::try_to_load(
 			m_texture = sf::Texture();
 			return false;
 		}
+	}
+
+	m_file_name = loaded_name;
+
+	//
+	// Check if the image is already in the texture atlas.  If it is, we
+	// don't need to load it at all
+	//
+	if ( can_use_atlas() )
+	{
+		m_atlas_region = il.get_atlas_region( loaded_name, m_smooth );
+		if ( m_atlas_region )
+		{
+			m_texture = sf::Texture();
+			return true;
+		}
+	}
 
-		if ( il.load_image_from_file( loaded_name, &m_entry ) )
+	if ( in_archive )
+	{
+		if ( il.load_image_from_archive( path, temp, &m_entry ) )
 			data = m_entry->get_data();
 	}
+	else if ( il.load_image_from_file( loaded_name, &m_entry ) )
+		data = m_entry->get_data();
 
-	m_file_name = loaded_name;
+	if ( data && place_in_atlas() )
+		return true;
 
 	// resize our texture accordingly
 	if ( m_texture.getSize() != sf::Vector2u( m_entry->get_width(), m_entry->get_height() ) )
@@ -545,9 +817,95 @@ const sf::Texture &FeTextureContainer::get_texture()
 	if ( m_swf )
 		return m_swf->get_texture();
 #endif
+	if ( m_atlas_region )
+		return m_atlas_region->get_texture();
+
 	return m_texture;
 }
 
+sf::IntRect FeTextureContainer::get_texture_rect()
+{
+	if ( m_atlas_region )
+		return m_atlas_region->get_rect();
+
+	return FeBaseTextureContainer::get_texture_rect();
+}
+
+bool FeTextureContainer::can_use_atlas() const
+{
+	//
+	// Images that get mipmapped, repeated or used by a shader need the
+	// whole texture to themselves
+	//
+	if ( !FeImageLoader::get_ref().get_atlas_mode()
+			|| m_texture_shared || m_mipmap || m_texture.isRepeated() )
+		return false;
+
+	for ( std::vector<FeImage *>::const_iterator itr=m_images.begin();
+			itr != m_images.end(); ++itr )
+	{
+		if ( (*itr)->get_shader() )
+			return false;
+	}
+
+	return true;
+}
+
+bool FeTextureContainer::place_in_atlas()
+{
+	if ( !m_entry || !can_use_atlas() )
+		return false;
+
+	FeImageLoader &il = FeImageLoader::get_ref();
+	m_atlas_region = il.atlas_image( m_file_name,
+		m_entry->get_width(), m_entry->get_height(),
+		m_entry->get_data(), m_smooth );
+
+	if ( !m_atlas_region )
+		return false;
+
+	il.release_entry( &m_entry );
+	m_texture = sf::Texture();
+	return true;
+}
+
+void FeTextureContainer::move_atlas_image( bool to_atlas )
+{
+	if ( !m_atlas_region )
+		return;
+
+	FeImageLoader &il = FeImageLoader::get_ref();
+	sf::IntRect r = m_atlas_region->get_rect();
+
+	sf::Image img;
+	img.create( r.width, r.height );
+	img.copy( m_atlas_region->get_texture().copyToImage(), 0, 0, r );
+
+	il.release_atlas_region( &m_atlas_region );
+
+	if ( to_atlas )
+	{
+		m_atlas_region = il.get_atlas_region( m_file_name, m_smooth );
+
+		if ( !m_atlas_region )
+			m_atlas_region = il.atlas_image( m_file_name, r.width, r.height,
+				img.getPixelsPtr(), m_smooth );
+	}
+
+	if ( !m_atlas_region )
+	{
+		m_texture.loadFromImage( img );
+		m_texture.setSmooth( m_smooth );
+	}
+
+	notify_texture_moved( sf::Vector2i( r.left, r.top ) );
+}
+
+void FeTextureContainer::leave_atlas()
+{
+	move_atlas_image( false );
+}
+
 void FeTextureContainer::on_new_selection( FeSettings *feSettings )
 {
 	if (( m_type != IsStatic ) && ( m_art_update_trigger == ToNewSelection ))
@@ -591,13 +949,18 @@ void FeTextureContainer::internal_update_selection( FeSettings *feSettings )
 	m_current_rom_index = rom_index;
 	m_current_filter_index = filter_index;
 
+#ifndef NO_MOVIE
+	cancel_pending_video();
+#endif
+
 	std::vector<std::string> vid_list;
 	std::vector<std::string> image_list;
 	std::string archive_name; // empty if no archive
+	FeRomInfo *rom=NULL;
 
 	if ( m_type == IsArtwork )
 	{
-		FeRomInfo *rom	= feSettings->get_rom_absolute( filter_index, rom_index );
+		rom = feSettings->get_rom_absolute( filter_index, rom_index );
 		if ( !rom )
 			return;
 
@@ -647,6 +1010,27 @@ void FeTextureContainer::internal_update_selection( FeSettings *feSettings )
 			}
 		}
 
+		//
+		// While scrolling, the static artwork is shown in place of the video
+		//
+		if ( defer_video( feSettings, path, filename ) )
+		{
+			//
+			// get_best_artwork_file() doesn't look for images once it
+			// has found a video, so look for them now
+			//
+			if ( rom && image_list.empty() )
+			{
+				std::vector<std::string> temp;
+				feSettings->get_best_artwork_file( *rom,
+					m_art_name,
+					temp,
+					image_list,
+					true );
+			}
+			break;
+		}
+
 		if ( try_to_load( path, filename ) )
 		{
 			loaded = true;
@@ -689,6 +1073,12 @@ void FeTextureContainer::internal_update_selection( FeSettings *feSettings )
 				}
 			}
 		}
+
+#ifndef NO_MOVIE
+		if ( m_video_pending )
+			FeDebug() << "Video deferred: " << m_pending_name << ", showing: "
+				<< ( loaded ? m_file_name : "[no image]" ) << std::endl;
+#endif
 	}
 
 	//
@@ -707,6 +1097,12 @@ bool FeTextureContainer::tick( FeSettings *feSettings, bool play_movies )
 		FeImageLoader &il = FeImageLoader::get_ref();
 		if ( il.check_loaded( m_entry ) )
 		{
+			if ( place_in_atlas() )
+			{
+				notify_texture_change();
+				return true;
+			}
+
 			m_texture.update( m_entry->get_data() );
 #if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
 			if ( m_mipmap ) m_texture.generateMipmap();
@@ -721,6 +1117,11 @@ bool FeTextureContainer::tick( FeSettings *feSettings, bool play_movies )
 	if ( !play_movies || (m_video_flags & VF_DisableVideo) )
 		return false;
 
+#ifndef NO_MOVIE
+	if ( m_video_pending )
+		tick_pending_video( feSettings );
+#endif
+
 #ifndef NO_SWF
 	if ( m_swf && m_movie_status )
 		return m_swf->tick();
@@ -729,6 +1130,8 @@ bool FeTextureContainer::tick( FeSettings *feSettings, bool play_movies )
 #ifndef NO_MOVIE
 	if (( m_movie ) && ( m_movie_status > 0 ))
 	{
+		update_movie_display_hints();
+
 		if ( m_movie_status < PLAY_COUNT )
 		{
 			//
@@ -755,7 +1158,12 @@ bool FeTextureContainer::tick( FeSettings *feSettings, bool play_movies )
 			m_movie->play();
 		}
 
-		// restart looped video
+		//
+		// Looped video normally loops in place, but still gets restarted
+		// here if it stops (for example after falling far behind)
+		//
+		m_movie->set_video_loop( !(m_video_flags & VF_NoLoop) );
+
 		if ( !(m_video_flags & VF_NoLoop) && !m_movie->is_playing() )
 		{
 			m_movie->stop();
@@ -764,8 +1172,14 @@ bool FeTextureContainer::tick( FeSettings *feSettings, bool play_movies )
 			FeDebug() << "Restarted looped video" << std::endl;
 		}
 
+		sf::Vector2u old_size = m_texture.getSize();
+
 		if ( m_movie->tick() )
 		{
+			// the video's frame size changes if it gets displayed at a different size
+			if ( m_texture.getSize() != old_size )
+				notify_texture_change();
+
 			m_frame_displayed=true;
 #if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
 			if ( m_mipmap ) m_texture.generateMipmap();
@@ -778,6 +1192,59 @@ bool FeTextureContainer::tick( FeSettings *feSettings, bool play_movies )
 	return false;
 }
 
+bool FeTextureContainer::get_next_tick_due( sf::Time &t )
+{
+	//
+	// Images and videos being loaded in the background get checked on
+	// every so often
+	//
+	const sf::Time POLL_TIME = sf::milliseconds( 10 );
+
+	if ( m_entry )
+	{
+		t = POLL_TIME;
+		return true;
+	}
+
+#ifndef NO_MOVIE
+	if ( m_video_pending )
+	{
+		t = POLL_TIME;
+		return true;
+	}
+
+	if ( m_movie && ( m_movie_status > 0 ))
+	{
+		// the first few ticks before playing starts are counted
+		if ( m_movie_status <= PLAY_COUNT )
+		{
+			t = sf::Time::Zero;
+			return true;
+		}
+
+		if ( m_movie->get_next_frame_due( t ) )
+			return true;
+
+		// looped video that stopped gets restarted on the next tick
+		if ( !(m_video_flags & VF_NoLoop) )
+		{
+			t = sf::Time::Zero;
+			return true;
+		}
+	}
+#endif
+
+#ifndef NO_SWF
+	if ( m_swf && m_movie_status )
+	{
+		t = sf::Time::Zero;
+		return true;
+	}
+#endif
+
+	return false;
+}
+
 void FeTextureContainer::set_play_state( bool play )
 {
 #ifndef NO_SWF
@@ -930,6 +1397,10 @@ void FeTextureContainer::load_from_archive( const char *a, const char *n )
 {
 	std::string path, filename = clean_path( n );
 
+#ifndef NO_MOVIE
+	cancel_pending_video();
+#endif
+
 	if ( filename.empty() )
 	{
 		clear();
@@ -954,6 +1425,14 @@ void FeTextureContainer::load_from_archive( const char *a, const char *n )
 
 const char *FeTextureContainer::get_file_name() const
 {
+#ifndef NO_MOVIE
+	//
+	// m_file_name is the artwork shown in the meantime (which is also its
+	// texture atlas key), report the video that is on its way instead
+	//
+	if ( m_video_pending )
+		return m_pending_name.c_str();
+#endif
 	return m_file_name.c_str();
 }
 
@@ -993,6 +1472,7 @@ void FeTextureContainer::clear()
 	m_movie_status = -1;
 	m_frame_displayed = false;
 	m_file_name.clear();
+	m_movie_target = sf::Vector2u( 0, 0 );
 
 #ifndef NO_SWF
 	if ( m_swf )
@@ -1012,11 +1492,13 @@ void FeTextureContainer::clear()
 	}
 #endif
 
+	FeImageLoader &il = FeImageLoader::get_ref();
+
 	if ( m_entry )
-	{
-		FeImageLoader &il = FeImageLoader::get_ref();
 		il.release_entry( &m_entry );
-	}
+
+	if ( m_atlas_region )
+		il.release_atlas_region( &m_atlas_region );
 }
 
 void FeTextureContainer::set_smooth( bool s )
@@ -1027,6 +1509,10 @@ void FeTextureContainer::set_smooth( bool s )
 		m_swf->set_smooth( s );
 #endif
 	m_texture.setSmooth( s );
+
+	// smoothed and unsmoothed images are kept on separate atlas pages
+	if ( m_atlas_region && ( m_atlas_region->is_smooth() != s ))
+		move_atlas_image( true );
 }
 
 bool FeTextureContainer::get_smooth() const
@@ -1037,6 +1523,9 @@ bool FeTextureContainer::get_smooth() const
 void FeTextureContainer::set_mipmap( bool m )
 {
 	m_mipmap = m;
+	if ( m_mipmap )
+		leave_atlas();
+
 #if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
 	if ( m_mipmap && !m_movie) m_texture.generateMipmap();
 #endif
@@ -1049,6 +1538,9 @@ bool FeTextureContainer::get_mipmap() const
 
 void FeTextureContainer::set_repeat( bool r )
 {
+	if ( r )
+		leave_atlas();
+
 	m_texture.setRepeated( r );
 }
 
@@ -1057,6 +1549,35 @@ bool FeTextureContainer::get_repeat() const
 	return m_texture.isRepeated();
 }
 
+const sf::Shader *FeTextureContainer::get_conversion_shader()
+{
+#ifndef NO_MOVIE
+	if ( m_movie )
+		return m_movie->get_yuv_shader( m_smooth );
+#endif
+
+	return NULL;
+}
+
+void FeTextureContainer::on_size_queried()
+{
+	if ( m_size_queried )
+		return;
+
+	m_size_queried = true;
+
+#ifndef NO_MOVIE
+	if ( m_movie )
+		update_movie_display_hints();
+#endif
+}
+
+void FeTextureContainer::on_texture_shared()
+{
+	leave_atlas();
+	m_texture_shared = true;
+}
+
 bool FeTextureContainer::is_swf() const
 {
 	return m_swf;
@@ -1079,8 +1600,17 @@ void FeTextureContainer::release_audio( bool state )
 #endif
 }
 
+namespace
+{
+	int g_surface_redraws=0;
+	int g_surface_skipped=0;
+};
+
 FeSurfaceTextureContainer::FeSurfaceTextureContainer( int width, int height )
-	: m_clear( true )
+	: m_clear( true ),
+	m_dirty( true ),
+	m_drawn_elements( 0 ),
+	m_shader_changes( 0 )
 {
 	m_texture.create( width, height );
 }
@@ -1105,6 +1635,8 @@ void FeSurfaceTextureContainer::on_new_selection( FeSettings *s )
 	for ( std::vector<FeBasePresentable *>::iterator itr = elements.begin();
 				itr != elements.end(); ++itr )
 		(*itr)->on_new_selection( s );
+
+	m_dirty = true;
 }
 
 void FeSurfaceTextureContainer::on_end_navigation( FeSettings *feSettings )
@@ -1120,22 +1652,62 @@ void FeSurfaceTextureContainer::on_new_list( FeSettings *s, bool )
 	for ( std::vector<FeBasePresentable *>::iterator itr = elements.begin();
 				itr != elements.end(); ++itr )
 		(*itr)->on_new_list( s );
+
+	m_dirty = true;
 }
 
 void FeSurfaceTextureContainer::on_redraw_surfaces()
 {
+	//
+	// Only redraw if something drawn on the surface changed.  Elements flag
+	// their own changes (and those of the textures they show), shaders are
+	// checked here since they can be shared by anything
+	//
+	unsigned int shader_changes=0;
+	for ( std::vector<FeBasePresentable *>::const_iterator itr = elements.begin();
+				itr != elements.end(); ++itr )
+	{
+		FeShader *sh = (*itr)->get_shader();
+		if ( sh && (*itr)->get_visible() )
+		{
+			// can't tell when other images' textures used by the shader change
+			if ( sh->uses_image_texture() )
+				m_dirty = true;
+
+			shader_changes += sh->get_param_changes();
+		}
+	}
+
+	if ( !m_dirty && ( m_drawn_elements == elements.size() )
+			&& ( m_shader_changes == shader_changes ))
+	{
+		g_surface_skipped++;
+		return;
+	}
+
+	m_dirty = false;
+	m_drawn_elements = elements.size();
+	m_shader_changes = shader_changes;
+	g_surface_redraws++;
+
 	//
 	// Draw the surface's draw list to the render texture
 	//
 	if ( m_clear ) m_texture.clear( sf::Color::Transparent );
+	m_batch.begin( m_texture );
+
 	for ( std::vector<FeBasePresentable *>::const_iterator itr = elements.begin();
 				itr != elements.end(); ++itr )
 	{
 		if ( (*itr)->get_visible() )
-			m_texture.draw( (*itr)->drawable() );
+			(*itr)->draw_batched( m_batch, sf::RenderStates::Default );
 	}
 
+	m_batch.end();
 	m_texture.display();
+
+	// anything showing this surface needs redrawing now too
+	notify_texture_update();
 }
 
 void FeSurfaceTextureContainer::set_smooth( bool s )
@@ -1159,7 +1731,11 @@ bool FeSurfaceTextureContainer::get_mipmap() const
 
 void FeSurfaceTextureContainer::set_clear( bool c )
 {
-	m_clear = c;
+	if ( c != m_clear )
+	{
+		m_clear = c;
+		m_dirty = true;
+	}
 }
 
 bool FeSurfaceTextureContainer::get_clear() const
@@ -1182,6 +1758,27 @@ FePresentableParent *FeSurfaceTextureContainer::get_presentable_parent()
 	return this;
 }
 
+void FeSurfaceTextureContainer::on_element_change()
+{
+	m_dirty = true;
+}
+
+int FeSurfaceTextureContainer::get_redraw_count()
+{
+	return g_surface_redraws;
+}
+
+int FeSurfaceTextureContainer::get_skipped_redraw_count()
+{
+	return g_surface_skipped;
+}
+
+void FeSurfaceTextureContainer::reset_redraw_counts()
+{
+	g_surface_redraws=0;
+	g_surface_skipped=0;
+}
+
 FeImage::FeImage( FePresentableParent &p,
 	FeBaseTextureContainer *tc, float x, float y, float w, float h )
 	: FeBasePresentable( p ),
@@ -1217,7 +1814,12 @@ FeImage::~FeImage()
 const sf::Texture *FeImage::get_texture()
 {
 	if ( m_tex )
+	{
+		// the texture is going to be used by a shader, so it has to hold
+		// the actual image from now on
+		m_tex->on_texture_shared();
 		return &(m_tex->get_texture());
+	}
 	else
 		return NULL;
 }
@@ -1239,10 +1841,36 @@ void FeImage::texture_changed( FeBaseTextureContainer *new_tex )
 	m_sprite.setTexture( m_tex->get_texture() );
 
 	//  reset texture rect now to the one reported by the new texture object
-	m_sprite.setTextureRect(
-		sf::IntRect( 0, 0, m_tex->get_texture().getSize().x, m_tex->get_texture().getSize().y ) );
+	m_sprite.setTextureRect( m_tex->get_texture_rect() );
 
 	scale();
+	flag_redraw();
+}
+
+void FeImage::texture_moved( const sf::Vector2i &old_origin )
+{
+	//
+	// Keep the subimg the script set, relative to the image's new spot
+	//
+	sf::IntRect r = m_sprite.getTextureRect();
+	sf::IntRect tr = m_tex->get_texture_rect();
+	r.left += tr.left - old_origin.x;
+	r.top += tr.top - old_origin.y;
+
+	m_sprite.setTexture( m_tex->get_texture() );
+	m_sprite.setTextureRect( r );
+
+	flag_redraw();
+}
+
+void FeImage::script_set_shader( FeShader *sh )
+{
+	// shaders work with the texture coordinates of the whole texture,
+	// so the image can't stay in the texture atlas
+	if ( sh && m_tex )
+		m_tex->leave_atlas();
+
+	FeBasePresentable::script_set_shader( sh );
 }
 
 int FeImage::getIndexOffset() const
@@ -1284,7 +1912,10 @@ bool FeImage::fix_masked_image()
 void FeImage::draw(sf::RenderTarget& target, sf::RenderStates states) const
 {
 	FeShader *s = get_shader();
-	if ( s )
+	const sf::Shader *cs = m_tex->get_conversion_shader();
+	if ( cs )
+		states.shader = cs;
+	else if ( s )
 	{
 		const sf::Shader *sh = s->get_shader();
 		if ( sh )
@@ -1293,12 +1924,36 @@ void FeImage::draw(sf::RenderTarget& target, sf::RenderStates states) const
 	else
 		states.shader = FeBlend::get_default_shader( m_blend_mode );
 
+	set_blend_states( states );
+	target.draw( m_sprite, states );
+}
+
+void FeImage::draw_batched( FeDrawBatch &batch, const sf::RenderStates &states ) const
+{
+	//
+	// Custom shaders can depend on the image's own transform, and the
+	// conversion shader is set up for this image's texture, so those are
+	// drawn on their own
+	//
+	if ( get_shader() || m_tex->get_conversion_shader() )
+	{
+		batch.draw( *this, states );
+		return;
+	}
+
+	sf::RenderStates s( states );
+	s.shader = FeBlend::get_default_shader( m_blend_mode );
+	set_blend_states( s );
+
+	m_sprite.drawBatched( batch, s );
+}
+
+void FeImage::set_blend_states( sf::RenderStates &states ) const
+{
 	if (( m_tex->is_swf() ) && ( m_blend_mode == FeBlend::Alpha ))
 		states.blendMode = FeBlend::get_blend_mode( FeBlend::Premultiplied );
 	else
 		states.blendMode = FeBlend::get_blend_mode( m_blend_mode );
-
-	target.draw( m_sprite, states );
 }
 
 void FeImage::scale()
@@ -1385,7 +2040,7 @@ void FeImage::setSize( const sf::Vector2f &s )
 	{
 		m_size = s;
 		scale();
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -1395,7 +2050,7 @@ void FeImage::setPosition( const sf::Vector2f &p )
 	{
 		m_pos = p;
 		scale();
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -1410,7 +2065,7 @@ void FeImage::setRotation( float r )
 	{
 		m_sprite.setRotation( r );
 		scale();
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -1424,27 +2079,39 @@ void FeImage::setColor( const sf::Color &c )
 	if ( c != m_sprite.getColor() )
 	{
 		m_sprite.setColor( c );
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
 const sf::Vector2u FeImage::getTextureSize() const
 {
-	return m_tex->get_texture().getSize();
+	sf::IntRect tr = m_tex->get_texture_rect();
+	return sf::Vector2u( tr.width, tr.height );
 }
 
-const sf::IntRect &FeImage::getTextureRect() const
+sf::IntRect FeImage::getTextureRect() const
 {
-	return m_sprite.getTextureRect();
+	//
+	// Report the rect relative to the image, which isn't at the origin of
+	// the texture if it is in the texture atlas
+	//
+	sf::IntRect r = m_sprite.getTextureRect();
+	sf::IntRect tr = m_tex->get_texture_rect();
+	r.left -= tr.left;
+	r.top -= tr.top;
+	return r;
 }
 
 void FeImage::setTextureRect( const sf::IntRect &r )
 {
-	if ( r != m_sprite.getTextureRect() )
+	sf::IntRect tr = m_tex->get_texture_rect();
+	sf::IntRect sr( r.left + tr.left, r.top + tr.top, r.width, r.height );
+
+	if ( sr != m_sprite.getTextureRect() )
 	{
-		m_sprite.setTextureRect( r );
+		m_sprite.setTextureRect( sr );
 		scale();
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -1569,7 +2236,7 @@ void FeImage::set_origin_x( float x )
 	{
 		m_origin.x = x;
 		scale();
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -1579,7 +2246,7 @@ void FeImage::set_origin_y( float y )
 	{
 		m_origin.y = y;
 		scale();
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 void FeImage::set_skew_x( int x )
@@ -1587,7 +2254,7 @@ void FeImage::set_skew_x( int x )
 	if ( x != m_sprite.getSkewX() )
 	{
 		m_sprite.setSkewX( x );
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -1596,7 +2263,7 @@ void FeImage::set_skew_y( int y )
 	if ( y != m_sprite.getSkewY() )
 	{
 		m_sprite.setSkewY( y );
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -1605,7 +2272,7 @@ void FeImage::set_pinch_x( int x )
 	if ( x != m_sprite.getPinchX() )
 	{
 		m_sprite.setPinchX( x );
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -1614,17 +2281,19 @@ void FeImage::set_pinch_y( int y )
 	if ( y != m_sprite.getPinchY() )
 	{
 		m_sprite.setPinchY( y );
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
 int FeImage::get_texture_width() const
 {
+	m_tex->on_size_queried();
 	return getTextureSize().x;
 }
 
 int FeImage::get_texture_height() const
 {
+	m_tex->on_size_queried();
 	return getTextureSize().y;
 }
 
@@ -1694,6 +2363,7 @@ void FeImage::set_preserve_aspect_ratio( bool p )
 void FeImage::set_mipmap( bool m )
 {
 	m_tex->set_mipmap( m );
+	flag_redraw();
 }
 
 bool FeImage::get_mipmap() const
@@ -1714,6 +2384,7 @@ bool FeImage::get_clear() const
 void FeImage::set_repeat( bool r )
 {
 	m_tex->set_repeat( r );
+	flag_redraw();
 }
 
 bool FeImage::get_repeat() const
@@ -1736,6 +2407,7 @@ void FeImage::transition_swap( FeImage *o )
 void FeImage::set_smooth( bool s )
 {
 	m_tex->set_smooth( s );
+	flag_redraw();
 }
 
 bool FeImage::get_smooth() const
@@ -1750,7 +2422,11 @@ int FeImage::get_blend_mode() const
 
 void FeImage::set_blend_mode( int b )
 {
-	m_blend_mode = (FeBlend::Mode)b;
+	if ( b != m_blend_mode )
+	{
+		m_blend_mode = (FeBlend::Mode)b;
+		flag_redraw();
+	}
 }
 
 FeImage *FeImage::add_image(const char *n, int x, int y, int w, int h)
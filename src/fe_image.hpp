@@ -27,6 +27,7 @@
 #include "sprite.hpp"
 #include "fe_presentable.hpp"
 #include "fe_blend.hpp"
+#include "fe_batch.hpp"
 
 class FeSettings;
 class FeMedia;
@@ -36,6 +37,8 @@ class FeText;
 class FeListBox;
 class FeTextureContainer;
 class FeImageLoaderEntry;
+class FeVideoLoaderEntry;
+class FeAtlasRegion;
 
 enum FeVideoFlags
 {
@@ -53,6 +56,13 @@ public:
 
 	virtual const sf::Texture &get_texture()=0;
 
+	// The area of get_texture() that holds the image.  This is only part of
+	// the texture when the image is in the image loader's texture atlas
+	virtual sf::IntRect get_texture_rect();
+
+	// Move the image out of the texture atlas into its own texture
+	virtual void leave_atlas();
+
 	virtual void on_new_selection( FeSettings *feSettings )=0;
 	virtual void on_end_navigation( FeSettings *feSettings )=0;
 
@@ -61,6 +71,10 @@ public:
 	virtual bool get_visible() const;
 	virtual bool tick( FeSettings *feSettings, bool play_movies ); // returns true if redraw required
 
+	// Set t to how long until tick() next has something to do (a video frame
+	// due etc).  Returns false if there is nothing coming up
+	virtual bool get_next_tick_due( sf::Time &t );
+
 	virtual void set_play_state( bool play );
 	virtual bool get_play_state() const;
 	virtual void set_vol( float vol );
@@ -98,12 +112,26 @@ public:
 	virtual bool is_swf() const;
 	virtual float get_sample_aspect_ratio() const;
 
+	// Returns the shader needed to draw the texture if it doesn't hold the
+	// image itself (a video converted from YUV on the GPU), otherwise NULL
+	virtual const sf::Shader *get_conversion_shader();
+
+	// Called when the texture gets used other than by the registered images
+	virtual void on_texture_shared();
+
+	// Called when a script reads the texture's size
+	virtual void on_size_queried();
+
 	// function for use with surface objects
 	//
 	virtual FePresentableParent *get_presentable_parent();
 
 	void register_image( FeImage * );
 
+	// call this when the texture's contents were updated (a new video frame etc)
+	// so anything drawing it gets redrawn
+	void notify_texture_update();
+
 	virtual void release_audio( bool );
 	virtual void on_redraw_surfaces();
 
@@ -120,6 +148,10 @@ protected:
 	// call this to notify registered images that the texture has changed
 	void notify_texture_change();
 
+	// call this when the image has moved to a different spot or texture, but
+	// is otherwise unchanged.  old_origin is where the image used to be
+	void notify_texture_moved( const sf::Vector2i &old_origin );
+
 private:
 	std::vector< FeImage * > m_images;
 
@@ -134,6 +166,8 @@ public:
 	~FeTextureContainer();
 
 	const sf::Texture &get_texture();
+	sf::IntRect get_texture_rect();
+	void leave_atlas();
 	bool get_visible() const;
 
 	void on_new_selection( FeSettings *feSettings );
@@ -141,6 +175,7 @@ public:
 	void on_new_list( FeSettings *, bool );
 
 	bool tick( FeSettings *feSettings, bool play_movies ); // returns true if redraw required
+	bool get_next_tick_due( sf::Time &t );
 	void set_play_state( bool play );
 	bool get_play_state() const;
 	void set_vol( float vol );
@@ -178,6 +213,10 @@ public:
 	bool is_swf() const;
 	float get_sample_aspect_ratio() const;
 
+	const sf::Shader *get_conversion_shader();
+	void on_texture_shared();
+	void on_size_queried();
+
 protected:
 	FeTextureContainer *get_derived_texture_container();
 
@@ -188,6 +227,17 @@ private:
 		const std::string &path,
 		const std::string &filename,
 		bool is_image );
+
+	// tell m_movie how it is being displayed (priority and target size)
+	void update_movie_display_hints();
+
+	// Videos are only opened once the selection has stayed on them for the
+	// video start delay.  Returns true if the video was put on hold
+	bool defer_video( FeSettings *feSettings,
+		const std::string &path,
+		const std::string &filename );
+	void tick_pending_video( FeSettings *feSettings );
+	void cancel_pending_video();
 #endif
 
 	bool try_to_load(
@@ -195,10 +245,22 @@ private:
 		const std::string &filename,
 		bool is_image=false );
 
+	// returns true if the loaded image can be put in the texture atlas
+	bool can_use_atlas() const;
+
+	// move the image in m_entry to the texture atlas.  Returns false
+	// if it isn't going there
+	bool place_in_atlas();
+
+	// move an image that is in the texture atlas to a region with the
+	// current smoothing setting (if to_atlas is true) or to m_texture
+	void move_atlas_image( bool to_atlas );
+
 	void internal_update_selection( FeSettings *feSettings );
 	void clear();
 
 	sf::Texture m_texture;
+	FeAtlasRegion *m_atlas_region; // set if the image is in the texture atlas
 
 	std::string m_art_name; // artwork label/template name (dynamic images)
 	std::string m_file_name; // the name of the loaded file
@@ -217,7 +279,18 @@ private:
 	bool m_mipmap;
 	bool m_smooth;
 	bool m_frame_displayed;
+	bool m_texture_shared;
+	bool m_size_queried; // a script has read the size, so videos stay at native size
+	sf::Vector2u m_movie_target; // size the current video is being converted to
 	FeImageLoaderEntry *m_entry;
+#ifndef NO_MOVIE
+	FeVideoLoaderEntry *m_video_entry; // video being opened in the background
+	std::string m_pending_path;
+	std::string m_pending_file;
+	std::string m_pending_name; // reported as the file name while pending
+	bool m_video_pending;
+	sf::Clock m_pending_clock;
+#endif
 };
 
 class FeSurfaceTextureContainer : public FeBaseTextureContainer, public FePresentableParent
@@ -249,9 +322,20 @@ public:
 
 	FePresentableParent *get_presentable_parent();
 
+	void on_element_change();
+
+	// number of surface redraws done and skipped because nothing changed
+	static int get_redraw_count();
+	static int get_skipped_redraw_count();
+	static void reset_redraw_counts();
+
 private:
 	sf::RenderTexture m_texture;
 	bool m_clear;
+	bool m_dirty;
+	size_t m_drawn_elements; // element count at the last redraw
+	unsigned int m_shader_changes; // shader param changes at the last redraw
+	FeDrawBatch m_batch;
 };
 
 class FeImage : public sf::Drawable, public FeBasePresentable
@@ -270,6 +354,8 @@ protected:
 	// Override from base class:
 	void draw(sf::RenderTarget& target, sf::RenderStates states) const;
 
+	void set_blend_states( sf::RenderStates &states ) const;
+
 public:
 	FeImage( FePresentableParent &p, FeBaseTextureContainer *,
 		float x, float y, float w, float h );
@@ -294,7 +380,7 @@ public:
 	int getFilterOffset() const;
 	void setFilterOffset(int);
 	const sf::Vector2u getTextureSize() const;
-	const sf::IntRect &getTextureRect() const;
+	sf::IntRect getTextureRect() const;
 	void setTextureRect( const sf::IntRect &);
 	int getVideoFlags() const;
 	void setVideoFlags( int f );
@@ -315,10 +401,14 @@ public:
 	// Overrides from base class:
 	//
 	const sf::Drawable &drawable() const { return (const sf::Drawable &)*this; };
+	void draw_batched( FeDrawBatch &batch, const sf::RenderStates &states ) const;
 
 	bool get_visible() const;
 
 	void texture_changed( FeBaseTextureContainer *new_tex=NULL );
+	void texture_moved( const sf::Vector2i &old_origin );
+
+	void script_set_shader( FeShader *s );
 
 	float get_origin_x() const;
 	float get_origin_y() const;
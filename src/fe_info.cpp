@@ -31,6 +31,7 @@
 #include <sqstdstring.h>
 
 const char *FE_STAT_FILE_EXTENSION = ".stat";
+const char *FE_STATS_FILE_EXTENSION = ".stats";
 const char FE_TAGS_SEP = ';';
 
 const FeRomInfo::Index FeRomInfo::BuildFullPath = FeRomInfo::Tags;
@@ -81,18 +82,6 @@ const std::string &FeRomInfo::get_info( int i ) const
 	return m_info[i];
 }
 
-std::string FeRomInfo::get_info_escaped( int i ) const
-{
-	if ( m_info[i].find_first_of( ';' ) != std::string::npos )
-	{
-		std::string temp = m_info[i];
-		perform_substitution( temp, "\"", "\\\"" );
-		return ( "\"" + temp + "\"" );
-	}
-	else
-		return m_info[i];
-}
-
 void FeRomInfo::set_info( Index i, const std::string &v )
 {
 	m_info[i] = v;
@@ -111,93 +100,17 @@ void FeRomInfo::append_tag( const std::string &tag )
 	m_info[Tags] += FE_TAGS_SEP;
 }
 
-void FeRomInfo::load_stats( const std::string &path )
-{
-	// Check if stats already loaded for this one
-	if ( !m_info[PlayedCount].empty() )
-		return;
-
-	m_info[PlayedCount] = "0";
-	m_info[PlayedTime] = "0";
-
-	if ( path.empty() )
-		return;
-
-	std::string filename = path + m_info[Emulator] + "/"
-		+ m_info[Romname] + FE_STAT_FILE_EXTENSION;
-	nowide::ifstream myfile( filename.c_str() );
-
-	if ( !myfile.is_open() )
-		return;
-
-	std::string line;
-	if ( myfile.good() )
-	{
-		getline( myfile, line );
-		m_info[PlayedCount] = line;
-	}
-
-	if ( myfile.good() )
-	{
-		getline( myfile, line );
-		m_info[PlayedTime] = line;
-	}
-
-	myfile.close();
-}
-
-void FeRomInfo::update_stats( const std::string &path, int count_incr, int played_incr )
-{
-	load_stats( path );
-
-	int new_count = as_int( m_info[PlayedCount] ) + count_incr;
-	int new_time = as_int( m_info[PlayedTime] ) + played_incr;
-
-	m_info[PlayedCount] = as_str( new_count );
-	m_info[PlayedTime] = as_str( new_time );
-
-	confirm_directory( path, m_info[Emulator] );
-	std::string filename = path + m_info[Emulator] + "/"
-		+ m_info[Romname] + FE_STAT_FILE_EXTENSION;
-	nowide::ofstream myfile( filename.c_str() );
-
-	if ( !myfile.is_open() )
-	{
-		FeLog() << "Error writing stat file: " << filename << std::endl;
-		return;
-	}
-
-	myfile << m_info[PlayedCount] << std::endl << m_info[PlayedTime] << std::endl;
-	myfile.close();
-}
-
 int FeRomInfo::process_setting( const std::string &,
          const std::string &value, const std::string &fn )
 {
 	size_t pos=0;
-	std::string token;
 
 	for ( int i=1; i < Favourite; i++ )
-	{
-		token_helper( value, pos, token );
-		m_info[(Index)i] = token;
-	}
+		token_helper( value, pos, m_info[(Index)i] );
 
 	return 0;
 }
 
-std::string FeRomInfo::as_output( void ) const
-{
-	std::string s = get_info_escaped( (Index)0 );
-	for ( int i=1; i < Favourite; i++ )
-	{
-		s += ';';
-		s += get_info_escaped( (Index)i );
-	}
-
-	return s;
-}
-
 void FeRomInfo::clear()
 {
 	for ( int i=0; i < LAST_INDEX; i++ )
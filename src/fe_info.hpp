@@ -29,6 +29,7 @@
 #include "nowide/fstream.hpp"
 
 extern const char *FE_STAT_FILE_EXTENSION;
+extern const char *FE_STATS_FILE_EXTENSION;
 extern const char FE_TAGS_SEP;
 struct SQRex;
 
@@ -87,10 +88,6 @@ public:
 	int process_setting( const std::string &setting,
 		const std::string &value,
 		const std::string &fn );
-	std::string as_output( void ) const;
-
-	void load_stats( const std::string &path );
-	void update_stats( const std::string &path, int count_incr, int played_incr );
 
 	void clear();
 
@@ -101,8 +98,6 @@ public:
 	bool full_comparison( const FeRomInfo & ) const; // copares all fields that get loaded from the romlist file
 
 private:
-	std::string get_info_escaped( int ) const;
-
 	std::string m_info[LAST_INDEX];
 };
 
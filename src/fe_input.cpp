@@ -847,6 +847,7 @@ const char *FeInputMap::commandStrings[] =
 	"exit",
 	"exit_to_desktop",
 	"screenshot",
+	"toggle_profiler",
 	"configure",
 	"random_game",
 	"replay_last_game",
@@ -901,6 +902,7 @@ const char *FeInputMap::commandDispStrings[] =
 	"Exit",
 	"Exit to Desktop",
 	"Screenshot",
+	"Toggle Profiler",
 	"Configure",
 	"Random Game",
 	"Replay Last Game",
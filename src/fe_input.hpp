@@ -146,6 +146,7 @@ public:
 		Exit,
 		ExitToDesktop,
 		ScreenShot,
+		ToggleProfiler,
 		Configure,
 		RandomGame,
 		ReplayLastGame,
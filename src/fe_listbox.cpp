@@ -169,7 +169,7 @@ void FeListBox::setColor( const sf::Color &c )
 	}
 
 	if ( m_scripted )
-		FePresent::script_flag_redraw();
+		flag_redraw();
 }
 
 void FeListBox::setSelColor( const sf::Color &c )
@@ -186,7 +186,7 @@ void FeListBox::setSelColor( const sf::Color &c )
 	}
 
 	if ( m_scripted )
-		FePresent::script_flag_redraw();
+		flag_redraw();
 }
 
 void FeListBox::setSelBgColor( const sf::Color &c )
@@ -202,7 +202,7 @@ void FeListBox::setSelBgColor( const sf::Color &c )
 	}
 
 	if ( m_scripted )
-		FePresent::script_flag_redraw();
+		flag_redraw();
 }
 
 void FeListBox::setSelStyle( int s )
@@ -218,7 +218,7 @@ void FeListBox::setSelStyle( int s )
 	}
 
 	if ( m_scripted )
-		FePresent::script_flag_redraw();
+		flag_redraw();
 }
 
 int FeListBox::getSelStyle()
@@ -331,7 +331,7 @@ void FeListBox::setRotation( float r )
 		m_texts[i].setRotation( m_rotation );
 
 	if ( m_scripted )
-		FePresent::script_flag_redraw();
+		flag_redraw();
 }
 
 void FeListBox::on_new_list( FeSettings *s )
@@ -522,7 +522,7 @@ void FeListBox::setBgColor( const sf::Color &c )
 	}
 
 	if ( m_scripted )
-		FePresent::script_flag_redraw();
+		flag_redraw();
 }
 
 void FeListBox::set_bgr(int r)
@@ -606,7 +606,7 @@ void FeListBox::set_style(int s)
 	}
 
 	if ( m_scripted )
-		FePresent::script_flag_redraw();
+		flag_redraw();
 }
 
 void FeListBox::set_align(int a)
@@ -620,7 +620,7 @@ void FeListBox::set_align(int a)
 		m_texts[i].setAlignment( (FeTextPrimative::Alignment)a );
 
 	if ( m_scripted )
-		FePresent::script_flag_redraw();
+		flag_redraw();
 }
 
 int FeListBox::get_selr()
@@ -760,7 +760,7 @@ void FeListBox::set_font( const char *f )
 		setFont( *font );
 		m_font_name = f;
 
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
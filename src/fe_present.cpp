@@ -28,11 +28,14 @@
 #include "fe_input.hpp"
 #include "fe_file.hpp"
 #include "fe_blend.hpp"
+#include "fe_window.hpp"
 #include "zip.hpp"
+#include "image_loader.hpp"
 
 #include <iostream>
 #include <cmath>
 #include <limits>
+#include <algorithm>
 
 #ifndef NO_MOVIE
 #include <Audio/AudioDevice.hpp>
@@ -103,6 +106,8 @@ FeFontContainer::~FeFontContainer()
 {
 	if ( m_stream )
 		delete m_stream;
+
+	FeTextPrimative::clear_layout_cache();
 }
 
 void FeFontContainer::set_font( const std::string &p, const std::string &n )
@@ -136,6 +141,7 @@ const sf::Font &FeFontContainer::get_font() const
 {
 	if ( m_needs_reload && m_stream )
 	{
+		FeTextPrimative::clear_layout_cache();
 		m_font.loadFromStream( *m_stream );
 		m_needs_reload=false;
 	}
@@ -145,6 +151,7 @@ const sf::Font &FeFontContainer::get_font() const
 
 void FeFontContainer::clear_font()
 {
+	FeTextPrimative::clear_layout_cache();
 	m_font = sf::Font();
 	m_needs_reload = true;
 }
@@ -421,6 +428,9 @@ void FePresent::init_monitors()
 FePresent::~FePresent()
 {
 	clear();
+
+	FeBlend::clear_default_shaders();
+	FeShader::clear_cache();
 }
 
 void FePresent::clear()
@@ -438,6 +448,7 @@ void FePresent::clear()
 	m_layoutFontName = m_feSettings->get_info( FeSettings::DefaultFont );
 	m_user_page_size = -1;
 	m_preserve_aspect = false;
+	FeBlend::set_pinch_shader_enabled( true );
 	m_custom_overlay = false;
 	m_overlay_caption = NULL;
 	m_overlay_lb = NULL;
@@ -459,6 +470,27 @@ void FePresent::clear()
 		delete t;
 	}
 
+	if ( FeSurfaceTextureContainer::get_redraw_count()
+			|| FeSurfaceTextureContainer::get_skipped_redraw_count() )
+	{
+		FeDebug() << "Surface redraws: " << FeSurfaceTextureContainer::get_redraw_count()
+			<< ", skipped (unchanged): " << FeSurfaceTextureContainer::get_skipped_redraw_count()
+			<< std::endl;
+
+		FeSurfaceTextureContainer::reset_redraw_counts();
+	}
+
+	if ( m_draw_batch.get_item_count() )
+	{
+		FeDebug() << "Batched drawing: " << m_draw_batch.get_item_count()
+			<< " items in " << m_draw_batch.get_draw_count() << " draw calls" << std::endl;
+
+		m_draw_batch.reset_counts();
+	}
+
+	FeFramePacer::get_ref().log_stats();
+	FeFramePacer::get_ref().reset();
+
 	while ( !m_sounds.empty() )
 	{
 		FeSound *s = m_sounds.back();
@@ -490,7 +522,13 @@ void FePresent::clear()
 	m_layoutScale.x = 1.0;
 	m_layoutScale.y = 1.0;
 
-	FeBlend::clear_default_shaders();
+	//
+	// Atlas mode is set by each layout that wants it.  Images that were
+	// in the atlas for the old layout are all unused now
+	//
+	FeImageLoader &il = FeImageLoader::get_ref();
+	il.set_atlas_mode( false );
+	il.trim_atlas();
 }
 
 void FePresent::draw( sf::RenderTarget& target, sf::RenderStates states ) const
@@ -502,11 +540,15 @@ void FePresent::draw( sf::RenderTarget& target, sf::RenderStates states ) const
 	{
 		// use m_transform on monitor 0
 		states.transform = i ? m_mon[i].transform : m_transform;
+		m_draw_batch.begin( target );
+
 		for ( itl=m_mon[i].elements.begin(); itl != m_mon[i].elements.end(); ++itl )
 		{
 			if ( (*itl)->get_visible() )
-				target.draw( (*itl)->drawable(), states );
+				(*itl)->draw_batched( m_draw_batch, states );
 		}
+
+		m_draw_batch.end();
 	}
 }
 
@@ -1132,9 +1174,13 @@ void FePresent::on_end_navigation()
 
 void FePresent::redraw_surfaces()
 {
-	std::vector<FeBaseTextureContainer *>::iterator itc;
+	//
+	// Go from newest to oldest, surfaces nested in another surface are
+	// always created after it and have to be drawn first
+	//
+	std::vector<FeBaseTextureContainer *>::reverse_iterator itc;
 
-	for ( itc=m_texturePool.begin(); itc != m_texturePool.end(); ++itc )
+	for ( itc=m_texturePool.rbegin(); itc != m_texturePool.rend(); ++itc )
 		(*itc)->on_redraw_surfaces();
 }
 
@@ -1252,7 +1298,10 @@ bool FePresent::video_tick()
 			itm != m_texturePool.end(); ++itm )
 	{
 		if ( (*itm)->tick( m_feSettings, m_playMovies ) )
+		{
+			(*itm)->notify_texture_update();
 			ret_val=true;
+		}
 	}
 
 	// Check if we need to loop any script sounds that are set to loop
@@ -1263,6 +1312,31 @@ bool FePresent::video_tick()
 	return ret_val;
 }
 
+bool FePresent::get_next_tick_due( sf::Time &t )
+{
+	bool due = false;
+
+	// script tick callbacks (animations etc) run once a frame
+	if ( has_tick_callbacks() )
+	{
+		t = sf::seconds( 1.f / std::max( m_refresh_rate, 1 ));
+		due = true;
+	}
+
+	for ( std::vector<FeBaseTextureContainer *>::iterator itm=m_texturePool.begin();
+			itm != m_texturePool.end(); ++itm )
+	{
+		sf::Time tt;
+		if ( (*itm)->get_next_tick_due( tt ) && ( !due || ( tt < t )))
+		{
+			t = tt;
+			due = true;
+		}
+	}
+
+	return due;
+}
+
 bool FePresent::saver_activation_check()
 {
 	int saver_timeout = m_feSettings->get_screen_saver_timeout();
@@ -1540,6 +1614,20 @@ bool FePresent::get_preserve_aspect_ratio()
 	return m_preserve_aspect;
 }
 
+void FePresent::set_gpu_pinch( bool p )
+{
+	if ( p != FeBlend::get_pinch_shader_enabled() )
+	{
+		FeBlend::set_pinch_shader_enabled( p );
+		flag_redraw();
+	}
+}
+
+bool FePresent::get_gpu_pinch()
+{
+	return FeBlend::get_pinch_shader_enabled();
+}
+
 bool FePresent::get_overlay_custom_controls( FeText *&t, FeListBox *&lb )
 {
 	t = m_overlay_caption;
@@ -1560,7 +1648,7 @@ void FePresent::script_do_update( FeBasePresentable *bp )
 	{
 		bp->on_new_list( fep->m_feSettings );
 		bp->on_new_selection( fep->m_feSettings );
-		fep->flag_redraw();
+		bp->flag_redraw();
 	}
 }
 
@@ -29,6 +29,7 @@
 #include "fe_sound.hpp"
 #include "fe_shader.hpp"
 #include "fe_window.hpp"
+#include "fe_batch.hpp"
 
 class FeImage;
 class FeBaseTextureContainer;
@@ -153,6 +154,8 @@ protected:
 	FeText *m_overlay_caption;
 	FeListBox *m_overlay_lb;
 
+	mutable FeDrawBatch m_draw_batch;
+
 	FePresent( const FePresent & );
 	FePresent &operator=( const FePresent & );
 
@@ -190,6 +193,7 @@ protected:
 	void set_search_rule( const char * );
 	const char *get_search_rule();
 	bool get_preserve_aspect_ratio();
+	bool get_gpu_pinch();
 
 	void set_selection_index( int );
 	const char *get_layout_font() const;
@@ -199,6 +203,7 @@ protected:
 	void set_toggle_rotation( int );
 	void set_layout_font( const char * );
 	void set_preserve_aspect_ratio( bool );
+	void set_gpu_pinch( bool );
 
 public:
 	FePresent( FeSettings *fesettings, FeFontContainer &defaultfont, FeWindow &wnd );
@@ -219,6 +224,11 @@ public:
 	bool tick(); // run vm on_tick and update videos.  return true if redraw required
 	bool video_tick(); // update videos only. return true if redraw required
 
+	// Set t to how long until tick() or video_tick() next need to be run
+	// (for the next video frame, script tick callbacks etc).  Returns false
+	// if there is nothing coming up
+	bool get_next_tick_due( sf::Time &t );
+
 	bool saver_activation_check();
 	void on_stop_frontend();
 	void pre_run();
@@ -258,6 +268,7 @@ public:
 	bool get_video_toggle() { return m_playMovies; };
 
 	int get_layout_ms();
+	int get_refresh_rate() const { return m_refresh_rate; };
 
 	//
 	// Script static functions
@@ -275,6 +286,7 @@ public:
 	//
 	virtual bool on_new_layout()=0;
 	virtual bool on_tick()=0;
+	virtual bool has_tick_callbacks()=0;
 	virtual void on_transition( FeTransitionType, int var )=0;
 	virtual void flag_redraw()=0;
 	virtual void init_with_default_layout()=0;
@@ -22,6 +22,7 @@
 
 #include "fe_presentable.hpp"
 #include "fe_present.hpp"
+#include "fe_batch.hpp"
 
 FeBasePresentable::FeBasePresentable( FePresentableParent &p )
 	: m_parent( p ),
@@ -44,6 +45,11 @@ FePresentableParent::~FePresentableParent()
 {
 }
 
+void FeBasePresentable::draw_batched( FeDrawBatch &batch, const sf::RenderStates &states ) const
+{
+	batch.draw( drawable(), states );
+}
+
 void FeBasePresentable::on_new_selection( FeSettings * )
 {
 }
@@ -175,7 +181,7 @@ void FeBasePresentable::set_visible( bool v )
 	if ( v != m_visible )
 	{
 		m_visible = v;
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -197,7 +203,11 @@ FeShader *FeBasePresentable::script_get_shader() const
 
 void FeBasePresentable::script_set_shader( FeShader *sh )
 {
-	m_shader = sh;
+	if ( sh != m_shader )
+	{
+		m_shader = sh;
+		flag_redraw();
+	}
 }
 
 int FeBasePresentable::get_zorder()
@@ -221,9 +231,19 @@ void FeBasePresentable::set_zorder( int pos )
 	m_zorder = pos;
 
 	std::stable_sort( m_parent.elements.begin(), m_parent.elements.end(), zcompare );
+	flag_redraw();
+}
+
+void FeBasePresentable::flag_redraw()
+{
+	m_parent.on_element_change();
 	FePresent::script_flag_redraw();
 }
 
+void FePresentableParent::on_element_change()
+{
+}
+
 int FePresentableParent::get_nesting_level()
 {
 	return m_nesting_level;
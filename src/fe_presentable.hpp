@@ -29,11 +29,13 @@
 class FeSettings;
 class FeShader;
 class FePresentableParent;
+class FeDrawBatch;
 
 namespace sf
 {
 	class Drawable;
 	class Color;
+	class RenderStates;
 };
 
 class FeBasePresentable
@@ -53,6 +55,11 @@ public:
 	virtual void set_scale_factor( float, float );
 
 	virtual const sf::Drawable &drawable() const=0;
+
+	// Draw using batch, which can merge the draw with those of neighbouring
+	// presentables.  By default this just draws drawable()
+	virtual void draw_batched( FeDrawBatch &batch, const sf::RenderStates &states ) const;
+
 	virtual const sf::Vector2f &getPosition() const=0;
 	virtual void setPosition( const sf::Vector2f & )=0;
 	virtual const sf::Vector2f &getSize() const=0;
@@ -97,10 +104,13 @@ public:
 
 	FeShader *get_shader() const;
 	FeShader *script_get_shader() const;
-	void script_set_shader( FeShader *s );
+	virtual void script_set_shader( FeShader *s );
 
 	int get_zorder();
 	void set_zorder( int );
+
+	// Flag that the way this presentable looks has changed
+	void flag_redraw();
 };
 
 class FeImage;
@@ -119,6 +129,9 @@ public:
 	int get_nesting_level();
 	void set_nesting_level( int );
 
+	// Called when something changed in how one of our elements looks
+	virtual void on_element_change();
+
 	FeImage *add_image(const char *,int, int, int, int);
 	FeImage *add_image(const char *, int, int);
 	FeImage *add_image(const char *);
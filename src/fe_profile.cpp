@@ -0,0 +1,249 @@
+/*
+ *
+ *  Attract-Mode frontend
+ *  Copyright (C) 2020 Andrew Mickelson
+ *
+ *  This file is part of Attract-Mode.
+ *
+ *  Attract-Mode is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Attract-Mode is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Attract-Mode.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "fe_profile.hpp"
+#include "fe_base.hpp" // logging
+#include "fe_util.hpp"
+
+#include "nowide/fstream.hpp"
+#include <iostream>
+#include <algorithm>
+
+namespace
+{
+	//
+	// The overlay gets updated this often
+	//
+	const int OVERLAY_UPDATE_MS = 1000;
+
+	//
+	// Limit on the number of events kept for a trace, so that leaving the
+	// profiler running doesn't eat all the memory
+	//
+	const size_t MAX_TRACE_EVENTS = 500000;
+
+	bool stat_greater(
+		const std::pair<std::string, sf::Int64> &a,
+		const std::pair<std::string, sf::Int64> &b )
+	{
+		return ( a.second > b.second );
+	}
+
+	void write_json_string( nowide::ofstream &out, const std::string &s )
+	{
+		out << '"';
+		for ( std::string::const_iterator itr=s.begin(); itr!=s.end(); ++itr )
+		{
+			if (( *itr == '"' ) || ( *itr == '\\' ))
+				out << '\\' << *itr;
+			else if (( *itr >= 0 ) && ( *itr < 0x20 ))
+				out << ' ';
+			else
+				out << *itr;
+		}
+		out << '"';
+	}
+};
+
+FeProfiler::FeProfileStat::FeProfileStat()
+	: total_us( 0 ),
+	max_us( 0 ),
+	calls( 0 )
+{
+}
+
+FeProfiler::FeProfiler()
+	: m_enabled( false ),
+	m_frames( 0 ),
+	m_overlay( NULL, sf::Color::White, sf::Color( 0, 0, 0, 200 ), 14, FeTextPrimative::Left )
+{
+	m_overlay.setNoMargin( true );
+}
+
+FeProfiler &FeProfiler::get_ref()
+{
+	static FeProfiler profiler;
+	return profiler;
+}
+
+void FeProfiler::toggle( const std::string &path, const sf::Font *font )
+{
+	if ( m_enabled )
+	{
+		m_enabled = false;
+		write_trace();
+
+		m_stats.clear();
+		m_trace.clear();
+		return;
+	}
+
+	if ( !font )
+		return;
+
+	m_overlay.setFont( *font );
+	m_overlay.setSize( 480, m_overlay.getLineSpacingFactored(
+		font, m_overlay.getCharacterSize() ) + 4 );
+
+	get_available_filename( path, "trace", ".json", m_trace_path );
+
+	m_enabled = true;
+	m_frames = 0;
+	m_stats.clear();
+	m_trace.clear();
+	m_overlay_clock.restart();
+	m_overlay.setString( "Profiling..." );
+
+	FeLog() << "Profiler enabled, recording trace to: " << m_trace_path << std::endl;
+}
+
+bool FeProfiler::end_frame()
+{
+	if ( !m_enabled )
+		return false;
+
+	m_frames++;
+
+	if ( m_overlay_clock.getElapsedTime().asMilliseconds() < OVERLAY_UPDATE_MS )
+		return false;
+
+	update_overlay();
+
+	m_overlay_clock.restart();
+	m_frames = 0;
+	m_stats.clear();
+	return true;
+}
+
+void FeProfiler::record( const char *name, sf::Int64 start_us, sf::Int64 end_us )
+{
+	sf::Int64 dur = end_us - start_us;
+
+	FeProfileStat &s = m_stats[ name ];
+	s.total_us += dur;
+	s.max_us = std::max( s.max_us, dur );
+	s.calls++;
+
+	if ( m_trace.size() < MAX_TRACE_EVENTS )
+	{
+		FeTraceEvent e;
+		e.name = name;
+		e.start_us = start_us;
+		e.duration_us = dur;
+		m_trace.push_back( e );
+	}
+}
+
+void FeProfiler::update_overlay()
+{
+	//
+	// List the stages with the most time spent in them first
+	//
+	std::vector< std::pair<std::string, sf::Int64> > sorted;
+	for ( std::map<std::string, FeProfileStat>::const_iterator itr=m_stats.begin();
+			itr != m_stats.end(); ++itr )
+		sorted.push_back( std::pair<std::string, sf::Int64>( itr->first, itr->second.total_us ) );
+
+	std::sort( sorted.begin(), sorted.end(), stat_greater );
+
+	float secs = m_overlay_clock.getElapsedTime().asSeconds();
+	int frames = std::max( m_frames, 1 );
+
+	std::string str = "Profile: " + as_str( m_frames / secs, 1 )
+		+ " passes/s (ms per pass / max ms)";
+
+	for ( std::vector< std::pair<std::string, sf::Int64> >::iterator itr=sorted.begin();
+			itr != sorted.end(); ++itr )
+	{
+		const FeProfileStat &s = m_stats[ (*itr).first ];
+
+		str += "\n" + (*itr).first + ": "
+			+ as_str( s.total_us / 1000.f / frames, 2 ) + " / "
+			+ as_str( s.max_us / 1000.f, 2 );
+	}
+
+	const sf::Font *font = m_overlay.getFont();
+	if ( font )
+	{
+		int lines = sorted.size() + 1;
+		m_overlay.setSize( 480, lines * m_overlay.getLineSpacingFactored(
+			font, m_overlay.getCharacterSize() ) + 4 );
+	}
+
+	m_overlay.setString( str );
+}
+
+void FeProfiler::write_trace()
+{
+	if ( m_trace.empty() )
+		return;
+
+	nowide::ofstream out( m_trace_path.c_str(), std::ios_base::binary );
+	if ( !out.is_open() )
+	{
+		FeLog() << "Error writing profiler trace file: " << m_trace_path << std::endl;
+		return;
+	}
+
+	out << "{\"traceEvents\":[" << std::endl;
+
+	for ( std::vector<FeTraceEvent>::const_iterator itr=m_trace.begin();
+			itr != m_trace.end(); ++itr )
+	{
+		if ( itr != m_trace.begin() )
+			out << "," << std::endl;
+
+		out << "{\"name\":";
+		write_json_string( out, (*itr).name );
+		out << ",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":" << (*itr).start_us
+			<< ",\"dur\":" << (*itr).duration_us << "}";
+	}
+
+	out << std::endl << "]}" << std::endl;
+
+	FeLog() << "Wrote profiler trace (" << m_trace.size() << " events) to: "
+		<< m_trace_path << std::endl;
+}
+
+FeProfileScope::FeProfileScope( const char *name )
+	: m_name( name ),
+	m_start( 0 ),
+	m_active( FeProfiler::get_ref().is_enabled() )
+{
+	if ( m_active )
+		m_start = FeProfiler::get_ref().now_us();
+}
+
+FeProfileScope::~FeProfileScope()
+{
+	end();
+}
+
+void FeProfileScope::end()
+{
+	if ( !m_active )
+		return;
+
+	FeProfiler &p = FeProfiler::get_ref();
+	p.record( m_name, m_start, p.now_us() );
+	m_active = false;
+}
@@ -0,0 +1,118 @@
+/*
+ *
+ *  Attract-Mode frontend
+ *  Copyright (C) 2020 Andrew Mickelson
+ *
+ *  This file is part of Attract-Mode.
+ *
+ *  Attract-Mode is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  Attract-Mode is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with Attract-Mode.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef FE_PROFILE_HPP
+#define FE_PROFILE_HPP
+
+#include <SFML/System/Clock.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include "tp.hpp"
+
+//
+// Frame profiler.  Times the stages of the main loop (and script callbacks)
+// using FeProfileScope objects, shows the results in an on-screen overlay
+// and records a Chrome trace-event file ("chrome://tracing") while the
+// overlay is up.
+//
+// Nothing is recorded unless the profiler is enabled.
+//
+class FeProfiler
+{
+	friend class FeProfileScope;
+
+public:
+	static FeProfiler &get_ref();
+
+	bool is_enabled() const { return m_enabled; };
+
+	//
+	// Show/hide the overlay.  A trace gets recorded while it is shown and
+	// is written to a "trace" file in path when it is hidden
+	//
+	void toggle( const std::string &path, const sf::Font *font );
+
+	// call at the end of each pass through the main loop.  Returns true if
+	// the overlay text changed and the screen needs to be redrawn
+	bool end_frame();
+
+	const sf::Drawable &get_overlay() const { return m_overlay; };
+
+private:
+	struct FeProfileStat
+	{
+		FeProfileStat();
+
+		sf::Int64 total_us;
+		sf::Int64 max_us;
+		int calls;
+	};
+
+	struct FeTraceEvent
+	{
+		std::string name;
+		sf::Int64 start_us;
+		sf::Int64 duration_us;
+	};
+
+	sf::Clock m_clock;
+	sf::Clock m_overlay_clock;
+	bool m_enabled;
+	int m_frames;
+	std::map<std::string, FeProfileStat> m_stats;
+	std::vector<FeTraceEvent> m_trace;
+	std::string m_trace_path;
+	FeTextPrimative m_overlay;
+
+	FeProfiler();
+	FeProfiler( const FeProfiler & );
+	FeProfiler &operator=( const FeProfiler & );
+
+	sf::Int64 now_us() const { return m_clock.getElapsedTime().asMicroseconds(); };
+	void record( const char *name, sf::Int64 start_us, sf::Int64 end_us );
+	void update_overlay();
+	void write_trace();
+};
+
+//
+// Times the enclosing scope (or until end() is called) when the profiler
+// is enabled.  name must stay valid for the life of the object
+//
+class FeProfileScope
+{
+public:
+	FeProfileScope( const char *name );
+	~FeProfileScope();
+
+	void end();
+
+private:
+	const char *m_name;
+	sf::Int64 m_start;
+	bool m_active;
+
+	FeProfileScope( const FeProfileScope & );
+	FeProfileScope &operator=( const FeProfileScope & );
+};
+
+#endif
@@ -25,7 +25,9 @@
 
 #include <iostream>
 #include "nowide/fstream.hpp"
+#include "nowide/cstdio.hpp"
 #include <algorithm>
+#include <cstring>
 
 #include <squirrel.h>
 #include <sqstdstring.h>
@@ -37,6 +39,294 @@ const char *FE_FAVOURITE_FILE_EXTENSION = ".tag";
 
 const char *FE_ROMLIST_SUBDIR	= "romlists/";
 const char *FE_STATS_SUBDIR                     = "stats/";
+const char *FE_ROMLIST_CACHE_EXTENSION = ".cache";
+
+namespace
+{
+	const size_t WRITE_BUFFER_SIZE = 1024 * 1024;
+
+	//
+	// Romlist cache file format (native byte order, the cache is only ever
+	// read back on the machine that wrote it):
+	//
+	//   uint32 magic, uint32 version, uint32 field count,
+	//   int64 romlist file size, int64 romlist file mtime,
+	//   int64 romlist file mtime nanoseconds, uint32 entry count
+	//
+	// followed by each field of each entry as a uint32 length and the
+	// (unescaped) field contents.
+	//
+	const sf::Uint32 CACHE_MAGIC = 0x4c524d41; // "AMRL"
+	const sf::Uint32 CACHE_VERSION = 2;
+	const size_t CACHE_HEADER_SIZE = 4 + 4 + 4 + 8 + 8 + 8 + 4;
+
+	std::string get_cache_filename( const std::string &filename )
+	{
+		if ( tail_compare( filename, FE_ROMLIST_FILE_EXTENSION ) )
+			return filename.substr( 0, filename.size() - strlen( FE_ROMLIST_FILE_EXTENSION ) )
+				+ FE_ROMLIST_CACHE_EXTENSION;
+
+		return filename + FE_ROMLIST_CACHE_EXTENSION;
+	}
+
+	template <class T>
+	void append_raw( std::string &buff, T v )
+	{
+		buff.append( (const char *)&v, sizeof( T ) );
+	}
+
+	template <class T>
+	bool read_raw( const char *&pos, const char *end, T &v )
+	{
+		if ( end - pos < (long)sizeof( T ) )
+			return false;
+
+		memcpy( &v, pos, sizeof( T ) );
+		pos += sizeof( T );
+		return true;
+	}
+
+	// Append field to buff, escaped for the romlist text format
+	void append_escaped( std::string &buff, const std::string &field )
+	{
+		if ( field.find_first_of( ';' ) == std::string::npos )
+		{
+			buff += field;
+			return;
+		}
+
+		buff += '"';
+		for ( std::string::const_iterator itr=field.begin(); itr!=field.end(); ++itr )
+		{
+			if ( *itr == '"' )
+				buff += '\\';
+
+			buff += *itr;
+		}
+		buff += '"';
+	}
+
+	//
+	// Write out buff to a temp file and then move it into place as filename
+	// text_mode is used for the romlist itself so that line endings are the
+	// same as they've always been
+	//
+	class FeAtomicWriter
+	{
+	public:
+		FeAtomicWriter( const std::string &filename, bool text_mode )
+			: m_filename( filename ),
+			m_temp( filename + ".tmp" ),
+			m_ok( true )
+		{
+			m_file = nowide::fopen( m_temp.c_str(), text_mode ? "w" : "wb" );
+			m_buff.reserve( WRITE_BUFFER_SIZE + 4096 );
+		}
+
+		~FeAtomicWriter()
+		{
+			if ( m_file )
+			{
+				fclose( m_file );
+				delete_file( m_temp );
+			}
+		}
+
+		bool is_open() const { return ( m_file != NULL ); };
+		std::string &buff() { return m_buff; };
+
+		void flush_if_full()
+		{
+			if ( m_buff.size() >= WRITE_BUFFER_SIZE )
+				flush();
+		}
+
+		void flush()
+		{
+			if ( !m_buff.empty() && ( fwrite( m_buff.data(), 1, m_buff.size(), m_file ) != m_buff.size() ))
+				m_ok = false;
+
+			m_buff.clear();
+		}
+
+		bool commit()
+		{
+			flush();
+
+			if ( fclose( m_file ) != 0 )
+				m_ok = false;
+
+			m_file = NULL;
+
+			if ( m_ok && replace_file( m_temp, m_filename ) )
+				return true;
+
+			FeLog() << "Error writing file: " << m_filename << std::endl;
+			delete_file( m_temp );
+			return false;
+		}
+
+	private:
+		FeAtomicWriter( const FeAtomicWriter & );
+		FeAtomicWriter &operator=( const FeAtomicWriter & );
+
+		std::string m_filename;
+		std::string m_temp;
+		std::string m_buff;
+		FILE *m_file;
+		bool m_ok;
+	};
+
+	void write_romlist_cache( const std::string &filename,
+		const FeRomInfoListType &romlist )
+	{
+		std::string cache_name = get_cache_filename( filename );
+
+		long long size( 0 ), mtime( 0 ), mtime_nsec( 0 );
+		if ( !get_file_stats( filename, size, mtime, mtime_nsec ) )
+			return;
+
+		FeAtomicWriter out( cache_name, false );
+		if ( !out.is_open() )
+			return;
+
+		std::string &buff = out.buff();
+		append_raw<sf::Uint32>( buff, CACHE_MAGIC );
+		append_raw<sf::Uint32>( buff, CACHE_VERSION );
+		append_raw<sf::Uint32>( buff, FeRomInfo::Favourite );
+		append_raw<sf::Int64>( buff, size );
+		append_raw<sf::Int64>( buff, mtime );
+		append_raw<sf::Int64>( buff, mtime_nsec );
+		append_raw<sf::Uint32>( buff, romlist.size() );
+
+		for ( FeRomInfoListType::const_iterator itr=romlist.begin(); itr!=romlist.end(); ++itr )
+		{
+			for ( int i=0; i < FeRomInfo::Favourite; i++ )
+			{
+				const std::string &f = (*itr).get_info( i );
+				append_raw<sf::Uint32>( buff, f.size() );
+				buff += f;
+			}
+
+			out.flush_if_full();
+		}
+
+		out.commit();
+	}
+};
+
+bool write_romlist( const std::string &filename,
+	const FeRomInfoListType &romlist,
+	bool write_cache )
+{
+	FeAtomicWriter out( filename, true );
+	if ( !out.is_open() )
+	{
+		FeLog() << "Error opening file for writing: " << filename << std::endl;
+		return false;
+	}
+
+	std::string &buff = out.buff();
+
+	// one line header showing what the columns represent
+	//
+	int i=0;
+	buff += "#";
+	buff += FeRomInfo::indexStrings[i++];
+	while ( i < FeRomInfo::Favourite )
+	{
+		buff += ';';
+		buff += FeRomInfo::indexStrings[i++];
+	}
+	buff += '\n';
+
+	// Now output the list
+	//
+	for ( FeRomInfoListType::const_iterator itr=romlist.begin(); itr!=romlist.end(); ++itr )
+	{
+		append_escaped( buff, (*itr).get_info( 0 ) );
+		for ( int i=1; i < FeRomInfo::Favourite; i++ )
+		{
+			buff += ';';
+			append_escaped( buff, (*itr).get_info( i ) );
+		}
+		buff += '\n';
+
+		out.flush_if_full();
+	}
+
+	if ( !out.commit() )
+		return false;
+
+	if ( write_cache )
+		write_romlist_cache( filename, romlist );
+	else
+		delete_file( get_cache_filename( filename ) );
+
+	return true;
+}
+
+bool load_romlist_cache( const std::string &filename,
+	FeRomInfoListType &romlist )
+{
+	std::string cache_name = get_cache_filename( filename );
+
+	//
+	// The sub-second part of the mtime catches edits that keep the file's
+	// size and land in the same second as the write the cache is for
+	//
+	long long size( 0 ), mtime( 0 ), mtime_nsec( 0 );
+	if ( !get_file_stats( filename, size, mtime, mtime_nsec ) )
+		return false;
+
+	// Read the whole cache in one go
+	std::string data;
+	if ( !get_file_contents( cache_name, data ) || ( data.size() < CACHE_HEADER_SIZE ))
+		return false;
+
+	const char *pos = data.data();
+	const char *end = pos + data.size();
+
+	sf::Uint32 magic, version, fields, count;
+	sf::Int64 c_size, c_mtime, c_mtime_nsec;
+
+	read_raw( pos, end, magic );
+	read_raw( pos, end, version );
+	read_raw( pos, end, fields );
+	read_raw( pos, end, c_size );
+	read_raw( pos, end, c_mtime );
+	read_raw( pos, end, c_mtime_nsec );
+	read_raw( pos, end, count );
+
+	if (( magic != CACHE_MAGIC ) || ( version != CACHE_VERSION )
+			|| ( fields != FeRomInfo::Favourite )
+			|| ( c_size != size ) || ( c_mtime != mtime )
+			|| ( c_mtime_nsec != mtime_nsec ))
+		return false;
+
+	FeRomInfoListType temp;
+	for ( sf::Uint32 j=0; j<count; j++ )
+	{
+		temp.push_back( FeRomInfo() );
+		FeRomInfo &rom = temp.back();
+
+		for ( int i=0; i < FeRomInfo::Favourite; i++ )
+		{
+			sf::Uint32 len;
+			if ( !read_raw( pos, end, len ) || ( (size_t)( end - pos ) < len ))
+			{
+				FeLog() << "Ignoring corrupt romlist cache: " << cache_name << std::endl;
+				return false;
+			}
+
+			rom.set_info( (FeRomInfo::Index)i, std::string( pos, len ) );
+			pos += len;
+		}
+	}
+
+	romlist.splice( romlist.end(), temp );
+	return true;
+}
 
 SQRex *FeRomListSorter::m_rex = NULL;
 
@@ -139,8 +429,179 @@ const char FeRomListSorter::get_first_letter( const FeRomInfo *one_info )
 	return name.at( b );
 }
 
+FePlayedStats::FePlayedStats( const std::string &config_path )
+	: m_config_path( config_path )
+{
+}
+
+void FePlayedStats::load( FeRomInfo &rom )
+{
+	// Check if stats already loaded for this one
+	if ( !rom.get_info( FeRomInfo::PlayedCount ).empty() )
+		return;
+
+	int count( 0 ), played( 0 );
+
+	if ( !m_config_path.empty() )
+	{
+		FeEmuStats &stats = get_emulator( rom.get_info( FeRomInfo::Emulator ) );
+		FeEmuStats::iterator itr = stats.find( rom.get_info( FeRomInfo::Romname ) );
+
+		if ( itr != stats.end() )
+		{
+			count = (*itr).second.first;
+			played = (*itr).second.second;
+		}
+	}
+
+	rom.set_info( FeRomInfo::PlayedCount, as_str( count ) );
+	rom.set_info( FeRomInfo::PlayedTime, as_str( played ) );
+}
+
+bool FePlayedStats::update( FeRomInfo &rom, int count_incr, int played_incr )
+{
+	load( rom );
+
+	int new_count = as_int( rom.get_info( FeRomInfo::PlayedCount ) ) + count_incr;
+	int new_time = as_int( rom.get_info( FeRomInfo::PlayedTime ) ) + played_incr;
+
+	rom.set_info( FeRomInfo::PlayedCount, as_str( new_count ) );
+	rom.set_info( FeRomInfo::PlayedTime, as_str( new_time ) );
+
+	if ( m_config_path.empty() )
+		return false;
+
+	const std::string &emu = rom.get_info( FeRomInfo::Emulator );
+	FeEmuStats &stats = get_emulator( emu );
+	stats[ rom.get_info( FeRomInfo::Romname ) ] = std::pair<int, int>( new_count, new_time );
+
+	return save( emu, stats );
+}
+
+void FePlayedStats::erase( const std::string &emulator, const std::string &romname )
+{
+	if ( m_config_path.empty() )
+		return;
+
+	FeEmuStats &stats = get_emulator( emulator );
+	if ( stats.erase( romname ) )
+		save( emulator, stats );
+}
+
+void FePlayedStats::clear()
+{
+	m_emulators.clear();
+}
+
+FePlayedStats::FeEmuStats &FePlayedStats::get_emulator( const std::string &emulator )
+{
+	std::map< std::string, FeEmuStats >::iterator itr = m_emulators.find( emulator );
+	if ( itr != m_emulators.end() )
+		return (*itr).second;
+
+	FeEmuStats &stats = m_emulators[ emulator ];
+
+	std::string filename = m_config_path + FE_STATS_SUBDIR
+		+ emulator + FE_STATS_FILE_EXTENSION;
+
+	std::string contents;
+	if ( !get_file_contents( filename, contents ) )
+	{
+		migrate( emulator, stats );
+		return stats;
+	}
+
+	// Each line is: <count>;<time>;<romname>
+	//
+	size_t pos=0;
+	while ( pos < contents.size() )
+	{
+		size_t end = contents.find_first_of( "\r\n", pos );
+		if ( end == std::string::npos )
+			end = contents.size();
+
+		size_t s1 = contents.find( ';', pos );
+		size_t s2 = ( s1 < end ) ? contents.find( ';', s1 + 1 ) : std::string::npos;
+
+		if ( s2 < end )
+		{
+			stats[ contents.substr( s2 + 1, end - s2 - 1 ) ] = std::pair<int, int>(
+				atoi( contents.c_str() + pos ),
+				atoi( contents.c_str() + s1 + 1 ) );
+		}
+
+		pos = end + 1;
+	}
+
+	return stats;
+}
+
+void FePlayedStats::migrate( const std::string &emulator, FeEmuStats &stats )
+{
+	std::string path = m_config_path + FE_STATS_SUBDIR + emulator + "/";
+	if ( emulator.empty() || !directory_exists( path ) )
+		return;
+
+	std::vector<std::string> list;
+	get_basename_from_extension( list, path, FE_STAT_FILE_EXTENSION );
+
+	for ( std::vector<std::string>::iterator itr=list.begin(); itr!=list.end(); ++itr )
+	{
+		nowide::ifstream myfile( ( path + (*itr) + FE_STAT_FILE_EXTENSION ).c_str() );
+		if ( !myfile.is_open() )
+			continue;
+
+		std::string count, played;
+		getline( myfile, count );
+		getline( myfile, played );
+
+		stats[ *itr ] = std::pair<int, int>( as_int( count ), as_int( played ) );
+	}
+
+	if ( !list.empty() )
+	{
+		FeLog() << " - Migrating " << list.size() << " stat files for emulator: "
+			<< emulator << std::endl;
+
+		save( emulator, stats );
+	}
+}
+
+bool FePlayedStats::save( const std::string &emulator, const FeEmuStats &stats )
+{
+	confirm_directory( m_config_path, FE_STATS_SUBDIR );
+
+	// The file is rewritten in full and moved into place, so a crash part
+	// way through never leaves a truncated stats file behind
+	//
+	FeAtomicWriter out( m_config_path + FE_STATS_SUBDIR
+		+ emulator + FE_STATS_FILE_EXTENSION, true );
+
+	if ( !out.is_open() )
+	{
+		FeLog() << "Error writing stats file for emulator: " << emulator << std::endl;
+		return false;
+	}
+
+	std::string &buff = out.buff();
+	for ( FeEmuStats::const_iterator itr=stats.begin(); itr!=stats.end(); ++itr )
+	{
+		buff += as_str( (*itr).second.first );
+		buff += ';';
+		buff += as_str( (*itr).second.second );
+		buff += ';';
+		buff += (*itr).first;
+		buff += '\n';
+
+		out.flush_if_full();
+	}
+
+	return out.commit();
+}
+
 FeRomList::FeRomList( const std::string &config_path )
 	: m_config_path( config_path ),
+	m_played_stats( config_path ),
 	m_fav_changed( false ),
 	m_tags_changed( false ),
 	m_availability_checked( false ),
@@ -187,6 +648,7 @@ bool FeRomList::load_romlist( const std::string &path,
 	m_list.clear();
 	m_availability_checked = false;
 	m_played_stats_checked = !load_stats;
+	m_played_stats.clear();
 
 	m_group_clones = group_clones;
 
@@ -194,8 +656,11 @@ bool FeRomList::load_romlist( const std::string &path,
 
 	sf::Clock load_timer;
 
-	bool retval = FeBaseConfigurable::load_from_file(
-			path + m_romlist_name + FE_ROMLIST_FILE_EXTENSION, ";" );
+	std::string romlist_file = path + m_romlist_name + FE_ROMLIST_FILE_EXTENSION;
+
+	bool retval = load_romlist_cache( romlist_file, m_list );
+	if ( !retval )
+		retval = FeBaseConfigurable::load_from_file( romlist_file, ";" );
 
 	//
 	// Create rom name to romlist entry lookup map
@@ -826,14 +1291,14 @@ void FeRomList::get_played_stats()
 		return;
 
 	for ( FeRomInfoListType::iterator itr=m_list.begin(); itr != m_list.end(); ++itr )
-		(*itr).load_stats( m_config_path + FE_STATS_SUBDIR );
+		m_played_stats.load( *itr );
 
 	m_played_stats_checked = true;
 }
 
 void FeRomList::load_stats( int filter_idx, int idx )
 {
-	lookup( filter_idx, idx ).load_stats( m_config_path + FE_STATS_SUBDIR );
+	m_played_stats.load( lookup( filter_idx, idx ) );
 }
 
 // NOTE: this function is implemented in fe_settings.cpp
@@ -33,6 +33,25 @@ typedef std::list<FeRomInfo> FeRomInfoListType;
 extern const char *FE_ROMLIST_FILE_EXTENSION;
 extern const char *FE_ROMLIST_SUBDIR;
 extern const char *FE_STATS_SUBDIR;
+extern const char *FE_ROMLIST_CACHE_EXTENSION;
+
+//
+// Write romlist to the specified file.  The list is written to a temporary
+// file which is then moved into place, so a partially written romlist is
+// never left behind.  If write_cache is true, a binary cache of the list is
+// written alongside it that load_romlist() can use instead of parsing the
+// text file.
+//
+bool write_romlist( const std::string &filename,
+	const FeRomInfoListType &romlist,
+	bool write_cache=true );
+
+//
+// Load the binary cache of the specified romlist file.  Returns false if
+// there is no cache or it doesn't match the current romlist file.
+//
+bool load_romlist_cache( const std::string &filename,
+	FeRomInfoListType &romlist );
 
 //
 // Comparison used when sorting/merging FeRomLists
@@ -80,6 +99,43 @@ public:
 
 };
 
+//
+// Played count/time statistics.  Stats for all the games of an emulator are
+// kept together in one file in the stats directory (<emulator>.stats) that
+// is read in one go the first time a game for that emulator is looked up.
+// Stats from the older one file per game layout (<emulator>/<romname>.stat)
+// are migrated to the new file the first time an emulator is loaded.
+//
+class FePlayedStats
+{
+public:
+	FePlayedStats( const std::string &config_path );
+
+	// Set the PlayedCount and PlayedTime of rom, if not already set
+	void load( FeRomInfo &rom );
+
+	// Increment the played stats of rom and rewrite its emulator's stats file
+	bool update( FeRomInfo &rom, int count_incr, int played_incr );
+
+	void erase( const std::string &emulator, const std::string &romname );
+
+	// Discard the loaded stats so that they are reread when next needed
+	void clear();
+
+private:
+	typedef std::map< std::string, std::pair< int, int > > FeEmuStats;
+
+	FeEmuStats &get_emulator( const std::string &emulator );
+	void migrate( const std::string &emulator, FeEmuStats &stats );
+	bool save( const std::string &emulator, const FeEmuStats &stats );
+
+	FePlayedStats( const FePlayedStats & );
+	FePlayedStats &operator=( const FePlayedStats & );
+
+	const std::string &m_config_path;
+	std::map< std::string, FeEmuStats > m_emulators;
+};
+
 class FeRomList : public FeBaseConfigurable
 {
 private:
@@ -94,6 +150,7 @@ private:
 
 	std::string m_romlist_name;
 	const std::string &m_config_path;
+	FePlayedStats m_played_stats;
 	bool m_fav_changed;
 	bool m_tags_changed;
 	bool m_availability_checked;
@@ -151,6 +208,7 @@ public:
 	void get_file_availability();
 
 	void load_stats( int filter_idx, int idx );
+	FePlayedStats &get_stats_store() { return m_played_stats; };
 
 	// Fixes m_filtered_list as needed using the filters in the given "display", with the
 	// assumption that the specified "target" attribute for all games might have been changed
@@ -282,7 +282,10 @@ FeSettings::FeSettings( const std::string &config_path,
 	m_filter_wrap_mode( WrapWithinDisplay ),
 	m_selection_max_step( 128 ),
 	m_selection_speed( 40 ),
+	m_video_start_delay( 100 ),
 	m_image_cache_mbytes( 100 ),
+	m_video_io_buffer_kbytes( 32 ),
+	m_audio_buffer_ms( 250 ),
 #ifdef SFML_SYSTEM_MACOS
 	m_move_mouse_on_launch( false ), // hotcorners
 #else
@@ -419,6 +422,7 @@ const char *FeSettings::configSettingStrings[] =
 	"smooth_images",
 	"selection_max_step",
 	"selection_speed_ms",
+	"video_start_delay_ms",
 	"move_mouse_on_launch",
 	"scrape_snaps",
 	"scrape_marquees",
@@ -433,6 +437,9 @@ const char *FeSettings::configSettingStrings[] =
 	"hide_console",
 #endif
 	"video_decoder",
+	"gpu_video_conversion",
+	"video_io_buffer_kbytes",
+	"audio_buffer_ms",
 	"menu_prompt",
 	"menu_layout",
 	"image_cache_mbytes",
@@ -1138,7 +1145,7 @@ const std::string &FeSettings::get_rom_info_absolute( int filter_index, int rom_
 			&& ( get_current_filter_index() == filter_index ))
 	{
 		if ( load_stats )
-			m_current_search[ rom_index ]->load_stats( m_config_path + FE_STATS_SUBDIR );
+			m_rl.get_stats_store().load( *m_current_search[ rom_index ] );
 
 		return m_current_search[ rom_index ]->get_info( index );
 	}
@@ -2361,12 +2368,10 @@ bool FeSettings::update_stats( int play_count, int play_time )
 	if ( !rom )
 		return false;
 
-	std::string path = m_config_path + FE_STATS_SUBDIR;
-
 	FeDebug() << "Updating stats: increment play count by " << play_count
 		<< " and play time by " << play_time << " seconds." << std::endl;
 
-	rom->update_stats( path, play_count, play_time );
+	m_rl.get_stats_store().update( *rom, play_count, play_time );
 
 	bool fixed = m_rl.fix_filters( m_displays[m_current_display], FeRomInfo::PlayedCount );
 	fixed |= m_rl.fix_filters( m_displays[m_current_display], FeRomInfo::PlayedTime );
@@ -2873,8 +2878,14 @@ const std::string FeSettings::get_info( int index ) const
 		return as_str( m_selection_max_step );
 	case SelectionSpeed:
 		return as_str( m_selection_speed );
+	case VideoStartDelay:
+		return as_str( m_video_start_delay );
 	case ImageCacheMBytes:
 		return as_str( m_image_cache_mbytes );
+	case VideoIOBufferKBytes:
+		return as_str( m_video_io_buffer_kbytes );
+	case AudioBufferMs:
+		return as_str( m_audio_buffer_ms );
 	case StartupMode:
 		return startupTokens[ m_startup_mode ];
 	case ThegamesdbKey:
@@ -2900,6 +2911,7 @@ const std::string FeSettings::get_info( int index ) const
 #ifdef SFML_SYSTEM_WINDOWS
 	case HideConsole:
 #endif
+	case GpuVideoConversion:
 		return ( get_info_bool( index ) ? FE_CFG_YES_STR : FE_CFG_NO_STR );
 	case VideoDecoder:
 #ifdef NO_MOVIE
@@ -2961,6 +2973,12 @@ bool FeSettings::get_info_bool( int index ) const
 #ifdef SFML_SYSTEM_WINDOWS
 	case HideConsole:
 		return m_hide_console;
+#endif
+	case GpuVideoConversion:
+#ifdef NO_MOVIE
+		return false;
+#else
+		return FeMedia::get_gpu_conversion();
 #endif
 	default:
 		break;
@@ -3132,6 +3150,12 @@ bool FeSettings::set_info( int index, const std::string &value )
 			m_selection_speed = 0;
 		break;
 
+	case VideoStartDelay:
+		m_video_start_delay = as_int( value );
+		if ( m_video_start_delay < 0 )
+			m_video_start_delay = 0;
+		break;
+
 	case ImageCacheMBytes:
 		m_image_cache_mbytes = as_int( value );
 		if ( m_image_cache_mbytes < 0 )
@@ -3141,6 +3165,28 @@ bool FeSettings::set_info( int index, const std::string &value )
 		FeImageLoader::set_cache_size( m_image_cache_mbytes * 1024 * 1024 );
 		break;
 
+	case VideoIOBufferKBytes:
+		m_video_io_buffer_kbytes = as_int( value );
+		if ( m_video_io_buffer_kbytes < 4 )
+			m_video_io_buffer_kbytes = 4;
+
+#ifndef NO_MOVIE
+		FeMedia::set_io_buffer_size( m_video_io_buffer_kbytes * 1024 );
+#endif
+		break;
+
+	case AudioBufferMs:
+		m_audio_buffer_ms = as_int( value );
+		if ( m_audio_buffer_ms < 10 )
+			m_audio_buffer_ms = 10;
+		else if ( m_audio_buffer_ms > 1000 )
+			m_audio_buffer_ms = 1000;
+
+#ifndef NO_MOVIE
+		FeMedia::set_audio_buffer_ms( m_audio_buffer_ms );
+#endif
+		break;
+
 	case MoveMouseOnLaunch:
 		m_move_mouse_on_launch = config_str_to_bool( value );
 		break;
@@ -3189,6 +3235,12 @@ bool FeSettings::set_info( int index, const std::string &value )
 #endif
 		break;
 
+	case GpuVideoConversion:
+#ifndef NO_MOVIE
+		FeMedia::set_gpu_conversion( config_str_to_bool( value ) );
+#endif
+		break;
+
 	case MenuLayout:
 		if ( m_menu_layout.compare( value ) != 0 )
 		{
@@ -4346,40 +4398,15 @@ void FeSettings::update_romlist_after_edit(
 	//
 	// Write out the update romlist file
 	//
-	nowide::ofstream outfile( out_path.c_str() );
-	if ( outfile.is_open() )
-	{
-                // one line header showing what the columns represent
-                //
-		int i=0;
-                outfile << "#" << FeRomInfo::indexStrings[i++];
-                while ( i < FeRomInfo::Favourite )
-                        outfile << ";" << FeRomInfo::indexStrings[i++];
-                outfile << std::endl;
-
-                // Now output the list
-                //
-                for ( FeRomInfoListType::const_iterator itl=temp_list.begin();
-                                itl != temp_list.end(); ++itl )
-                        outfile << (*itl).as_output() << std::endl;
-
-                outfile.close();
-	}
+	write_romlist( out_path, temp_list );
 
 	// Clean up stats file if the last entry for a game is deleted
 	//
 	if (( u_type == EraseEntry ) && !found_similar )
 	{
-		// stats
-		std::string path = m_config_path + FE_STATS_SUBDIR;
-		std::string emu = original.get_info( FeRomInfo::Emulator );
-		confirm_directory( path, emu );
-
-		path += emu + "/";
-		path += original.get_info( FeRomInfo::Romname );
-		path += FE_STAT_FILE_EXTENSION;
-
-		delete_file( path );
+		m_rl.get_stats_store().erase(
+			original.get_info( FeRomInfo::Emulator ),
+			original.get_info( FeRomInfo::Romname ) );
 	}
 }
 
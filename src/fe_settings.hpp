@@ -74,6 +74,9 @@ public:
 	std::string file_name;
 };
 
+class FeImportJob;
+class FeImportJobQueue;
+
 class FeLanguage
 {
 public:
@@ -136,6 +139,7 @@ public:
 		SmoothImages,
 		SelectionMaxStep,
 		SelectionSpeed,
+		VideoStartDelay,
 		MoveMouseOnLaunch,
 		ScrapeSnaps,
 		ScrapeMarquees,
@@ -150,6 +154,9 @@ public:
 		HideConsole,
 #endif
 		VideoDecoder,
+		GpuVideoConversion,
+		VideoIOBufferKBytes,
+		AudioBufferMs,
 		MenuPrompt, // 'Displays Menu' prompt
 		MenuLayout, // 'Displays Menu' layout
 		ImageCacheMBytes,
@@ -230,7 +237,10 @@ private:
 	FilterWrapModeType m_filter_wrap_mode;
 	int m_selection_max_step; // max selection acceleration step.  0 to disable accel
 	int m_selection_speed;
+	int m_video_start_delay; // ms the selection has to be still for before a video is opened
 	int m_image_cache_mbytes; // image cache size (in Megabytes)
+	int m_video_io_buffer_kbytes; // video file read buffer size (in Kilobytes)
+	int m_audio_buffer_ms; // audio decoded at a time (in milliseconds)
 	bool m_move_mouse_on_launch; // configure whether mouse gets moved to bottom right corner on launch
 	bool m_scrape_snaps;
 	bool m_scrape_marquees;
@@ -281,6 +291,12 @@ private:
 	bool thegamesdb_scraper( FeImporterContext & );
 	bool apply_xml_import( FeImporterContext & );
 
+	// Run a single romlist build/import job.  Called from the import
+	// workers, so this must only touch the job and read-only settings
+	//
+	friend class FeImportJobQueue;
+	void run_import_job( FeImportJob &, UiUpdate, void * );
+
 	bool load_game_extras(
 		const std::string &romlist_name,
 		const std::string &romname,
@@ -411,6 +427,7 @@ public:
 
 	int selection_speed() const { return m_selection_speed; }
 	int selection_max_step() const { return m_selection_max_step; }
+	int video_start_delay() const { return m_video_start_delay; }
 
 	// get a list of available plugins
 	void get_available_plugins( std::vector < std::string > &list ) const;
@@ -514,10 +531,14 @@ public:
 	// If output_name is empty, then a non-existing filename is chosen for
 	// the resulting romlist file
 	//
+	// If update is true and output_name is an existing romlist, only roms
+	// that are new or have changed since it was built get processed
+	//
 	bool build_romlist( const std::vector< FeImportTask > &task_list,
 		const std::string &output_name,
 		FeFilter &filter,
-		bool full );
+		bool full,
+		bool update=false );
 
 	//
 	// Save an updated rom in the current romlist file (used with "Edit Game" command)
@@ -549,7 +570,8 @@ public:
 
 	// This function implements the config-mode romlist generation
 	// A romlist named "<emu_name>.txt" is created in the romlist dir,
-	// overwriting any previous list of this name.
+	// overwriting any previous list of this name.  Entries in the previous
+	// list for roms that haven't changed since it was built are kept as-is.
 	//
 	// Returns false if cancelled by the user
 	//
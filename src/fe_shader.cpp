@@ -24,13 +24,314 @@
 #include "fe_presentable.hpp"
 #include "fe_image.hpp"
 #include "fe_present.hpp"
+#include "fe_base.hpp" // logging
+#include "fe_file.hpp"
+#include <SFML/System/Clock.hpp>
 #include <iostream>
+#include <list>
+#include <cstdlib>
+#include <cctype>
+
+namespace
+{
+	//
+	// Compiled shaders that aren't in use, kept so that reloading a layout
+	// (or another layout using the same shader) doesn't have to compile
+	// them again.  Most recently released first
+	//
+	const size_t MAX_IDLE_SHADERS=16;
+
+	struct idle_shader_t
+	{
+		std::string key;
+		sf::Shader *shader;
+		std::string current_texture; // see FeShader::m_current_texture
+	};
+	std::list< idle_shader_t > idle_shaders;
+
+	bool read_stream( sf::InputStream &s, std::string &out )
+	{
+		sf::Int64 size = s.getSize();
+		if (( size < 0 ) || ( s.seek( 0 ) < 0 ))
+			return false;
+
+		out.resize( (size_t)size );
+		return (( size == 0 ) || ( s.read( &out[0], size ) == size ));
+	}
+
+	bool read_file( const std::string &fn, std::string &out )
+	{
+		FeFileInputStream fs( fn );
+		if ( !read_stream( fs, out ) )
+		{
+			FeLog() << "Error reading shader file: " << fn << std::endl;
+			return false;
+		}
+
+		return true;
+	}
+
+	// split a FeShader key back into the vertex and fragment shader source
+	void split_key( const std::string &key, std::string &vert, std::string &frag )
+	{
+		size_t pos = key.find( '\0' );
+		if ( key.empty() || ( pos == std::string::npos ))
+			return;
+
+		vert = key.substr( 1, pos - 1 );
+		frag = key.substr( pos + 1 );
+	}
+
+	bool load_shader( sf::Shader *s, FeShader::Type t,
+		const std::string &vert, const std::string &frag )
+	{
+		if ( t == FeShader::VertexAndFragment )
+			return s->loadFromMemory( vert, frag );
+		else if ( t == FeShader::Vertex )
+			return s->loadFromMemory( vert, sf::Shader::Vertex );
+		else
+			return s->loadFromMemory( frag, sf::Shader::Fragment );
+	}
+
+	void set_uniform( sf::Shader *s, const std::string &name, int size, const float *v )
+	{
+		switch ( size )
+		{
+#if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
+		case 1: s->setUniform( name, v[0] ); break;
+		case 2: s->setUniform( name, sf::Glsl::Vec2( v[0], v[1] ) ); break;
+		case 3: s->setUniform( name, sf::Glsl::Vec3( v[0], v[1], v[2] ) ); break;
+		case 4: s->setUniform( name, sf::Glsl::Vec4( v[0], v[1], v[2], v[3] ) ); break;
+#else
+		case 1: s->setParameter( name, v[0] ); break;
+		case 2: s->setParameter( name, v[0], v[1] ); break;
+		case 3: s->setParameter( name, v[0], v[1], v[2] ); break;
+		case 4: s->setParameter( name, v[0], v[1], v[2], v[3] ); break;
+#endif
+		default: break;
+		}
+	}
+
+	bool is_ident_char( char c )
+	{
+		return ( isalnum( (unsigned char)c ) || ( c == '_' ));
+	}
+
+	std::string strip_comments( const std::string &src )
+	{
+		std::string out( src );
+		size_t i=0;
+		while ( i < out.size() )
+		{
+			size_t end=i;
+			if ( out.compare( i, 2, "//" ) == 0 )
+				end = out.find( '\n', i );
+			else if ( out.compare( i, 2, "/*" ) == 0 )
+			{
+				end = out.find( "*/", i + 2 );
+				if ( end != std::string::npos )
+					end += 2;
+			}
+
+			if ( end == std::string::npos )
+				end = out.size();
+
+			if ( end == i )
+				i++;
+			else
+			{
+				while ( i < end )
+					out[i++] = ' ';
+			}
+		}
+		return out;
+	}
+
+	void skip_space( const char *&p )
+	{
+		while ( isspace( (unsigned char)*p ) )
+			p++;
+	}
+
+	//
+	// Parse a uniform's initializer: a number, or a constructor such as
+	// "vec3( 1.0, 0.5, 0.0 )" with numbers for its arguments
+	//
+	bool parse_initializer( const std::string &init, int size, float *v )
+	{
+		const char *p = init.c_str();
+		skip_space( p );
+
+		bool ctor=false;
+		if ( isalpha( (unsigned char)*p ) )
+		{
+			const char *type = p;
+			while ( is_ident_char( *p ) )
+				p++;
+
+			std::string t( type, p - type );
+			if (( t.compare( "float" ) != 0 ) && ( t.compare( "int" ) != 0 )
+					&& ( t.compare( 0, 3, "vec" ) != 0 ) && ( t.compare( 0, 4, "ivec" ) != 0 ))
+				return false;
+
+			skip_space( p );
+			if ( *p != '(' )
+				return false;
+
+			p++;
+			ctor=true;
+		}
+
+		int n=0;
+		while ( true )
+		{
+			char *end;
+			double d = strtod( p, &end );
+			if (( end == p ) || ( n >= 4 ))
+				return false;
+
+			v[n++] = (float)d;
+			p = end;
+			if (( *p == 'f' ) || ( *p == 'F' ))
+				p++;
+
+			skip_space( p );
+			if ( ctor && ( *p == ',' ))
+			{
+				p++;
+				continue;
+			}
+			break;
+		}
+
+		if ( ctor )
+		{
+			if ( *p != ')' )
+				return false;
+			p++;
+		}
+
+		skip_space( p );
+		if ( *p )
+			return false;
+
+		if (( n == 1 ) && ( ctor || ( size == 1 )))
+		{
+			for ( int i=1; i<size; i++ )
+				v[i] = v[0];
+			return true;
+		}
+
+		return ( n == size );
+	}
+
+	//
+	// Find the value that uniform "name" starts out with in the shader
+	// source: its initializer, or zero if it doesn't have one.  Returns 1
+	// if found (with the value in v), 0 if src doesn't declare the uniform
+	// and -1 if it does but the value can't be worked out
+	//
+	int find_uniform_default( const std::string &src, const std::string &name,
+		int size, float *v )
+	{
+		std::string s = strip_comments( src );
+
+		size_t pos=0;
+		while (( pos = s.find( "uniform", pos )) != std::string::npos )
+		{
+			size_t start=pos;
+			pos += 7;
+			if ((( start > 0 ) && is_ident_char( s[start-1] ))
+					|| (( pos < s.size() ) && is_ident_char( s[pos] )))
+				continue;
+
+			size_t end = s.find( ';', pos );
+			if ( end == std::string::npos )
+				break;
+
+			std::string decl = s.substr( pos, end - pos );
+			pos = end;
+
+			// uniform blocks aren't handled
+			if ( decl.find( '{' ) != std::string::npos )
+			{
+				if ( decl.find( name ) != std::string::npos )
+					return -1;
+				continue;
+			}
+
+			//
+			// "[qualifiers] type name [= init], name [= init]..."
+			//
+			size_t item=0;
+			while ( item <= decl.size() )
+			{
+				int depth=0;
+				size_t i=item;
+				size_t eq=std::string::npos;
+				for ( ; i<decl.size(); i++ )
+				{
+					if ( decl[i] == '(' ) depth++;
+					else if ( decl[i] == ')' ) depth--;
+					else if (( decl[i] == '=' ) && ( depth == 0 ) && ( eq == std::string::npos ))
+						eq = i;
+					else if (( decl[i] == ',' ) && ( depth == 0 ))
+						break;
+				}
+
+				std::string lhs = decl.substr( item,
+					(( eq == std::string::npos ) ? i : eq ) - item );
+
+				bool is_array=false;
+				size_t name_end = lhs.find( '[' );
+				if ( name_end != std::string::npos )
+					is_array=true;
+				else
+					name_end = lhs.size();
+
+				while (( name_end > 0 ) && isspace( (unsigned char)lhs[name_end-1] ))
+					name_end--;
+
+				size_t name_start=name_end;
+				while (( name_start > 0 ) && is_ident_char( lhs[name_start-1] ))
+					name_start--;
+
+				if ( lhs.compare( name_start, name_end - name_start, name ) == 0 )
+				{
+					if ( is_array )
+						return -1;
+
+					for ( int j=0; j<4; j++ )
+						v[j] = 0.f;
+
+					if ( eq == std::string::npos )
+						return 1;
+
+					return parse_initializer(
+						decl.substr( eq + 1, i - eq - 1 ), size, v ) ? 1 : -1;
+				}
+
+				item = i + 1;
+			}
+		}
+
+		return 0;
+	}
+};
 
 FeShader::FeShader()
-	: m_type( Empty )
+	: m_type( Empty ),
+	m_shader( NULL ),
+	m_param_changes( 0 ),
+	m_image_texture( false )
 {
 }
 
+FeShader::~FeShader()
+{
+	release();
+}
+
 bool FeShader::load( sf::InputStream &vert_shader,
 		sf::InputStream &frag_shader )
 {
@@ -38,8 +339,11 @@ bool FeShader::load( sf::InputStream &vert_shader,
 	if ( !sf::Shader::isAvailable() )
 		return true;
 
-	m_type = VertexAndFragment;
-	return m_shader.loadFromStream( vert_shader, frag_shader );
+	std::string vert, frag;
+	read_stream( vert_shader, vert );
+	read_stream( frag_shader, frag );
+
+	return compile( VertexAndFragment, vert, frag, "(memory)" );
 }
 
 bool FeShader::load( sf::InputStream &sh,
@@ -49,9 +353,13 @@ bool FeShader::load( sf::InputStream &sh,
 	if ( !sf::Shader::isAvailable() || ( t == Empty ) )
 		return true;
 
-	m_type = t;
-	return m_shader.loadFromStream( sh,
-		(t == Fragment) ? sf::Shader::Fragment : sf::Shader::Vertex );
+	std::string src;
+	read_stream( sh, src );
+
+	if ( t == Fragment )
+		return compile( t, "", src, "(memory)" );
+	else
+		return compile( t, src, "", "(memory)" );
 }
 
 bool FeShader::load( const std::string &vert_shader,
@@ -61,8 +369,11 @@ bool FeShader::load( const std::string &vert_shader,
 	if ( !sf::Shader::isAvailable() )
 		return true;
 
-	m_type = VertexAndFragment;
-	return m_shader.loadFromFile( vert_shader, frag_shader );
+	std::string vert, frag;
+	read_file( vert_shader, vert );
+	read_file( frag_shader, frag );
+
+	return compile( VertexAndFragment, vert, frag, vert_shader + ", " + frag_shader );
 }
 
 bool FeShader::load( const std::string &sh,
@@ -72,72 +383,238 @@ bool FeShader::load( const std::string &sh,
 	if ( !sf::Shader::isAvailable() || ( t == Empty ) )
 		return true;
 
+	std::string src;
+	read_file( sh, src );
+
+	if ( t == Fragment )
+		return compile( t, "", src, sh );
+	else
+		return compile( t, src, "", sh );
+}
+
+bool FeShader::compile( Type t, const std::string &vert, const std::string &frag,
+		const std::string &label )
+{
+	release();
+
 	m_type = t;
-	return m_shader.loadFromFile( sh,
-		(t == Fragment) ? sf::Shader::Fragment : sf::Shader::Vertex );
+	m_key = std::string( 1, (char)( '0' + t ) ) + vert;
+	m_key += '\0';
+	m_key += frag;
+	m_param_changes = 0;
+
+	for ( std::list< idle_shader_t >::iterator itr = idle_shaders.begin();
+			itr != idle_shaders.end(); ++itr )
+	{
+		if ( itr->key == m_key )
+		{
+			m_shader = itr->shader;
+			m_current_texture = itr->current_texture;
+			idle_shaders.erase( itr );
+
+			FeDebug() << "Reusing compiled shader: " << label << std::endl;
+			return true;
+		}
+	}
+
+	sf::Clock clk;
+	m_shader = new sf::Shader();
+
+	bool retval = load_shader( m_shader, t, vert, frag );
+
+	FeDebug() << "Compiled shader in " << clk.getElapsedTime().asMilliseconds()
+		<< "ms: " << label << std::endl;
+
+	// a shader that failed to compile isn't worth keeping
+	if ( !retval )
+		m_key.clear();
+
+	return retval;
 }
 
-void FeShader::set_param( const char *name, float x )
+void FeShader::release()
 {
-	if ( m_type != Empty )
+	if ( !m_shader )
+		return;
+
+	//
+	// Put every parameter that was set back to the value it starts out
+	// with in the shader source, so the next layout to use the shader gets
+	// it as if it was freshly compiled.  The current texture parameter is
+	// set to texture unit 0 on each draw, which is where a sampler starts
+	// out anyway.  Shaders that can't be put back (an image's texture is
+	// set, which SFML has no way to unset, or a parameter's starting value
+	// can't be worked out) aren't kept
+	//
+	bool keep = !m_key.empty();
+
+	std::string vert, frag;
+	split_key( m_key, vert, frag );
+
+	for ( std::vector< FeShaderParam >::iterator itr = m_params.begin();
+			keep && ( itr != m_params.end() ); ++itr )
 	{
-#if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
-		m_shader.setUniform( name, x );
-#else
-		m_shader.setParameter( name, x );
-#endif
-		FePresent::script_flag_redraw();
+		if ( (*itr).size < 0 )
+			keep = false;
+		else if ( (*itr).size > 0 )
+		{
+			float v[4];
+			int r = find_uniform_default( vert, (*itr).name, (*itr).size, v );
+			if ( r == 0 )
+				r = find_uniform_default( frag, (*itr).name, (*itr).size, v );
+
+			if ( r < 0 )
+				keep = false;
+			else if ( r > 0 )
+				set_uniform( m_shader, (*itr).name, (*itr).size, v );
+		}
+	}
+
+	if ( keep )
+	{
+		idle_shader_t is;
+		is.key = m_key;
+		is.shader = m_shader;
+		is.current_texture = m_current_texture;
+		idle_shaders.push_front( is );
+
+		while ( idle_shaders.size() > MAX_IDLE_SHADERS )
+		{
+			delete idle_shaders.back().shader;
+			idle_shaders.pop_back();
+		}
 	}
+	else
+		delete m_shader;
+
+	m_shader = NULL;
+	m_key.clear();
+	m_params.clear();
+	m_current_texture.clear();
+	m_image_texture = false;
 }
 
-void FeShader::set_param( const char *name, float x, float y )
+bool FeShader::recompile()
 {
-	if ( m_type != Empty )
+	std::string vert, frag;
+	split_key( m_key, vert, frag );
+
+	sf::Shader *s = new sf::Shader();
+	if ( !load_shader( s, m_type, vert, frag ) )
 	{
+		delete s;
+		return false;
+	}
+
+	delete m_shader;
+	m_shader = s;
+	m_current_texture.clear();
+
+	for ( std::vector< FeShaderParam >::iterator itr = m_params.begin();
+			itr != m_params.end(); ++itr )
+	{
+		if ( (*itr).size > 0 )
+			set_uniform( m_shader, (*itr).name, (*itr).size, (*itr).v );
+		else if ( (*itr).size == 0 )
+		{
 #if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
-		m_shader.setUniform( name, sf::Glsl::Vec2( x, y ) );
+			m_shader->setUniform( (*itr).name, sf::Shader::CurrentTexture );
 #else
-		m_shader.setParameter( name, x, y );
+			m_shader->setParameter( (*itr).name, sf::Shader::CurrentTexture );
 #endif
-		FePresent::script_flag_redraw();
+			m_current_texture = (*itr).name;
+		}
+		else if ( (*itr).texture )
+		{
+#if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
+			m_shader->setUniform( (*itr).name, *(*itr).texture );
+#else
+			m_shader->setParameter( (*itr).name, *(*itr).texture );
+#endif
+		}
 	}
+
+	return true;
 }
 
-void FeShader::set_param( const char *name, float x, float y, float z )
+FeShader::FeShaderParam &FeShader::record_param( const char *name, int size )
 {
-	if ( m_type != Empty )
+	std::vector< FeShaderParam >::iterator itr;
+	for ( itr = m_params.begin(); itr != m_params.end(); ++itr )
 	{
-#if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
-		m_shader.setUniform( name, sf::Glsl::Vec3( x, y, z ) );
-#else
-		m_shader.setParameter( name, x, y, z );
-#endif
-		FePresent::script_flag_redraw();
+		if ( (*itr).name.compare( name ) == 0 )
+			break;
+	}
+
+	if ( itr == m_params.end() )
+	{
+		m_params.push_back( FeShaderParam() );
+		itr = m_params.end() - 1;
+		(*itr).name = name;
 	}
+
+	(*itr).size = size;
+	(*itr).texture = NULL;
+	return *itr;
 }
 
-void FeShader::set_param( const char *name, float x, float y, float z, float w )
+void FeShader::set_float_param( const char *name, int size, float x, float y, float z, float w )
 {
 	if ( m_type != Empty )
 	{
-#if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
-		m_shader.setUniform( name, sf::Glsl::Vec4( x, y, z, w ) );
-#else
-		m_shader.setParameter( name, x, y, z, w );
-#endif
+		FeShaderParam &p = record_param( name, size );
+		p.v[0] = x;
+		p.v[1] = y;
+		p.v[2] = z;
+		p.v[3] = w;
+
+		set_uniform( m_shader, p.name, size, p.v );
+		m_param_changes++;
 		FePresent::script_flag_redraw();
 	}
 }
 
+void FeShader::clear_cache()
+{
+	while ( !idle_shaders.empty() )
+	{
+		delete idle_shaders.back().shader;
+		idle_shaders.pop_back();
+	}
+}
+
+void FeShader::set_param( const char *name, float x )
+{
+	set_float_param( name, 1, x, 0.f, 0.f, 0.f );
+}
+
+void FeShader::set_param( const char *name, float x, float y )
+{
+	set_float_param( name, 2, x, y, 0.f, 0.f );
+}
+
+void FeShader::set_param( const char *name, float x, float y, float z )
+{
+	set_float_param( name, 3, x, y, z, 0.f );
+}
+
+void FeShader::set_param( const char *name, float x, float y, float z, float w )
+{
+	set_float_param( name, 4, x, y, z, w );
+}
+
 void FeShader::set_texture_param( const char *name )
 {
 	if ( m_type != Empty )
 	{
 #if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
-		m_shader.setUniform( name, sf::Shader::CurrentTexture );
+		m_shader->setUniform( name, sf::Shader::CurrentTexture );
 #else
-		m_shader.setParameter( name, sf::Shader::CurrentTexture );
+		m_shader->setParameter( name, sf::Shader::CurrentTexture );
 #endif
+		record_param( name, 0 );
+		m_current_texture = name;
+		m_param_changes++;
 		FePresent::script_flag_redraw();
 	}
 }
@@ -150,11 +627,32 @@ void FeShader::set_texture_param( const char *name, FeImage *image )
 
 		if ( texture )
 		{
+			FeShaderParam &p = record_param( name, -1 );
+			p.texture = texture;
+
+			//
+			// SFML keeps drawing the current texture to the parameter that
+			// was last set to it, even once it is set to another texture.
+			// If that is this parameter (which can be left over from the
+			// layout that used the shader before), start from a fresh copy
+			// of the shader instead
+			//
+			if ( m_current_texture.compare( name ) == 0 )
+			{
+				if ( !recompile() )
+					FeLog() << "Error recompiling shader to set texture parameter: "
+						<< name << std::endl;
+			}
+			else
+			{
 #if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
-			m_shader.setUniform( name, *texture );
+				m_shader->setUniform( name, *texture );
 #else
-			m_shader.setParameter( name, *texture );
+				m_shader->setParameter( name, *texture );
 #endif
+			}
+			m_param_changes++;
+			m_image_texture = true;
 			FePresent::script_flag_redraw();
 		}
 	}
@@ -24,6 +24,9 @@
 #define FE_SHADER_HPP
 
 #include <SFML/Graphics/Shader.hpp>
+#include <string>
+#include <vector>
+
 class FeImage;
 
 class FeShader
@@ -38,6 +41,8 @@ public:
 	};
 
 	FeShader();
+	~FeShader();
+
 	bool load( sf::InputStream &vert, sf::InputStream &frag );
 	bool load( sf::InputStream &sh, Type t );
 
@@ -51,15 +56,54 @@ public:
 	void set_texture_param( const char *name );
 	void set_texture_param( const char *name, FeImage *image );
 
-	const sf::Shader *get_shader() const { return ( m_type != Empty ) ? &m_shader : NULL; };
+	const sf::Shader *get_shader() const { return ( m_type != Empty ) ? m_shader : NULL; };
 	Type get_type() const { return m_type; };
 
+	// Count of parameter changes, lets surfaces tell if they need redrawing
+	unsigned int get_param_changes() const { return m_param_changes; };
+
+	// true if the shader samples another image's texture
+	bool uses_image_texture() const { return m_image_texture; };
+
+	//
+	// Compiled shaders are kept for reuse after the FeShader using them is
+	// deleted (when the layout is cleared).  Call this to free them
+	//
+	static void clear_cache();
+
 private:
 	FeShader( const FeShader & );
 	const FeShader &operator=( const FeShader & );
 
+	//
+	// A parameter that has been set on the shader, so that it can be put
+	// back before the compiled shader is kept for reuse
+	//
+	struct FeShaderParam
+	{
+		std::string name;
+		int size; // number of floats, 0 for the current texture, -1 for an image's texture
+		float v[4];
+		const sf::Texture *texture;
+	};
+
+	bool compile( Type t, const std::string &vert, const std::string &frag,
+		const std::string &label );
+	void release();
+
+	// compile a fresh copy of the shader and set its parameters again
+	bool recompile();
+
+	FeShaderParam &record_param( const char *name, int size );
+	void set_float_param( const char *name, int size, float x, float y, float z, float w );
+
 	Type m_type;
-	sf::Shader m_shader;
+	sf::Shader *m_shader;
+	std::string m_key; // type and source code, empty if not to be kept for reuse
+	std::vector< FeShaderParam > m_params;
+	std::string m_current_texture; // parameter SFML sets to the current texture
+	unsigned int m_param_changes;
+	bool m_image_texture;
 };
 
 #endif
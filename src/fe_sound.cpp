@@ -29,6 +29,15 @@
 #include <iostream>
 #include <cstring>
 
+namespace
+{
+	//
+	// Event sounds longer than this get streamed from file rather than
+	// kept in memory
+	//
+	const float FE_MAX_DECODED_SOUND_SECONDS = 10.f;
+};
+
 FeSoundSystem::FeSoundSystem( FeSettings *fes )
 	: m_sound( false ),
 	m_music( true ),
@@ -39,8 +48,43 @@ FeSoundSystem::FeSoundSystem( FeSettings *fes )
 
 FeSoundSystem::~FeSoundSystem()
 {
+	clear_sound_cache();
 }
 
+void FeSoundSystem::clear_sound_cache()
+{
+#ifndef NO_MOVIE
+	// m_sound may be playing from one of the decoded sounds
+	if ( !m_decoded.empty() )
+		m_sound.close();
+
+	for ( std::map< std::string, FeDecodedSound * >::iterator itr=m_decoded.begin();
+			itr != m_decoded.end(); ++itr )
+		delete (*itr).second;
+
+	m_decoded.clear();
+#endif
+}
+
+#ifndef NO_MOVIE
+const FeDecodedSound *FeSoundSystem::get_decoded( const std::string &fn )
+{
+	std::map< std::string, FeDecodedSound * >::iterator itr = m_decoded.find( fn );
+	if ( itr != m_decoded.end() )
+		return (*itr).second;
+
+	FeDecodedSound *s = new FeDecodedSound;
+	if ( !FeMedia::decode( "", fn, sf::seconds( FE_MAX_DECODED_SOUND_SECONDS ), *s ) )
+	{
+		delete s;
+		s = NULL;
+	}
+
+	m_decoded[ fn ] = s;
+	return s;
+}
+#endif
+
 FeSound &FeSoundSystem::get_ambient_sound()
 {
 	return m_music;
@@ -56,7 +100,15 @@ void FeSoundSystem::sound_event( FeInputMap::Command c )
 		return;
 
 	if ( sound.compare( m_sound.get_file_name() ) != 0 )
-		m_sound.load( "", sound );
+	{
+#ifndef NO_MOVIE
+		const FeDecodedSound *d = get_decoded( sound );
+		if ( d )
+			m_sound.load_decoded( sound, d );
+		else
+#endif
+			m_sound.load( "", sound );
+	}
 
 	m_current_sound = c;
 	m_sound.set_playing( true );
@@ -211,6 +263,38 @@ void FeSound::load( const std::string &path, const std::string &fn )
 	}
 }
 
+void FeSound::close()
+{
+#ifdef NO_MOVIE
+	m_sound.stop();
+#else
+	m_sound.close();
+#endif
+
+	if ( m_stream )
+	{
+		delete m_stream;
+		m_stream = NULL;
+	}
+
+	m_file_name = "";
+	m_play_state = false;
+}
+
+#ifndef NO_MOVIE
+void FeSound::load_decoded( const std::string &fn, const FeDecodedSound *s )
+{
+	if ( m_stream )
+	{
+		delete m_stream;
+		m_stream = NULL;
+	}
+
+	m_sound.open_decoded( s );
+	m_file_name = fn;
+}
+#endif
+
 void FeSound::set_file_name( const char *n )
 {
 	std::string path;
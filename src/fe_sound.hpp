@@ -31,6 +31,7 @@
 #endif
 
 #include <string>
+#include <map>
 #include "fe_input.hpp"
 
 class FeSettings;
@@ -60,6 +61,11 @@ public:
 	~FeSound();
 
 	void load( const std::string &path, const std::string &fn );
+	void close();
+#ifndef NO_MOVIE
+	// play sound s from memory, fn is the file it was decoded from
+	void load_decoded( const std::string &fn, const FeDecodedSound *s );
+#endif
 	void tick();
 
 	void load_from_archive( const char *, const char * );
@@ -102,6 +108,17 @@ private:
 	FeSettings *m_fes;
 	FeInputMap::Command m_current_sound;
 
+#ifndef NO_MOVIE
+	//
+	// Event sounds decoded into memory, by file name, so they play without
+	// having to open and decode the file each time.  NULL for files that
+	// are too long to keep in memory, which get streamed instead
+	//
+	std::map< std::string, FeDecodedSound * > m_decoded;
+
+	const FeDecodedSound *get_decoded( const std::string &fn );
+#endif
+
 public:
 	FeSoundSystem( FeSettings * );
 	~FeSoundSystem();
@@ -116,6 +133,9 @@ public:
 	void stop();
 	void tick();
 
+	// drop the decoded event sounds, so they get reloaded from file
+	void clear_sound_cache();
+
 	void release_audio( bool );
 };
 
@@ -83,7 +83,7 @@ void FeText::setColor( const sf::Color &c )
 	if ( c != m_draw_text.getColor() )
 	{
 		m_draw_text.setColor( c );
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -301,7 +301,7 @@ void FeText::set_bgr(int r)
 	{
 		c.r=r;
 		m_draw_text.setBgColor(c);
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -313,7 +313,7 @@ void FeText::set_bgg(int g)
 	{
 		c.g=g;
 		m_draw_text.setBgColor(c);
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -325,7 +325,7 @@ void FeText::set_bgb(int b)
 	{
 		c.b=b;
 		m_draw_text.setBgColor(c);
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -337,7 +337,7 @@ void FeText::set_bga(int a)
 	{
 		c.a=a;
 		m_draw_text.setBgColor(c);
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -355,7 +355,7 @@ void FeText::set_bg_rgb(int r, int g, int b )
 			c.a = 255;
 
 		m_draw_text.setBgColor(c);
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
@@ -388,7 +388,7 @@ void FeText::set_style(int s)
 	if ( s != m_draw_text.getStyle() )
 	{
 		m_draw_text.setStyle(s);
-		FePresent::script_flag_redraw();
+		flag_redraw();
 	}
 }
 
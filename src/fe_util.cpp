@@ -267,6 +267,59 @@ bool directory_exists( const std::string &file )
 		return file_exists( file + '/' );
 }
 
+bool get_file_stats( const std::string &file, long long &size, long long &mtime )
+{
+#ifdef SFML_SYSTEM_WINDOWS
+	struct _stat64 st;
+	if ( _wstat64( widen( file ).c_str(), &st ) != 0 )
+		return false;
+#else
+	struct stat st;
+	if ( stat( file.c_str(), &st ) != 0 )
+		return false;
+#endif
+
+	size = st.st_size;
+	mtime = st.st_mtime;
+	return true;
+}
+
+bool get_file_stats( const std::string &file, long long &size, long long &mtime,
+	long long &mtime_nsec )
+{
+	mtime_nsec = 0;
+
+#ifdef SFML_SYSTEM_WINDOWS
+	if ( !get_file_stats( file, size, mtime ) )
+		return false;
+
+	// FILETIME is in 100ns intervals
+	WIN32_FILE_ATTRIBUTE_DATA fad;
+	if ( GetFileAttributesExW( widen( file ).c_str(), GetFileExInfoStandard, &fad ) )
+	{
+		ULARGE_INTEGER t;
+		t.LowPart = fad.ftLastWriteTime.dwLowDateTime;
+		t.HighPart = fad.ftLastWriteTime.dwHighDateTime;
+		mtime_nsec = (long long)( t.QuadPart % 10000000 ) * 100;
+	}
+
+	return true;
+#else
+	struct stat st;
+	if ( stat( file.c_str(), &st ) != 0 )
+		return false;
+
+	size = st.st_size;
+	mtime = st.st_mtime;
+#if defined(SFML_SYSTEM_MACOS)
+	mtime_nsec = st.st_mtimespec.tv_nsec;
+#else
+	mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+	return true;
+#endif
+}
+
 bool is_relative_path( const std::string &n )
 {
 	std::string name = clean_path( n );
@@ -698,7 +751,7 @@ bool token_helper( const std::string &from,
 	else
 	{
 		size_t l = from.find_last_not_of( FE_WHITESPACE, end-1 );
-		token = from.substr( f, l-f+1 );
+		token.assign( from, f, l-f+1 );
 	}
 
 	if ( escaped )
@@ -760,6 +813,37 @@ void delete_file( const std::string &file )
 	nowide::remove( file.c_str() );
 }
 
+bool get_file_contents( const std::string &file, std::string &contents )
+{
+	FILE *f = nowide::fopen( file.c_str(), "rb" );
+	if ( !f )
+		return false;
+
+	bool retval = false;
+	if ( fseek( f, 0, SEEK_END ) == 0 )
+	{
+		long len = ftell( f );
+		if (( len >= 0 ) && ( fseek( f, 0, SEEK_SET ) == 0 ))
+		{
+			contents.resize( len );
+			retval = (( len == 0 ) || ( fread( &(contents[0]), 1, len, f ) == (size_t)len ));
+		}
+	}
+
+	fclose( f );
+	return retval;
+}
+
+bool replace_file( const std::string &from, const std::string &to )
+{
+#ifdef SFML_SYSTEM_WINDOWS
+	return ( MoveFileExW( widen( from ).c_str(), widen( to ).c_str(),
+		MOVEFILE_REPLACE_EXISTING ) != 0 );
+#else
+	return ( nowide::rename( from.c_str(), to.c_str() ) == 0 );
+#endif
+}
+
 bool confirm_directory( const std::string &base, const std::string &sub )
 {
 	bool retval=false;
@@ -1672,18 +1756,21 @@ bool line_to_setting_and_value( const std::string &line,
 {
 	size_t pos( 0 );
 
-	std::string tmp_setting;
-	token_helper( line, pos, tmp_setting, sep );
+	// Setting and value get filled in place so that when a caller reuses
+	// them from line to line their storage gets reused as well
+	//
+	token_helper( line, pos, setting, sep );
 
 	// skip comments
-	if (( tmp_setting.size() > 0 ) && ( tmp_setting[0] != '#' ))
+	if (( setting.size() > 0 ) && ( setting[0] != '#' ))
 	{
 		pos = line.find_first_not_of( FE_WHITESPACE, pos );
 		size_t end = line.find_last_not_of( FE_WHITESPACE );
 		if ( pos != std::string::npos )
-			value = line.substr( pos, end - pos + 1 );
+			value.assign( line, pos, end - pos + 1 );
+		else
+			value.clear();
 
-		setting.swap( tmp_setting );
 		return true;
 	}
 
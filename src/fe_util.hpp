@@ -168,6 +168,15 @@ bool file_exists( const std::string &file );
 // return true if specified path is an existing directory
 bool directory_exists( const std::string &file );
 
+// get the size and last modification time of the specified file (or
+// directory).  Returns false if it doesn't exist
+bool get_file_stats( const std::string &file, long long &size, long long &mtime );
+
+// as above, with mtime_nsec set to the sub-second part of the modification
+// time (in nanoseconds) where the platform provides it, otherwise 0
+bool get_file_stats( const std::string &file, long long &size, long long &mtime,
+	long long &mtime_nsec );
+
 // return true if the specified path is a relative path
 bool is_relative_path( const std::string &file );
 
@@ -252,6 +261,16 @@ bool confirm_directory( const std::string &base, const std::string &sub );
 //
 void delete_file( const std::string &file );
 
+//
+// Read the entire contents of file into contents with a single read
+//
+bool get_file_contents( const std::string &file, std::string &contents );
+
+//
+// Move file "from" to "to", replacing "to" if it already exists
+//
+bool replace_file( const std::string &from, const std::string &to );
+
 //
 // Return integer as a string
 //
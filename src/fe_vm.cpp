@@ -35,6 +35,7 @@
 #include "fe_util.hpp"
 #include "fe_util_sq.hpp"
 #include "image_loader.hpp"
+#include "fe_profile.hpp"
 #include "zip.hpp"
 
 #include <sqrat.h>
@@ -50,6 +51,7 @@
 #include <stdio.h>
 #include <ctime>
 #include <stdarg.h>
+#include <algorithm>
 
 const char *FE_SCRIPT_NV_FILE = "script.nv";
 
@@ -269,7 +271,15 @@ FeCallback::FeCallback( int pid,
 		FeSettings &fes )
 	: m_sid( pid ),
 	m_env( env ),
-	m_fn( fn )
+	m_fn( fn ),
+	m_overlap( false ),
+	m_total_us( 0 ),
+	m_max_us( 0 ),
+	m_calls( 0 ),
+	m_skipped( 0 ),
+	m_budget_us( 0 ),
+	m_budget_frames( 1 ),
+	m_skip( 0 )
 {
 	// the layout/screensaver/intro will have a m_pid < 0
 	if ( pid < 0 )
@@ -296,6 +306,46 @@ Sqrat::Function &FeCallback::get_fn()
 	return m_cached_fn;
 }
 
+bool FeCallback::skip_call()
+{
+	if ( m_skip <= 0 )
+		return false;
+
+	m_skip--;
+	m_skipped++;
+	return true;
+}
+
+void FeCallback::add_call_time( const sf::Time &t )
+{
+	sf::Int64 us = t.asMicroseconds();
+
+	m_total_us += us;
+	m_max_us = std::max( m_max_us, us );
+	m_calls++;
+
+	//
+	// If this call went over budget, sit out the next few ticks
+	//
+	if (( m_budget_us > 0 ) && ( us > m_budget_us ))
+		m_skip = m_budget_frames - 1;
+}
+
+void FeCallback::set_budget( int budget_ms, int frames )
+{
+	m_budget_us = ( budget_ms > 0 ) ? budget_ms * 1000 : 0;
+	m_budget_frames = std::max( frames, 1 );
+	m_skip = 0;
+}
+
+float FeCallback::get_average_ms() const
+{
+	if ( m_calls < 1 )
+		return 0.f;
+
+	return m_total_us / 1000.f / m_calls;
+}
+
 const char *FeVM::transitionTypeStrings[] =
 {
 		"StartLayout",
@@ -320,7 +370,8 @@ FeVM::FeVM( FeSettings &fes, FeFontContainer &defaultfont, FeWindow &wnd, FeSoun
 	m_redraw_triggered( false ),
 	m_process_console_input( console_input ),
 	m_script_cfg( NULL ),
-	m_script_id( -1 )
+	m_script_id( -1 ),
+	m_trans_generation( 0 )
 {
 	srand( time( NULL ) );
 	vm_init();
@@ -411,8 +462,21 @@ void FeVM::clear()
 	FePresent::clear();
 
 	m_last_ui_cmd = sf::Time();
+
+	for ( std::vector<FeCallback>::iterator itr = m_ticks.begin();
+		itr != m_ticks.end(); ++itr )
+	{
+		if ( (*itr).m_calls || (*itr).m_skipped )
+			FeDebug() << "Tick callback " << (*itr).m_fn << ": " << (*itr).m_calls
+				<< " calls, average " << (*itr).get_average_ms() << "ms, max "
+				<< (*itr).m_max_us / 1000.f << "ms, skipped (over budget): "
+				<< (*itr).m_skipped << std::endl;
+	}
+
 	m_ticks.clear();
+	m_active_trans.clear();
 	m_trans.clear();
+	m_trans_generation++;
 	m_sig_handlers.clear();
 
 	while ( !m_posted_commands.empty() )
@@ -425,10 +489,24 @@ void FeVM::add_ticks_callback( Sqrat::Object func, const char *slot )
 		FeCallback( m_script_id, func, slot, *m_feSettings ) );
 }
 
-void FeVM::add_transition_callback( Sqrat::Object func, const char *slot )
+void FeVM::set_ticks_budget( Sqrat::Object func, const char *slot,
+		int budget_ms, int frames )
+{
+	for ( std::vector<FeCallback>::iterator itr = m_ticks.begin();
+			itr != m_ticks.end(); ++itr )
+	{
+		if (( (*itr).m_fn.compare( slot ) == 0 )
+				&& ( fe_obj_compare( func.GetVM(), func.GetObject(), (*itr).m_env.GetObject() ) == 0 ))
+			(*itr).set_budget( budget_ms, frames );
+	}
+}
+
+void FeVM::add_transition_callback( Sqrat::Object func, const char *slot, bool overlap )
 {
 	m_trans.push_back(
 		FeCallback( m_script_id, func, slot, *m_feSettings ) );
+
+	m_trans.back().m_overlap = overlap;
 }
 
 void FeVM::add_signal_handler( Sqrat::Object func, const char *slot )
@@ -822,6 +900,7 @@ bool FeVM::on_new_layout()
 		.Prop( _SC("toggle_rotation"), &FePresent::get_toggle_rotation, &FePresent::set_toggle_rotation )
 		.Prop( _SC("page_size"), &FePresent::get_page_size, &FePresent::set_page_size )
 		.Prop(_SC("preserve_aspect_ratio"), &FePresent::get_preserve_aspect_ratio, &FePresent::set_preserve_aspect_ratio )
+		.Prop(_SC("gpu_pinch"), &FePresent::get_gpu_pinch, &FePresent::set_gpu_pinch )
 		.Prop(_SC("time"), &FePresent::get_layout_ms )
 	);
 
@@ -925,6 +1004,16 @@ bool FeVM::on_new_layout()
 		.Func( _SC("name_at"), &FeImageLoader::cache_get_name_at )
 		.Func( _SC("size_at"), &FeImageLoader::cache_get_size_at )
 		.Prop( _SC("bg_load"), &FeImageLoader::get_background_loading, &FeImageLoader::set_background_loading )
+		.Prop( _SC("atlas"), &FeImageLoader::get_atlas_mode, &FeImageLoader::set_atlas_mode )
+	);
+
+	fe.Bind( _SC("FrameStats"), Class <FeFramePacer, NoConstructor>()
+		.Prop( _SC("frames"), &FeFramePacer::get_frame_count )
+		.Prop( _SC("average_ms"), &FeFramePacer::get_average_ms )
+		.Prop( _SC("bucket_count"), &FeFramePacer::get_bucket_count )
+		.Func( _SC("bucket_limit"), &FeFramePacer::get_bucket_limit )
+		.Func( _SC("bucket_frames"), &FeFramePacer::get_bucket_frames )
+		.Func( _SC("reset"), &FeFramePacer::reset )
 	);
 
 	//
@@ -950,8 +1039,12 @@ bool FeVM::on_new_layout()
 	fe.Overload<FeShader* (*)(int)>(_SC("add_shader"), &FeVM::cb_add_shader);
 	fe.Overload<void (*)(const char *)>(_SC("add_ticks_callback"), &FeVM::cb_add_ticks_callback);
 	fe.Overload<void (*)(Object, const char *)>(_SC("add_ticks_callback"), &FeVM::cb_add_ticks_callback);
+	fe.Overload<void (*)(const char *, int, int)>(_SC("set_ticks_budget"), &FeVM::cb_set_ticks_budget);
+	fe.Overload<void (*)(Object, const char *, int, int)>(_SC("set_ticks_budget"), &FeVM::cb_set_ticks_budget);
+	fe.Func<Sqrat::Array (*)()>(_SC("get_ticks_stats"), &FeVM::cb_get_ticks_stats);
 	fe.Overload<void (*)(const char *)>(_SC("add_transition_callback"), &FeVM::cb_add_transition_callback);
 	fe.Overload<void (*)(Object, const char *)>(_SC("add_transition_callback"), &FeVM::cb_add_transition_callback);
+	fe.Overload<void (*)(Object, const char *, bool)>(_SC("add_transition_callback"), &FeVM::cb_add_transition_callback);
 	fe.Overload<void (*)(const char *)>(_SC("add_signal_handler"), &FeVM::cb_add_signal_handler);
 	fe.Overload<void (*)(Object, const char *)>(_SC("add_signal_handler"), &FeVM::cb_add_signal_handler);
 	fe.Overload<void (*)(const char *)>(_SC("remove_signal_handler"), &FeVM::cb_remove_signal_handler);
@@ -1029,6 +1122,7 @@ bool FeVM::on_new_layout()
 
 	FeImageLoader &il = FeImageLoader::get_ref();
 	fe.SetInstance( _SC("image_cache"), &il );
+	fe.SetInstance( _SC("frame_stats"), &FeFramePacer::get_ref() );
 	fe.SetValue( _SC("plugin"), Table() ); // an empty table for plugins to use/abuse
 
 	// We keep a "non-volatile" table for use by layouts/plugins, the
@@ -1179,6 +1273,13 @@ bool FeVM::on_tick()
 	using namespace Sqrat;
 	m_redraw_triggered = process_console_input();
 
+	if ( !m_active_trans.empty() )
+	{
+		FeProfileScope ps( "transitions" );
+		run_active_transitions();
+		m_redraw_triggered = true;
+	}
+
 	for ( std::vector<FeCallback>::iterator itr = m_ticks.begin();
 		itr != m_ticks.end(); )
 	{
@@ -1186,10 +1287,18 @@ bool FeVM::on_tick()
 		//
 		ASSERT( DefaultVM::Get() );
 
+		if ( (*itr).skip_call() )
+		{
+			++itr;
+			continue;
+		}
+
 		set_for_callback( *itr );
 		bool remove=false;
+		sf::Clock call_timer;
 		try
 		{
+			FeProfileScope ps( (*itr).m_fn.c_str() );
 			Function &func = (*itr).get_fn();
 			if ( !func.IsNull() )
 				func.Execute( m_layoutTimer.getElapsedTime().asMilliseconds() );
@@ -1208,78 +1317,186 @@ bool FeVM::on_tick()
 		if ( remove )
 			itr = m_ticks.erase( itr );
 		else
+		{
+			(*itr).add_call_time( call_timer.getElapsedTime() );
 			++itr;
+		}
 	}
 
 	return m_redraw_triggered;
 }
 
+namespace
+{
+	//
+	// Transitions that callbacks registered to overlap can carry on with
+	// from the main loop.  The frontend always waits for the rest (the
+	// layout is about to be unloaded, a game is about to be launched, the
+	// overlay is being shown etc).
+	//
+	bool can_overlap_transition( FeTransitionType t )
+	{
+		switch ( t )
+		{
+		case StartLayout:
+		case ToNewSelection:
+		case FromOldSelection:
+		case FromGame:
+		case ToNewList:
+		case EndNavigation:
+			return true;
+
+		default:
+			return false;
+		}
+	}
+};
+
+FeVM::FeTransitionState::FeTransitionState( int c, FeTransitionType t, int v, const sf::Time &s )
+	: cb( c ),
+	type( t ),
+	var( v ),
+	start( s )
+{
+}
+
+void FeVM::run_transition_pass( std::vector<FeTransitionState> &worklist )
+{
+	using namespace Sqrat;
+
+	// Assumption: Transition list is empty if no vm is active
+	//
+	ASSERT( worklist.empty() || DefaultVM::Get() );
+
+	sf::Time now = m_trans_clock.getElapsedTime();
+	int generation = m_trans_generation;
+
+	//
+	// Call each remaining transition callback once.  A callback stays in
+	// the worklist for as long as it keeps returning true.
+	//
+	for ( std::vector<FeTransitionState>::iterator itr=worklist.begin();
+		itr != worklist.end(); )
+	{
+		FeCallback &cb = m_trans[ (*itr).cb ];
+
+		set_for_callback( cb );
+		bool keep=false;
+		try
+		{
+			FeProfileScope ps( cb.m_fn.c_str() );
+			Function &func = cb.get_fn();
+			if ( !func.IsNull() )
+			{
+				keep = func.Evaluate<bool>(
+					(int)(*itr).type,
+					(*itr).var,
+					( now - (*itr).start ).asMilliseconds() );
+			}
+		}
+		catch( const Exception &e )
+		{
+			FeLog() << "Script Error in transition function: " << cb.m_fn
+					<< " - " << e.Message() << std::endl;
+		}
+
+		// the callbacks get cleared if a callback caused the layout to reload
+		if ( m_trans_generation != generation )
+		{
+			worklist.clear();
+			return;
+		}
+
+		if ( !keep )
+			itr = worklist.erase( itr );
+		else
+			++itr;
+	}
+}
+
+void FeVM::run_active_transitions()
+{
+	//
+	// Work on a copy, since the callbacks can start other transitions
+	//
+	std::vector<FeTransitionState> worklist;
+	worklist.swap( m_active_trans );
+
+	run_transition_pass( worklist );
+
+	m_active_trans.insert( m_active_trans.begin(), worklist.begin(), worklist.end() );
+}
+
+void FeVM::transition_frame()
+{
+	video_tick();
+
+	{
+		FeProfileScope ps( "redraw_surfaces" );
+		redraw_surfaces();
+	}
+
+	{
+		FeProfileScope ps( "draw" );
+		m_window.clear();
+		m_window.draw( *this );
+
+		if ( FeProfiler::get_ref().is_enabled() )
+			m_window.draw( FeProfiler::get_ref().get_overlay() );
+	}
+
+	{
+		FeProfileScope ps( "display" );
+		m_window.display();
+	}
+
+	FeFramePacer::get_ref().frame_displayed();
+	FeProfiler::get_ref().end_frame();
+}
+
 void FeVM::on_transition(
 	FeTransitionType t,
 	int var )
 {
-	using namespace Sqrat;
-
 	FeDebug() << "[Transition] type=" << transitionTypeStrings[t] << ", var=" << var << std::endl;
 
-	sf::Clock ttimer;
+	FeProfileScope ps( transitionTypeStrings[t] );
+
+	sf::Time start = m_trans_clock.getElapsedTime();
 
-	std::vector<FeCallback *> worklist( m_trans.size() );
+	std::vector<FeTransitionState> worklist;
 	for ( unsigned int i=0; i < m_trans.size(); i++ )
-		worklist[i] = &(m_trans[i]);
+		worklist.push_back( FeTransitionState( i, t, var, start ) );
+
+	run_transition_pass( worklist );
 
 	//
-	// A registered transition callback stays in the worklist for as long
-	// as it keeps returning true.
+	// Callbacks registered to overlap carry on from the main loop (see
+	// on_tick()), one pass per frame.  The frontend waits for the others
+	// to finish, one transition at a time.
 	//
-	while ( !worklist.empty() )
+	if ( can_overlap_transition( t ) )
 	{
-		// Assumption: Transition list is empty if no vm is active
-		//
-		ASSERT( DefaultVM::Get() );
-
-		//
-		// Call each remaining transition callback on each pass through
-		// the worklist
-		//
-		for ( std::vector<FeCallback *>::iterator itr=worklist.begin();
+		for ( std::vector<FeTransitionState>::iterator itr=worklist.begin();
 			itr != worklist.end(); )
 		{
-			set_for_callback( *(*itr) );
-			bool keep=false;
-			try
-			{
-				Function &func = (*itr)->get_fn();
-				if ( !func.IsNull() )
-				{
-					keep = func.Evaluate<bool>(
-						(int)t,
-						var,
-						ttimer.getElapsedTime().asMilliseconds() );
-				}
-			}
-			catch( const Exception &e )
+			if ( m_trans[ (*itr).cb ].m_overlap )
 			{
-				FeLog() << "Script Error in transition function: " << (*itr)->m_fn
-						<< " - " << e.Message() << std::endl;
-			}
-
-			if ( !keep )
+				m_active_trans.push_back( *itr );
 				itr = worklist.erase( itr );
+			}
 			else
 				++itr;
 		}
+	}
 
+	while ( !worklist.empty() )
+	{
 		// redraw now if we are doing another pass...
 		//
-		if (( !worklist.empty() ) && ( m_window.isOpen() ))
+		if ( m_window.isOpen() )
 		{
-			video_tick();
-
-			redraw_surfaces();
-			m_window.clear();
-			m_window.draw( *this );
-			m_window.display();
+			transition_frame();
 
 #ifdef SFML_SYSTEM_LINUX
 			//
@@ -1298,6 +1515,9 @@ void FeVM::on_transition(
 			}
 #endif
 		}
+
+		run_active_transitions();
+		run_transition_pass( worklist );
 	}
 }
 
@@ -2161,12 +2381,59 @@ void FeVM::cb_add_ticks_callback( const char *n )
 	cb_add_ticks_callback( rt, n );
 }
 
-void FeVM::cb_add_transition_callback( Sqrat::Object obj, const char *slot )
+void FeVM::cb_set_ticks_budget( Sqrat::Object obj, const char *slot,
+		int budget_ms, int frames )
+{
+	HSQUIRRELVM vm = Sqrat::DefaultVM::Get();
+	FeVM *fev = (FeVM *)sq_getforeignptr( vm );
+
+	fev->set_ticks_budget( obj, slot, budget_ms, frames );
+}
+
+void FeVM::cb_set_ticks_budget( const char *n, int budget_ms, int frames )
+{
+	Sqrat::RootTable rt;
+	cb_set_ticks_budget( rt, n, budget_ms, frames );
+}
+
+Sqrat::Array FeVM::cb_get_ticks_stats()
+{
+	HSQUIRRELVM vm = Sqrat::DefaultVM::Get();
+	FeVM *fev = (FeVM *)sq_getforeignptr( vm );
+
+	//
+	// One entry per callback, since callbacks registered by different
+	// layouts/plugins (or environments) can share a function name
+	//
+	Sqrat::Array retval( vm );
+	for ( std::vector<FeCallback>::iterator itr = fev->m_ticks.begin();
+			itr != fev->m_ticks.end(); ++itr )
+	{
+		Sqrat::Table t;
+		t.SetValue( _SC("fn"), (*itr).m_fn );
+		t.SetValue( _SC("env"), (*itr).m_env );
+		t.SetValue( _SC("calls"), (*itr).m_calls );
+		t.SetValue( _SC("skipped"), (*itr).m_skipped );
+		t.SetValue( _SC("average_ms"), (*itr).get_average_ms() );
+		t.SetValue( _SC("max_ms"), (*itr).m_max_us / 1000.f );
+
+		retval.Append( t );
+	}
+
+	return retval;
+}
+
+void FeVM::cb_add_transition_callback( Sqrat::Object obj, const char *slot, bool overlap )
 {
 	HSQUIRRELVM vm = Sqrat::DefaultVM::Get();
 	FeVM *fev = (FeVM *)sq_getforeignptr( vm );
 
-	fev->add_transition_callback( obj, slot );
+	fev->add_transition_callback( obj, slot, overlap );
+}
+
+void FeVM::cb_add_transition_callback( Sqrat::Object obj, const char *slot )
+{
+	cb_add_transition_callback( obj, slot, false );
 }
 
 void FeVM::cb_add_transition_callback( const char *n )
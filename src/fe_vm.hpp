@@ -57,6 +57,19 @@ public:
 		FeSettings &fes );
 	Sqrat::Function &get_fn();
 
+	// Returns true if this call should be skipped because the callback
+	// went over its time budget (ticks callbacks only)
+	bool skip_call();
+
+	// record the time taken by a call to the callback
+	void add_call_time( const sf::Time &t );
+
+	// throttle the callback to run every "frames" ticks when a call takes
+	// longer than budget_ms.  budget_ms <= 0 turns throttling off
+	void set_budget( int budget_ms, int frames );
+
+	float get_average_ms() const;
+
 	int m_sid;		// -1 for layout, otherwise the plugin index
 	Sqrat::Object m_env;	// callback function environment
 	std::string m_fn;	// callback function name
@@ -65,8 +78,22 @@ public:
 	std::string m_file;
 	const FeScriptConfigurable *m_cfg;
 
+	// transition callbacks only: true if the callback can be run from the
+	// main loop, overlapping other transitions
+	bool m_overlap;
+
+	// timing stats
+	sf::Int64 m_total_us;
+	sf::Int64 m_max_us;
+	int m_calls;
+	int m_skipped;
+
 private:
 	Sqrat::Function m_cached_fn;
+
+	sf::Int64 m_budget_us;
+	int m_budget_frames;
+	int m_skip;
 };
 
 class FeVM : public FePresent
@@ -95,16 +122,38 @@ private:
 	std::queue< FeInputMap::Command > m_posted_commands;
 	std::vector< FeCallback > m_ticks;
 	std::vector< FeCallback > m_trans;
+
+	//
+	// A transition callback that has asked to be called again
+	//
+	struct FeTransitionState
+	{
+		FeTransitionState( int, FeTransitionType, int, const sf::Time & );
+
+		int cb; // index in m_trans
+		FeTransitionType type;
+		int var;
+		sf::Time start;
+	};
+
+	// transitions being run from the main loop
+	std::vector< FeTransitionState > m_active_trans;
+	sf::Clock m_trans_clock;
+	int m_trans_generation; // incremented each time m_trans is cleared
 	std::vector< FeCallback > m_sig_handlers;
 
 	FeVM( const FeVM & );
 	FeVM &operator=( const FeVM & );
 
 	void add_ticks_callback( Sqrat::Object, const char * );
-	void add_transition_callback( Sqrat::Object, const char * );
+	void set_ticks_budget( Sqrat::Object, const char *, int, int );
+	void add_transition_callback( Sqrat::Object, const char *, bool overlap=false );
 	void add_signal_handler( Sqrat::Object, const char * );
 	void remove_signal_handler( Sqrat::Object, const char * );
 	void set_for_callback( const FeCallback & );
+	void run_transition_pass( std::vector<FeTransitionState> & );
+	void run_active_transitions();
+	void transition_frame();
 	bool process_console_input();
 
 	static bool internal_do_nut(const std::string &, const std::string &);
@@ -132,6 +181,7 @@ public:
 	void vm_init();
 	bool on_new_layout();
 	bool on_tick();
+	bool has_tick_callbacks() { return !m_ticks.empty() || !m_active_trans.empty(); };
 	void on_transition( FeTransitionType, int var );
 	void init_with_default_layout();
 	int get_script_id() { return m_script_id; };
@@ -195,6 +245,10 @@ public:
 	static FeShader *cb_add_shader(int);
 	static void cb_add_ticks_callback( Sqrat::Object, const char *);
 	static void cb_add_ticks_callback(const char *);
+	static void cb_set_ticks_budget( Sqrat::Object, const char *, int, int );
+	static void cb_set_ticks_budget( const char *, int, int );
+	static Sqrat::Array cb_get_ticks_stats();
+	static void cb_add_transition_callback( Sqrat::Object, const char *, bool );
 	static void cb_add_transition_callback( Sqrat::Object, const char *);
 	static void cb_add_transition_callback(const char *);
 	static void cb_add_signal_handler( Sqrat::Object, const char *);
@@ -39,6 +39,7 @@
 #endif // SFM_SYSTEM_MACOS
 
 #include <iostream>
+#include <algorithm>
 #include "nowide/fstream.hpp"
 
 #include <SFML/System/Sleep.hpp>
@@ -117,6 +118,29 @@ bool is_multimon_config( FeSettings &fes )
 
 const char *FeWindowPosition::FILENAME = "window.am";
 
+namespace
+{
+	//
+	// Input gets polled at least this often
+	//
+	const int INPUT_POLL_MS = 15;
+
+	//
+	// Once there has been nothing to do for this many polls in a row (about
+	// a second), the polling interval is stretched a little more on each
+	// poll, up to IDLE_POLL_MAX_MS, until the next input or redraw
+	//
+	const int IDLE_BACKOFF_POLLS = 60;
+	const int IDLE_POLL_MAX_MS = 100;
+
+	//
+	// Frame time histogram bucket upper limits (in ms).  The final bucket
+	// catches everything else
+	//
+	const int FRAME_BUCKETS[] = { 8, 12, 17, 20, 25, 34, 50, 100 };
+	const int FRAME_BUCKET_COUNT = sizeof( FRAME_BUCKETS ) / sizeof( int );
+};
+
 FeWindow::FeWindow( FeSettings &fes )
 	: m_window( NULL ),
 	m_fes( fes ),
@@ -745,3 +769,126 @@ bool FeWindow::pollEvent( sf::Event &e )
 
 	return false;
 }
+
+FeFramePacer::FeFramePacer()
+	: m_idle( true ),
+	m_idle_polls( 0 ),
+	m_total_us( 0 ),
+	m_frames( 0 ),
+	m_buckets( FRAME_BUCKET_COUNT + 1, 0 )
+{
+}
+
+FeFramePacer &FeFramePacer::get_ref()
+{
+	static FeFramePacer pacer;
+	return pacer;
+}
+
+void FeFramePacer::frame_displayed()
+{
+	sf::Time now = m_clock.getElapsedTime();
+
+	//
+	// Don't count the time spent idle with nothing to draw
+	//
+	if ( !m_idle )
+	{
+		sf::Int64 us = ( now - m_last_frame ).asMicroseconds();
+		int ms = us / 1000;
+
+		int i=0;
+		while (( i < FRAME_BUCKET_COUNT ) && ( ms >= FRAME_BUCKETS[i] ))
+			i++;
+
+		m_buckets[i]++;
+		m_total_us += us;
+		m_frames++;
+	}
+
+	m_last_frame = now;
+	m_idle = false;
+	m_idle_polls = 0;
+}
+
+void FeFramePacer::input_received()
+{
+	m_idle_polls = 0;
+}
+
+void FeFramePacer::wait( bool due, const sf::Time &due_in )
+{
+	sf::Time t = sf::milliseconds( INPUT_POLL_MS );
+
+	if ( due )
+	{
+		m_idle_polls = 0;
+		if ( due_in < t )
+			t = due_in;
+	}
+	else
+	{
+		m_idle = true;
+		if ( m_idle_polls < IDLE_BACKOFF_POLLS + IDLE_POLL_MAX_MS )
+			m_idle_polls++;
+
+		if ( m_idle_polls > IDLE_BACKOFF_POLLS )
+			t = sf::milliseconds( std::min( IDLE_POLL_MAX_MS,
+				INPUT_POLL_MS * ( 1 + m_idle_polls - IDLE_BACKOFF_POLLS )));
+	}
+
+	if ( t > sf::Time::Zero )
+		sf::sleep( t );
+}
+
+float FeFramePacer::get_average_ms() const
+{
+	if ( m_frames < 1 )
+		return 0.f;
+
+	return m_total_us / 1000.f / m_frames;
+}
+
+int FeFramePacer::get_bucket_count() const
+{
+	return FRAME_BUCKET_COUNT + 1;
+}
+
+int FeFramePacer::get_bucket_limit( int i ) const
+{
+	if (( i < 0 ) || ( i >= FRAME_BUCKET_COUNT ))
+		return -1;
+
+	return FRAME_BUCKETS[i];
+}
+
+int FeFramePacer::get_bucket_frames( int i ) const
+{
+	if (( i < 0 ) || ( i > FRAME_BUCKET_COUNT ))
+		return 0;
+
+	return m_buckets[i];
+}
+
+void FeFramePacer::reset()
+{
+	m_total_us = 0;
+	m_frames = 0;
+	m_idle = true;
+	std::fill( m_buckets.begin(), m_buckets.end(), 0 );
+}
+
+void FeFramePacer::log_stats() const
+{
+	if ( m_frames < 1 )
+		return;
+
+	FeDebug() << "Frame times: " << m_frames << " frames, average "
+		<< get_average_ms() << "ms" << std::endl;
+
+	for ( int i=0; i<FRAME_BUCKET_COUNT; i++ )
+		FeDebug() << " - <" << FRAME_BUCKETS[i] << "ms: " << m_buckets[i] << std::endl;
+
+	FeDebug() << " - >=" << FRAME_BUCKETS[FRAME_BUCKET_COUNT-1] << "ms: "
+		<< m_buckets[FRAME_BUCKET_COUNT] << std::endl;
+}
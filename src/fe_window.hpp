@@ -24,6 +24,8 @@
 #define FE_WINDOW_HPP
 
 #include <SFML/Graphics/RenderWindow.hpp>
+#include <SFML/System/Clock.hpp>
+#include <vector>
 
 class FeSettings;
 
@@ -67,4 +69,49 @@ public:
 	sf::RenderWindow &get_win();
 };
 
+//
+// Paces the main loop: sleeps until the next thing is due (video frame,
+// script tick etc) instead of a fixed amount, and keeps a histogram of the
+// time between displayed frames
+//
+class FeFramePacer
+{
+private:
+	sf::Clock m_clock;
+	sf::Time m_last_frame;
+	bool m_idle;
+	int m_idle_polls; // polls in a row with nothing due
+	sf::Int64 m_total_us;
+	int m_frames;
+	std::vector<int> m_buckets;
+
+	FeFramePacer();
+	FeFramePacer( const FeFramePacer & );
+	FeFramePacer &operator=( const FeFramePacer & );
+
+public:
+	static FeFramePacer &get_ref();
+
+	// call after each frame is displayed
+	void frame_displayed();
+
+	// call when no frame was displayed.  Sleeps until due_in (if due is true),
+	// but never longer than the input polling interval.  The polling interval
+	// backs off when there has been nothing to do for a while
+	void wait( bool due, const sf::Time &due_in );
+
+	// call on input, so that polling goes back to full speed
+	void input_received();
+
+	int get_frame_count() const { return m_frames; };
+	float get_average_ms() const;
+
+	int get_bucket_count() const;
+	int get_bucket_limit( int i ) const; // upper limit (in ms) of bucket i, -1 for the last
+	int get_bucket_frames( int i ) const;
+
+	void reset();
+	void log_stats() const;
+};
+
 #endif
@@ -21,9 +21,12 @@
  */
 
 #include <SFML/System/InputStream.hpp>
+#include <SFML/Graphics/Texture.hpp>
 
+#include <algorithm>
 #include <list>
 #include <map>
+#include <vector>
 #include <queue>
 #include <string>
 #include <mutex>
@@ -79,6 +82,306 @@ namespace
 #endif
 }
 
+namespace
+{
+	//
+	// Atlas settings.  Images bigger than ATLAS_MAX_IMAGE in either
+	// direction get their own texture.  Each image is surrounded by
+	// ATLAS_PADDING pixels copied from its edge so that smoothing doesn't
+	// pull in pixels from its neighbours
+	//
+	const int ATLAS_MAX_IMAGE=256;
+	const int ATLAS_PAGE_SIZE=2048;
+	const int ATLAS_MAX_PAGES=4;
+	const int ATLAS_PADDING=1;
+};
+
+class FeAtlasPage
+{
+public:
+	FeAtlasPage( bool smooth )
+		: m_smooth( smooth )
+	{
+		reset();
+	}
+
+	// Pack a w x h slot using shelves: slots are placed left to right, and a
+	// new shelf is started underneath when the current one is full
+	bool allocate( int w, int h, sf::IntRect &slot )
+	{
+		int size = (int)m_texture.getSize().x;
+
+		if ( m_shelf_x + w > size )
+		{
+			m_shelf_y += m_shelf_h;
+			m_shelf_x = 0;
+			m_shelf_h = 0;
+		}
+
+		if (( m_shelf_x + w > size ) || ( m_shelf_y + h > size ))
+			return false;
+
+		slot = sf::IntRect( m_shelf_x, m_shelf_y, w, h );
+		m_shelf_x += w;
+		m_shelf_h = std::max( m_shelf_h, h );
+		return true;
+	}
+
+	void reset()
+	{
+		m_shelf_x = m_shelf_y = m_shelf_h = 0;
+		m_used = 0;
+		m_free_slots.clear();
+	}
+
+	sf::Texture m_texture;
+	bool m_smooth;
+	int m_shelf_x;
+	int m_shelf_y;
+	int m_shelf_h;
+	int m_used; // number of regions on this page
+
+	// slots freed by evicted regions, available for reuse
+	std::vector< sf::IntRect > m_free_slots;
+};
+
+class FeTextureAtlas
+{
+public:
+	typedef std::pair< std::string, bool > region_key_t;
+	typedef std::map< region_key_t, FeAtlasRegion * >::iterator map_iterator_t;
+
+	FeTextureAtlas()
+		: m_page_size( std::min( (int)sf::Texture::getMaximumSize(), ATLAS_PAGE_SIZE ) )
+	{
+	}
+
+	~FeTextureAtlas()
+	{
+		for ( map_iterator_t itr = m_regions.begin(); itr != m_regions.end(); ++itr )
+			delete itr->second;
+
+		for ( std::vector< FeAtlasPage * >::iterator itr = m_pages.begin();
+				itr != m_pages.end(); ++itr )
+			delete (*itr);
+	}
+
+	FeAtlasRegion *get( const std::string &key, bool smooth )
+	{
+		map_iterator_t itr = m_regions.find( region_key_t( key, smooth ) );
+		if ( itr == m_regions.end() )
+			return NULL;
+
+		FeAtlasRegion *r = itr->second;
+		if ( r->m_ref_count == 0 )
+			m_unused.remove( r );
+
+		r->m_ref_count++;
+		return r;
+	}
+
+	FeAtlasRegion *add( const std::string &key, bool smooth,
+		int w, int h, const unsigned char *data )
+	{
+		if ( !data || ( w <= 0 ) || ( h <= 0 )
+				|| ( w > ATLAS_MAX_IMAGE ) || ( h > ATLAS_MAX_IMAGE ) )
+			return NULL;
+
+		FeAtlasRegion *r = get( key, smooth );
+		if ( r )
+			return r;
+
+		int pw = w + 2 * ATLAS_PADDING;
+		int ph = h + 2 * ATLAS_PADDING;
+
+		FeAtlasPage *page( NULL );
+		sf::IntRect slot;
+
+		// make room by evicting the least recently used regions that
+		// nothing is displaying
+		while ( !allocate( smooth, pw, ph, page, slot ) )
+		{
+			if ( m_unused.empty() )
+				return NULL;
+
+			free_region( m_unused.back() );
+		}
+
+		std::vector< unsigned char > buff( pw * ph * 4 );
+		for ( int y=0; y<ph; y++ )
+		{
+			int sy = std::min( std::max( y - ATLAS_PADDING, 0 ), h - 1 );
+			for ( int x=0; x<pw; x++ )
+			{
+				int sx = std::min( std::max( x - ATLAS_PADDING, 0 ), w - 1 );
+				std::copy( data + ( sy * w + sx ) * 4, data + ( sy * w + sx + 1 ) * 4,
+					buff.begin() + ( y * pw + x ) * 4 );
+			}
+		}
+
+		page->m_texture.update( &buff[0], pw, ph, slot.left, slot.top );
+		page->m_used++;
+
+		r = new FeAtlasRegion( key, smooth );
+		r->m_page = page;
+		r->m_slot = slot;
+		r->m_rect = sf::IntRect( slot.left + ATLAS_PADDING,
+			slot.top + ATLAS_PADDING, w, h );
+		r->m_ref_count = 1;
+
+		m_regions[ region_key_t( key, smooth ) ] = r;
+		return r;
+	}
+
+	void release( FeAtlasRegion *r )
+	{
+		r->m_ref_count--;
+		if ( r->m_ref_count <= 0 )
+		{
+			r->m_ref_count = 0;
+			m_unused.push_front( r );
+		}
+	}
+
+	// Drop the regions for key that aren't in use.  Called when the image
+	// is pruned from the image cache
+	void evict( const std::string &key )
+	{
+		for ( int i=0; i<2; i++ )
+		{
+			map_iterator_t itr = m_regions.find( region_key_t( key, i != 0 ) );
+			if (( itr != m_regions.end() ) && ( itr->second->m_ref_count == 0 ))
+				free_region( itr->second );
+		}
+	}
+
+	void trim()
+	{
+		while ( !m_unused.empty() )
+			free_region( m_unused.back() );
+
+		std::vector< FeAtlasPage * >::iterator itr = m_pages.begin();
+		while ( itr != m_pages.end() )
+		{
+			if ( (*itr)->m_used == 0 )
+			{
+				delete (*itr);
+				itr = m_pages.erase( itr );
+			}
+			else
+				++itr;
+		}
+	}
+
+	bool empty() { return m_pages.empty(); };
+	size_t get_page_count() { return m_pages.size(); };
+	size_t get_region_count() { return m_regions.size(); };
+
+private:
+	bool allocate( bool smooth, int w, int h, FeAtlasPage *&page, sf::IntRect &slot )
+	{
+		std::vector< FeAtlasPage * >::iterator itr;
+
+		//
+		// Reuse the smallest freed slot that fits first
+		//
+		std::vector< sf::IntRect >::iterator best_slot;
+		FeAtlasPage *best_page( NULL );
+
+		for ( itr = m_pages.begin(); itr != m_pages.end(); ++itr )
+		{
+			if ( (*itr)->m_smooth != smooth )
+				continue;
+
+			std::vector< sf::IntRect > &fs = (*itr)->m_free_slots;
+			for ( std::vector< sf::IntRect >::iterator its = fs.begin(); its != fs.end(); ++its )
+			{
+				if (( (*its).width >= w ) && ( (*its).height >= h )
+						&& ( !best_page || ( (*its).width * (*its).height
+							< (*best_slot).width * (*best_slot).height )))
+				{
+					best_page = *itr;
+					best_slot = its;
+				}
+			}
+		}
+
+		if ( best_page )
+		{
+			page = best_page;
+			slot = *best_slot;
+			best_page->m_free_slots.erase( best_slot );
+			return true;
+		}
+
+		for ( itr = m_pages.begin(); itr != m_pages.end(); ++itr )
+		{
+			if (( (*itr)->m_smooth == smooth ) && (*itr)->allocate( w, h, slot ))
+			{
+				page = *itr;
+				return true;
+			}
+		}
+
+		//
+		// Pages that have been emptied out can be reused for either
+		// smoothing mode
+		//
+		for ( itr = m_pages.begin(); itr != m_pages.end(); ++itr )
+		{
+			if ( (*itr)->m_used == 0 )
+			{
+				(*itr)->m_smooth = smooth;
+				(*itr)->m_texture.setSmooth( smooth );
+				page = *itr;
+				return page->allocate( w, h, slot );
+			}
+		}
+
+		if ( (int)m_pages.size() >= ATLAS_MAX_PAGES )
+			return false;
+
+		page = new FeAtlasPage( smooth );
+		if ( !page->m_texture.create( m_page_size, m_page_size ) )
+		{
+			FeLog() << "Error creating texture atlas page" << std::endl;
+			delete page;
+			return false;
+		}
+
+		page->m_texture.setSmooth( smooth );
+		m_pages.push_back( page );
+
+		FeDebug() << "Added texture atlas page (" << m_page_size << "x" << m_page_size
+			<< ", smooth=" << smooth << ")" << std::endl;
+
+		return page->allocate( w, h, slot );
+	}
+
+	void free_region( FeAtlasRegion *r )
+	{
+		if ( r->m_ref_count == 0 )
+			m_unused.remove( r );
+
+		m_regions.erase( region_key_t( r->m_key, r->m_smooth ) );
+
+		FeAtlasPage *page = r->m_page;
+		page->m_used--;
+
+		if ( page->m_used <= 0 )
+			page->reset();
+		else
+			page->m_free_slots.push_back( r->m_slot );
+
+		delete r;
+	}
+
+	std::vector< FeAtlasPage * > m_pages;
+	std::map< region_key_t, FeAtlasRegion * > m_regions;
+	std::list< FeAtlasRegion * > m_unused; // unreferenced regions, most recently used first
+	int m_page_size;
+};
+
 class FeImageLRUCache
 {
 public:
@@ -86,9 +389,10 @@ public:
 	typedef std::list<kvp_t>::iterator list_iterator_t;
 	typedef std::map< std::string, list_iterator_t >::iterator map_iterator_t;
 
-	FeImageLRUCache( size_t max_bytes )
+	FeImageLRUCache( size_t max_bytes, FeTextureAtlas **atlas )
 		: m_max_bytes( max_bytes ),
-		m_current_bytes( 0 )
+		m_current_bytes( 0 ),
+		m_atlas( atlas )
 	{
 	}
 
@@ -183,6 +487,11 @@ private:
 					delete last->second;
 			}
 
+			// the image isn't cached anymore, so don't hold it in the atlas
+			// either unless it is being displayed
+			if ( *m_atlas )
+				(*m_atlas)->evict( last->first );
+
 			m_items_map.erase( last->first );
 			m_items.pop_back();
 		}
@@ -192,6 +501,7 @@ private:
 	std::map< std::string, list_iterator_t > m_items_map;
 	size_t m_max_bytes;
 	size_t m_current_bytes;
+	FeTextureAtlas **m_atlas;
 };
 
 
@@ -221,6 +531,15 @@ public:
 			m_in.pop();
 		}
 #ifndef NO_MOVIE
+		while ( !m_open.empty() )
+		{
+			std::lock_guard<std::recursive_mutex> l( g_mutex );
+			if ( --(m_open.front()->m_ref_count) <= 0 )
+				delete m_open.front();
+
+			m_open.pop();
+		}
+
 		while ( !m_vid.empty() )
 		{
 			delete m_vid.front();
@@ -262,6 +581,13 @@ public:
 			else
 			{
 #ifndef NO_MOVIE
+				FeVideoLoaderEntry *ve = get_next_video();
+				if ( ve )
+				{
+					open_video( ve );
+					continue;
+				}
+
 				FeMedia *vid = get_vid_to_reap();
 				if ( vid )
 					delete vid;
@@ -285,6 +611,13 @@ public:
 		std::lock_guard<std::recursive_mutex> l( g_mutex );
 		m_vid.push( vid );
 	}
+
+	void add_video( FeVideoLoaderEntry *e )
+	{
+		std::lock_guard<std::recursive_mutex> l( g_mutex );
+		e->m_ref_count++; // Add ref while we are opening it
+		m_open.push( e );
+	}
 #endif
 
 private:
@@ -302,6 +635,53 @@ private:
 	}
 
 #ifndef NO_MOVIE
+	FeVideoLoaderEntry *get_next_video()
+	{
+		std::lock_guard<std::recursive_mutex> l( g_mutex );
+		while ( !m_open.empty() )
+		{
+			FeVideoLoaderEntry *retval = m_open.front();
+			m_open.pop();
+
+			//
+			// If we hold the only reference then the caller has already
+			// moved on (the selection changed), so don't bother opening it
+			//
+			if ( retval->m_ref_count <= 1 )
+			{
+				delete retval;
+				continue;
+			}
+
+			return retval;
+		}
+		return NULL;
+	}
+
+	void open_video( FeVideoLoaderEntry *e )
+	{
+		//
+		// Opening reads and probes the file, which is the slow part.  The
+		// display texture gets attached later on the main thread
+		//
+		FeMedia *m = new FeMedia( FeMedia::AudioVideo );
+		if ( !m->open( e->m_archive, e->m_name, NULL ) )
+		{
+			FeLog() << "ERROR loading video: " << e->m_archive
+				<< ( e->m_archive.empty() ? "" : "|" ) << e->m_name << std::endl;
+
+			delete m;
+			m = NULL;
+		}
+
+		std::lock_guard<std::recursive_mutex> l( g_mutex );
+		e->m_media = m;
+		e->m_loaded = true;
+
+		if ( --(e->m_ref_count) <= 0 )
+			delete e;
+	}
+
 	FeMedia *get_vid_to_reap()
 	{
 		std::lock_guard<std::recursive_mutex> l( g_mutex );
@@ -320,6 +700,7 @@ private:
 
 	std::queue< std::pair < std::string, FeImageLoaderEntry * > > m_in;
 #ifndef NO_MOVIE
+	std::queue< FeVideoLoaderEntry * > m_open;
 	std::queue< FeMedia * > m_vid;
 #endif
 };
@@ -329,7 +710,9 @@ class FeImageLoaderImp
 public:
 	FeImageLoaderImp()
 		: m_cache( NULL ),
-		m_load_images_in_bg( false )
+		m_atlas( NULL ),
+		m_load_images_in_bg( false ),
+		m_atlas_mode( false )
 	{
 	};
 
@@ -337,11 +720,16 @@ public:
 	{
 		if ( m_cache )
 			delete m_cache;
+
+		if ( m_atlas )
+			delete m_atlas;
 	}
 
 	FeImageLRUCache *m_cache;
+	FeTextureAtlas *m_atlas;
 	FeImageLoaderThread m_bg_loader;
 	bool m_load_images_in_bg;
+	bool m_atlas_mode;
 };
 
 FeImageLoaderEntry::FeImageLoaderEntry( sf::InputStream *s )
@@ -401,6 +789,54 @@ bool FeImageLoaderEntry::dec_ref()
 	return ( m_ref_count == 0 );
 }
 
+FeAtlasRegion::FeAtlasRegion( const std::string &key, bool smooth )
+	: m_key( key ),
+	m_smooth( smooth ),
+	m_page( NULL ),
+	m_ref_count( 0 )
+{
+}
+
+const sf::Texture &FeAtlasRegion::get_texture() const
+{
+	return m_page->m_texture;
+}
+
+const sf::IntRect &FeAtlasRegion::get_rect() const
+{
+	return m_rect;
+}
+
+bool FeAtlasRegion::is_smooth() const
+{
+	return m_smooth;
+}
+
+#ifndef NO_MOVIE
+FeVideoLoaderEntry::FeVideoLoaderEntry( const std::string &archive, const std::string &name )
+	: m_archive( archive ),
+	m_name( name ),
+	m_media( NULL ),
+	m_ref_count( 0 ),
+	m_loaded( false )
+{
+}
+
+FeVideoLoaderEntry::~FeVideoLoaderEntry()
+{
+	if ( m_media )
+		delete m_media;
+}
+
+FeMedia *FeVideoLoaderEntry::take_media()
+{
+	std::lock_guard<std::recursive_mutex> l( g_mutex );
+	FeMedia *retval = m_media;
+	m_media = NULL;
+	return retval;
+}
+#endif
+
 FeImageLoader::FeImageLoader()
 	: m_imp( NULL )
 {
@@ -521,6 +957,44 @@ void FeImageLoader::reap_video( FeMedia *vid )
 	if ( il.m_imp )
 		il.m_imp->m_bg_loader.reap_video( vid );
 }
+
+FeVideoLoaderEntry *FeImageLoader::load_video( const std::string &arch, const std::string &fn )
+{
+	FeVideoLoaderEntry *e = new FeVideoLoaderEntry( arch, fn );
+
+	// caller's reference
+	e->m_ref_count++;
+
+	m_imp->m_bg_loader.add_video( e );
+	return e;
+}
+
+bool FeImageLoader::check_video_loaded( FeVideoLoaderEntry *e )
+{
+	std::lock_guard<std::recursive_mutex> l( g_mutex );
+	return ( e && e->m_loaded );
+}
+
+void FeImageLoader::release_video_entry( FeVideoLoaderEntry **e )
+{
+	if ( e )
+	{
+		std::lock_guard<std::recursive_mutex> l( g_mutex );
+		if ( *e && ( --((*e)->m_ref_count) <= 0 ))
+		{
+			// hand any video nobody took back to the background thread to close
+			if ( (*e)->m_media )
+			{
+				reap_video( (*e)->m_media );
+				(*e)->m_media = NULL;
+			}
+
+			delete *e;
+		}
+
+		*e = NULL;
+	}
+}
 #endif
 
 FeImageLoader &FeImageLoader::get_ref()
@@ -549,7 +1023,7 @@ void FeImageLoader::set_cache_size( size_t s )
 	}
 
 	if ( !il.m_imp->m_cache )
-		il.m_imp->m_cache = new FeImageLRUCache( s );
+		il.m_imp->m_cache = new FeImageLRUCache( s, &il.m_imp->m_atlas );
 	else
 		il.m_imp->m_cache->resize( s );
 }
@@ -568,6 +1042,66 @@ bool FeImageLoader::get_background_loading()
 	return il.m_imp->m_load_images_in_bg;
 }
 
+void FeImageLoader::set_atlas_mode( bool flag )
+{
+	m_imp->m_atlas_mode = flag;
+
+	FeDebug() << "Set texture atlas mode: " << flag << std::endl;
+}
+
+bool FeImageLoader::get_atlas_mode()
+{
+	return m_imp->m_atlas_mode;
+}
+
+FeAtlasRegion *FeImageLoader::get_atlas_region( const std::string &key, bool smooth )
+{
+	if ( !m_imp->m_atlas_mode || !m_imp->m_atlas )
+		return NULL;
+
+	return m_imp->m_atlas->get( key, smooth );
+}
+
+FeAtlasRegion *FeImageLoader::atlas_image( const std::string &key, int width, int height,
+	const unsigned char *data, bool smooth )
+{
+	if ( !m_imp->m_atlas_mode || !data )
+		return NULL;
+
+	if ( !m_imp->m_atlas )
+		m_imp->m_atlas = new FeTextureAtlas();
+
+	return m_imp->m_atlas->add( key, smooth, width, height, data );
+}
+
+void FeImageLoader::release_atlas_region( FeAtlasRegion **r )
+{
+	if ( r && *r )
+	{
+		if ( m_imp->m_atlas )
+			m_imp->m_atlas->release( *r );
+
+		*r = NULL;
+	}
+}
+
+void FeImageLoader::trim_atlas()
+{
+	if ( !m_imp->m_atlas )
+		return;
+
+	FeDebug() << "Texture atlas: " << m_imp->m_atlas->get_page_count() << " page(s), "
+		<< m_imp->m_atlas->get_region_count() << " image(s)" << std::endl;
+
+	m_imp->m_atlas->trim();
+
+	if ( m_imp->m_atlas->empty() )
+	{
+		delete m_imp->m_atlas;
+		m_imp->m_atlas = NULL;
+	}
+}
+
 //
 //
 void FeImageLoader::cache_image( const char *fn )
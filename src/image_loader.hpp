@@ -25,11 +25,20 @@
 
 #include <SFML/System/InputStream.hpp>
 #include <SFML/System/Vector2.hpp>
+#include <SFML/Graphics/Rect.hpp>
+
+namespace sf
+{
+	class Texture;
+};
 
 class FeImageLoader;
 class FeImageLoaderThread;
 class FeImageLRUCache;
 class FeImageLoaderImp;
+class FeTextureAtlas;
+class FeAtlasPage;
+class FeMedia;
 
 class FeImageLoaderEntry
 {
@@ -64,6 +73,61 @@ private:
    bool dec_ref();
 };
 
+//
+// A small image that has been packed into one of the pages of the image
+// loader's texture atlas
+//
+class FeAtlasRegion
+{
+friend class FeTextureAtlas;
+
+public:
+	const sf::Texture &get_texture() const;
+
+	// The area of get_texture() that holds the image
+	const sf::IntRect &get_rect() const;
+
+	bool is_smooth() const;
+
+private:
+	std::string m_key;
+	bool m_smooth;
+	FeAtlasPage *m_page;
+	sf::IntRect m_slot; // area allocated on the page, includes padding
+	sf::IntRect m_rect;
+	int m_ref_count;
+
+	FeAtlasRegion( const std::string &key, bool smooth );
+	FeAtlasRegion( const FeAtlasRegion & );
+	const FeAtlasRegion &operator=( const FeAtlasRegion & );
+};
+
+#ifndef NO_MOVIE
+class FeVideoLoaderEntry
+{
+friend class FeImageLoader;
+friend class FeImageLoaderThread;
+
+public:
+   ~FeVideoLoaderEntry();
+
+   // Take the opened video (NULL if it couldn't be opened).  The caller
+   // becomes responsible for deleting it
+   FeMedia *take_media();
+
+private:
+   std::string m_archive;
+   std::string m_name;
+   FeMedia *m_media;
+   int m_ref_count;
+   bool m_loaded;
+
+   FeVideoLoaderEntry( const std::string &archive, const std::string &name );
+   FeVideoLoaderEntry( const FeVideoLoaderEntry & );
+   const FeVideoLoaderEntry &operator=( const FeVideoLoaderEntry & );
+};
+#endif
+
 class FeImageLoader
 {
 public:
@@ -90,9 +154,37 @@ public:
 	// set the cache size for the image loader's cache of uncompressed images (in bytes)
 	static void set_cache_size( size_t cache_size );
 
+	//
+	// Texture atlas.  When atlas mode is on, small images are packed into
+	// shared textures so that they can be drawn together in one batch.
+	//
+	// get_atlas_region() returns the region for an image that is already in
+	// the atlas (or NULL), atlas_image() adds the given RGBA pixel data to
+	// the atlas and returns NULL if the image is too big or there is no
+	// room.  Caller must release any region returned by calling
+	// release_atlas_region() when done with it
+	//
+	FeAtlasRegion *get_atlas_region( const std::string &key, bool smooth );
+	FeAtlasRegion *atlas_image( const std::string &key, int width, int height,
+		const unsigned char *data, bool smooth );
+	void release_atlas_region( FeAtlasRegion **r );
+
+	// free atlas regions that aren't being used anymore
+	void trim_atlas();
+
 #ifndef NO_MOVIE
 	// destroy vid (on our background thread which will wait on the video threads to stop)
 	void reap_video( FeMedia *vid );
+
+	// Open a video on our background thread.  Caller becomes responsible for the returned
+	// entry and must release it by calling release_video_entry() when done with it.  Releasing
+	// the entry before the video is opened cancels the open.
+	//
+	// arch is empty if the video isn't in an archive
+	//
+	FeVideoLoaderEntry *load_video( const std::string &arch, const std::string &fn );
+	bool check_video_loaded( FeVideoLoaderEntry *e );
+	void release_video_entry( FeVideoLoaderEntry **e );
 #endif
 
 	//
@@ -108,6 +200,9 @@ public:
 	void set_background_loading( bool flag );
 	bool get_background_loading();
 
+	void set_atlas_mode( bool flag );
+	bool get_atlas_mode();
+
 private:
 	FeImageLoader();
 	FeImageLoader( const FeImageLoader & );
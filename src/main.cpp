@@ -30,6 +30,7 @@
 #include "fe_window.hpp"
 #include "fe_vm.hpp"
 #include "fe_blend.hpp"
+#include "fe_profile.hpp"
 #include <iostream>
 #include <cmath>
 #include <cstdlib>
@@ -246,6 +247,7 @@ int main(int argc, char *argv[])
 				feSettings.on_joystick_connect(); // update joystick mappings
 
 				soundsys.stop();
+				soundsys.clear_sound_cache();
 				soundsys.update_volumes();
 				soundsys.play_ambient();
 
@@ -345,10 +347,14 @@ int main(int argc, char *argv[])
 			redraw=true;
 		}
 
+		FeProfileScope events_scope( "events" );
+
 		sf::Event ev;
 		bool from_ui;
 		while ( feVM.poll_command( c, ev, from_ui ) )
 		{
+			FeFramePacer::get_ref().input_received();
+
 			//
 			// Special case handling based on event type
 			//
@@ -662,6 +668,12 @@ int main(int argc, char *argv[])
 					}
 					break;
 
+				case FeInputMap::ToggleProfiler:
+					FeProfiler::get_ref().toggle( feSettings.get_config_dir(),
+						feVM.get_default_font() );
+					redraw=true;
+					break;
+
 				case FeInputMap::Configure:
 					config_mode = true;
 					break;
@@ -1080,10 +1092,21 @@ int main(int argc, char *argv[])
 			has_focus = window.hasFocus();
 #endif
 
-		if ( feVM.on_tick() )
-			redraw=true;
+		events_scope.end();
+
+		{
+			FeProfileScope ps( "script_tick" );
+			if ( feVM.on_tick() )
+				redraw=true;
+		}
+
+		{
+			FeProfileScope ps( "video_tick" );
+			if ( feVM.video_tick() )
+				redraw=true;
+		}
 
-		if ( feVM.video_tick() )
+		if ( FeProfiler::get_ref().end_frame() )
 			redraw=true;
 
 		if ( feVM.saver_activation_check() )
@@ -1091,16 +1114,35 @@ int main(int argc, char *argv[])
 
 		if ( redraw || !feSettings.get_info_bool( FeSettings::PowerSaving ) )
 		{
-			feVM.redraw_surfaces();
+			{
+				FeProfileScope ps( "redraw_surfaces" );
+				feVM.redraw_surfaces();
+			}
 
 			// begin drawing
-			window.clear();
-			window.draw( feVM );
-			window.display();
+			{
+				FeProfileScope ps( "draw" );
+				window.clear();
+				window.draw( feVM );
+
+				if ( FeProfiler::get_ref().is_enabled() )
+					window.draw( FeProfiler::get_ref().get_overlay() );
+			}
+
+			{
+				FeProfileScope ps( "display" );
+				window.display();
+			}
+			FeFramePacer::get_ref().frame_displayed();
 			redraw=false;
 		}
 		else
-			sf::sleep( sf::milliseconds( 15 ) );
+		{
+			// sleep until the next video frame/script tick is due
+			sf::Time due_in;
+			bool due = feVM.get_next_tick_due( due_in );
+			FeFramePacer::get_ref().wait( due, due_in );
+		}
 
 		soundsys.tick();
 	}
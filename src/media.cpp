@@ -24,6 +24,8 @@
 #include "zip.hpp"
 #include "fe_base.hpp"
 #include "fe_file.hpp"
+#include "fe_util.hpp"
+#include "fe_blend.hpp"
 #include <SFML/Graphics.hpp>
 
 extern "C"
@@ -43,16 +45,22 @@ extern "C"
 #endif
 }
 
-#include <queue>
+#include <vector>
+#include <list>
+#include <algorithm>
 #include <iostream>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include <atomic>
 
 #if (LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT( 59, 0, 100 ))
 typedef const AVCodec FeAVCodec;
+typedef const AVInputFormat FeAVInputFormat;
 #else
 typedef AVCodec FeAVCodec;
+typedef AVInputFormat FeAVInputFormat;
 #endif
 
 #if (LIBAVFORMAT_VERSION_INT >= AV_VERSION_INT( 58, 7, 100 ))
@@ -67,6 +75,9 @@ typedef AVCodec FeAVCodec;
 void try_hw_accel( AVCodecContext *&codec_ctx, FeAVCodec *&dec );
 
 std::string g_decoder;
+bool g_gpu_conversion=false;
+int g_io_buffer_size=32768;
+int g_audio_buffer_ms=250;
 
 //
 // As of Nov, 2017 RetroPie's default version of avcodec is old enough
@@ -101,7 +112,135 @@ void print_ffmpeg_version_info()
 		<< std::endl;
 }
 
-#define MAX_AUDIO_FRAME_SIZE 192000 // 1 second of 48khz 32bit audio
+namespace
+{
+	//
+	// Audio sample buffers that have been freed, kept for reuse by the next
+	// media opened (selection changes open and close media constantly)
+	//
+	class FeAudioBufferPool
+	{
+	private:
+		std::mutex m_mutex;
+		std::vector< std::pair< sf::Int16 *, int > > m_buffers;
+
+		static const size_t MAX_POOLED=8;
+
+	public:
+		~FeAudioBufferPool()
+		{
+			for ( size_t i=0; i<m_buffers.size(); i++ )
+				av_free( m_buffers[i].first );
+		}
+
+		//
+		// Get a buffer that holds at least size samples.  size is set to
+		// the number of samples the returned buffer holds
+		//
+		sf::Int16 *get( int &size )
+		{
+			{
+				std::lock_guard<std::mutex> l( m_mutex );
+				for ( size_t i=0; i<m_buffers.size(); i++ )
+				{
+					if ( m_buffers[i].second >= size )
+					{
+						sf::Int16 *b = m_buffers[i].first;
+						size = m_buffers[i].second;
+						m_buffers.erase( m_buffers.begin() + i );
+						return b;
+					}
+				}
+			}
+
+			return (sf::Int16 *)av_malloc( size * sizeof( sf::Int16 )
+				+ AV_INPUT_BUFFER_PADDING_SIZE );
+		}
+
+		void release( sf::Int16 *b, int size )
+		{
+			if ( !b )
+				return;
+
+			{
+				std::lock_guard<std::mutex> l( m_mutex );
+				if ( m_buffers.size() < MAX_POOLED )
+				{
+					m_buffers.push_back( std::pair< sf::Int16 *, int >( b, size ) );
+					return;
+				}
+			}
+
+			av_free( b );
+		}
+	};
+
+	FeAudioBufferPool g_audio_buffers;
+};
+
+//
+// Keeps packets and frames for reuse once they have been freed, so that
+// the demuxer and decoders aren't allocating new ones for every packet
+// and frame.  Used from the demuxer, decoder and main threads.
+//
+class FeMediaPool
+{
+private:
+	std::mutex m_mutex;
+	std::vector<AVPacket *> m_packets;
+	std::vector<AVFrame *> m_frames;
+
+	static const size_t MAX_POOLED=64;
+
+public:
+	~FeMediaPool();
+
+	AVPacket *alloc_packet();
+	void free_packet( AVPacket **pkt ); // sets *pkt to NULL
+
+	AVFrame *alloc_frame();
+	void free_frame( AVFrame **f ); // sets *f to NULL
+};
+
+//
+// Queue of packets between the demuxer and one stream's decoder.  Packets
+// are only ever pushed by the thread holding the read mutex and popped by
+// the thread decoding the stream, so the queue doesn't need a lock.
+//
+// Packets are stored in a chain of fixed size blocks.  The queue grows by
+// a block whenever the last one fills up (if a stream stops decoding while
+// the demuxer carries on reading for the other one, say), and the consumer
+// hands each block it finishes back to be reused.
+//
+class FePacketQueue
+{
+private:
+	static const size_t BLOCK_SIZE=256;
+
+	struct Block
+	{
+		AVPacket *buf[BLOCK_SIZE];
+		std::atomic<size_t> count; // packets pushed to this block
+		std::atomic<Block *> next; // set once this block is full
+
+		Block();
+	};
+
+	Block *m_head; // block being popped from, consumer only
+	size_t m_head_pos; // next packet to pop in m_head, consumer only
+	Block *m_tail; // block being pushed to, producer only
+	std::atomic<Block *> m_spare; // finished block waiting to be reused
+
+	FePacketQueue( const FePacketQueue & );
+	FePacketQueue &operator=( const FePacketQueue & );
+
+public:
+	FePacketQueue();
+	~FePacketQueue(); // doesn't free any packets left in the queue
+
+	void push( AVPacket *pkt );
+	AVPacket *pop(); // returns NULL if the queue is empty
+};
 
 //
 // Container for our general implementation
@@ -112,11 +251,21 @@ public:
 	FeMediaImp( FeMedia::Type t );
 	void close();
 
+	//
+	// Seek the demuxer to the keyframe at or before offset (from the start
+	// of the file).  Caller holds m_read_mutex
+	//
+	bool seek( sf::Time offset );
+
 	FeMedia::Type m_type;
 	AVFormatContext *m_format_ctx;
 	AVIOContext *m_io_ctx;
-	std::recursive_mutex m_read_mutex;
+	std::mutex m_read_mutex;
 	bool m_read_eof;
+	FeMediaPool m_pool;
+
+	std::atomic<bool> m_video_loop;
+	int m_loop_packets; // packets read since the start of the file
 };
 
 //
@@ -128,8 +277,7 @@ private:
 	//
 	// Queue containing the next packet to process for this stream
 	//
-	std::queue <AVPacket *> m_packetq;
-	std::recursive_mutex m_packetq_mutex;
+	FePacketQueue m_packetq;
 
 public:
 	virtual ~FeBaseStream();
@@ -139,12 +287,20 @@ public:
 	AVCodecContext *codec_ctx;
 	FeAVCodec *codec;
 	int stream_id;
+	FeMediaPool *pool;
 
-	FeBaseStream();
+	FeBaseStream( FeMediaPool *p );
 	virtual void stop();
 	AVPacket *pop_packet();
 	void push_packet( AVPacket *pkt );
 	void clear_packet_queue();
+
+	//
+	// When looping in place, a marker packet is queued where the file
+	// wraps around from the end back to the start
+	//
+	void push_loop_marker();
+	static bool is_loop_marker( const AVPacket *pkt );
 };
 
 //
@@ -155,14 +311,150 @@ class FeAudioImp : public FeBaseStream
 public:
 	SwrContext *resample_ctx;
 	sf::Int16 *audio_buff;
+	int audio_buff_size; // number of samples audio_buff holds
 	std::recursive_mutex audio_buff_mutex;
 
-	FeAudioImp();
+	//
+	// Number of samples to decode each time the sound stream asks for
+	// more, from the configured audio buffer length (see
+	// FeMedia::set_audio_buffer_ms())
+	//
+	int chunk_samples;
+
+	FeAudioImp( FeMediaPool *p );
 	~FeAudioImp();
 
+	//
+	// Size the buffer for the codec's sample rate, channels and frame size
+	//
+	bool init_buffer();
+
+	//
+	// Make sure audio_buff holds at least size samples, keeping the first
+	// keep samples if it has to be reallocated
+	//
+	bool reserve( int size, int keep );
+
 	bool process_frame( AVFrame *frame, sf::SoundStream::Chunk &data, int &offset );
 };
 
+//
+// A frame converted to RGBA
+//
+struct FeRgbaFrame
+{
+	sf::Uint8 *data[4];
+	int linesize[4];
+	int width;
+	int height;
+};
+
+//
+// Three RGBA frames shared between the worker converting frames and the
+// main thread displaying them.  The worker always converts into the back
+// frame and the main thread always displays from the front frame, the two
+// only meet when atomically swapping their frame with the middle one.  This
+// way neither thread ever waits on the other and the main thread always
+// gets the latest completed frame.
+//
+class FeRgbaTripleBuffer
+{
+private:
+	FeRgbaFrame m_frames[3];
+	int m_back;
+	int m_front;
+
+	//
+	// Index of the middle frame, with FRESH set when it holds a frame that
+	// the main thread hasn't picked up yet
+	//
+	std::atomic<int> m_middle;
+	static const int FRESH=4;
+	static const int INDEX_MASK=3;
+
+public:
+	FeRgbaTripleBuffer();
+	~FeRgbaTripleBuffer();
+
+	// worker: get the back frame, (re)allocated at w x h if needed.
+	// Returns NULL on allocation failure
+	FeRgbaFrame *get_back( int w, int h );
+
+	// worker: publish the back frame as the latest completed frame
+	void publish();
+
+	// worker: withdraw a published frame the main thread hasn't picked up
+	void discard();
+
+	// main thread: get the latest completed frame, or NULL if there is no
+	// new frame since the last call
+	FeRgbaFrame *acquire();
+
+	// true if there is a frame for acquire() to return
+	bool has_fresh() const { return ( m_middle.load() & FRESH ); };
+};
+
+FeRgbaTripleBuffer::FeRgbaTripleBuffer()
+	: m_frames(),
+	m_back( 0 ),
+	m_front( 1 ),
+	m_middle( 2 )
+{
+}
+
+FeRgbaTripleBuffer::~FeRgbaTripleBuffer()
+{
+	for ( int i=0; i<3; i++ )
+	{
+		if ( m_frames[i].data[0] )
+			av_freep( &m_frames[i].data[0] );
+	}
+}
+
+FeRgbaFrame *FeRgbaTripleBuffer::get_back( int w, int h )
+{
+	FeRgbaFrame &f = m_frames[ m_back ];
+
+	if ( f.data[0] && ( f.width == w ) && ( f.height == h ))
+		return &f;
+
+	if ( f.data[0] )
+		av_freep( &f.data[0] );
+
+	f.width = 0;
+	f.height = 0;
+
+	if ( av_image_alloc( f.data, f.linesize, w, h, AV_PIX_FMT_RGBA, 32 ) < 0 )
+	{
+		FeLog() << "Error allocating rgba buffer" << std::endl;
+		f.data[0] = NULL;
+		return NULL;
+	}
+
+	f.width = w;
+	f.height = h;
+	return &f;
+}
+
+void FeRgbaTripleBuffer::publish()
+{
+	m_back = m_middle.exchange( m_back | FRESH ) & INDEX_MASK;
+}
+
+void FeRgbaTripleBuffer::discard()
+{
+	m_back = m_middle.exchange( m_back ) & INDEX_MASK;
+}
+
+FeRgbaFrame *FeRgbaTripleBuffer::acquire()
+{
+	if ( !( m_middle.load() & FRESH ))
+		return NULL;
+
+	m_front = m_middle.exchange( m_front ) & INDEX_MASK;
+	return &m_frames[ m_front ];
+}
+
 //
 // Container for our implementation of the video component
 //
@@ -170,14 +462,46 @@ class FeVideoImp : public FeBaseStream
 {
 private:
 	//
-	// Video decoding and colour conversion runs on a dedicated thread.
-	// Loading the result into an sf::Texture and displaying it is done
-	// on the main thread.
+	// Video decoding and colour conversion is done by the shared
+	// FeVideoScheduler worker threads, which call step() whenever this
+	// video is due.  Loading the result into an sf::Texture and displaying
+	// it is done on the main thread.
 	//
-	std::thread m_video_thread;
 	FeMedia *m_parent;
-	sf::Uint8 *rgba_buffer[4];
-	int rgba_linesize[4];
+
+	//
+	// Decoding state, only touched by the worker currently stepping this
+	// video (or by the main thread once the video is unscheduled)
+	//
+	bool m_active;
+	int m_qscore;
+	int m_displayed;
+	int m_qscore_accum;
+	AVFrame *m_detached_frame;
+	bool m_degrading;
+	bool m_do_flush;
+	int64_t m_prev_pts;
+	int64_t m_prev_duration;
+	int64_t m_first_pts;
+	bool m_loop_drain;
+	SwsContext *m_sws_ctx;
+	sf::Time m_wait_time;
+
+	//
+	// Per-video decode statistics
+	//
+	sf::Time m_decode_time;
+	sf::Time m_first_frame_time; // time from play() to the first frame
+	int m_packets_sent;
+	int m_frames_received;
+
+	void finish();
+
+	// set the presentation timestamp of a newly decoded frame
+	void set_frame_pts( AVFrame *f, AVPacket *packet );
+
+	// carry on from the end of the loop that was just drained
+	void start_next_loop();
 
 #if FE_HWACCEL
 	AVPixelFormat hwaccel_output_format;
@@ -185,165 +509,680 @@ private:
 #endif
 
 public:
-	std::atomic<bool> run_video_thread;
+	std::atomic<bool> run_video;
+	std::atomic<float> priority;
+	std::atomic<int> target_width;
+	std::atomic<int> target_height;
+	std::atomic<bool> gpu_allowed;
 	sf::Time time_base;
 	sf::Time max_sleep;
 	sf::Clock video_timer;
+
+	//
+	// video_timer time (in microseconds) at which the current loop started
+	//
+	std::atomic<sf::Int64> loop_offset;
+
+	//
+	// video time (in microseconds) at which the next decoded frame is due
+	// to be displayed
+	//
+	std::atomic<sf::Int64> next_frame_time;
 	sf::Texture *display_texture;
 	int disptex_width;
 	int disptex_height;
 
 	//
-	// The video thread sets display_frame when the next image frame is decoded.
-	// The main thread then copies the image into the corresponding sf::Texture.
+	// Scheduling state, guarded by the FeVideoScheduler mutex
+	//
+	sf::Time sched_due;
+	bool sched_busy;
+
+	//
+	// The worker converts each decoded image frame into rgba_frames.  The
+	// main thread then copies the latest one into the corresponding
+	// sf::Texture.
 	//
-	std::recursive_mutex image_swap_mutex;
-	sf::Uint8 *display_frame;
+	FeRgbaTripleBuffer rgba_frames;
 
-	FeVideoImp( FeMedia *parent );
+	//
+	// When converting on the GPU, the worker sets display_yuv_frame to the
+	// decoded frame instead and the main thread takes it and uploads its
+	// planes straight into the yuv textures.
+	//
+	std::atomic<AVFrame *> display_yuv_frame;
+	sf::Texture yuv_texture[3];
+	bool yuv_displayed;
+	int yuv_width;
+	int yuv_height;
+	bool yuv_full_range;
+	bool yuv_bt709;
+
+	FeVideoImp( FeMedia *parent, FeMediaPool *p );
 	~FeVideoImp();
 
 	void play();
 	void stop();
 
-	void signal_stop(); // signal the bg thread we are stopping, without blocking
+	void signal_stop(); // signal the scheduler we are stopping, without blocking
+
+	// get the frame size to convert to, based on the target size
+	void get_output_size( int &w, int &h );
+
+	// get the rgba frame to convert into, updating the output size if needed
+	FeRgbaFrame *get_output_frame();
 
-	void init_rgba_buffer();
-	void video_thread();
+	// true if frame f can be displayed as YUV planes
+	bool use_yuv_planes( AVFrame *f );
+
+	// upload frame f to the plane textures and free it (main thread only)
+	void upload_yuv_frame( AVFrame *f );
+
+	//
+	// Do the next piece of work for this video (decode a frame or display
+	// the decoded one).  Sets "wait" to how long until the video next needs
+	// to be stepped.  Returns false once the video is finished.
+	//
+	bool step( sf::Time &wait );
 };
 
-FeMediaImp::FeMediaImp( FeMedia::Type t )
-	: m_type( t ),
-	m_format_ctx( NULL ),
-	m_io_ctx( NULL ),
-	m_read_eof( false )
+//
+// A fixed pool of worker threads that decodes all the playing videos.  A
+// worker steps whichever video is due next, preferring videos with a higher
+// priority (larger on screen) when more than one is due.  When the workers
+// are saturated, lower priority videos start discarding frames (by way of
+// their qscore) so that the highest priority video keeps up.
+//
+class FeVideoScheduler
 {
-}
+public:
+	// Returns NULL once the scheduler has been shut down at exit
+	static FeVideoScheduler *get();
 
-void FeMediaImp::close()
-{
-	if (m_format_ctx)
-		avformat_close_input( &m_format_ctx );
+	void add( FeVideoImp *v );
 
-	if (m_io_ctx)
-	{
-		if ( m_io_ctx->opaque )
-			delete (sf::InputStream *)(m_io_ctx->opaque);
+	// Remove v from the scheduler.  Blocks until no worker is stepping v
+	void remove( FeVideoImp *v );
 
-		av_free( m_io_ctx->buffer );
-		av_free( m_io_ctx );
-		m_io_ctx=NULL;
-	}
+	bool is_saturated() const { return m_saturated; };
+	float get_top_priority() const { return m_top_priority; };
 
+	~FeVideoScheduler();
 
-	m_read_eof=false;
-}
+private:
+	FeVideoScheduler();
+	FeVideoScheduler( const FeVideoScheduler & );
+	FeVideoScheduler &operator=( const FeVideoScheduler & );
+
+	void worker();
+	void update_load( const sf::Time &now );
+
+	std::vector< std::thread > m_workers;
+	std::vector< FeVideoImp * > m_videos;
+	std::mutex m_mutex;
+	std::condition_variable m_cond;
+	sf::Clock m_clock;
+	bool m_running;
+
+	sf::Time m_busy_time; // time spent stepping videos since m_load_start
+	sf::Time m_load_start;
+	std::atomic<bool> m_saturated;
+	std::atomic<float> m_top_priority;
+};
 
-FeBaseStream::FeBaseStream()
-	: at_end( false ),
-	far_behind( false ),
-	codec_ctx( NULL ),
-	codec( NULL ),
-	stream_id( -1 )
+namespace
 {
-}
+	const int FE_MAX_VIDEO_WORKERS=4;
 
-FeBaseStream::~FeBaseStream()
+	//
+	// Fraction of the worker pool's time spent decoding above which the
+	// scheduler is considered saturated, and below which it recovers
+	//
+	const float FE_SATURATED_LOAD=0.9f;
+	const float FE_RECOVERED_LOAD=0.75f;
+
+	bool g_scheduler_shutdown=false;
+};
+
+FeVideoScheduler *FeVideoScheduler::get()
 {
-	if ( codec_ctx )
-		avcodec_free_context( &codec_ctx );
+	static FeVideoScheduler g_video_scheduler;
 
-	clear_packet_queue();
+	if ( g_scheduler_shutdown )
+		return NULL;
 
-	codec = NULL;
-	at_end = false;
-	far_behind = false;
-	stream_id = -1;
+	return &g_video_scheduler;
 }
 
-void FeBaseStream::stop()
+FeVideoScheduler::FeVideoScheduler()
+	: m_running( true ),
+	m_saturated( false ),
+	m_top_priority( 0.f )
 {
-	clear_packet_queue();
-	at_end=false;
-	far_behind = false;
 }
 
-AVPacket *FeBaseStream::pop_packet()
+FeVideoScheduler::~FeVideoScheduler()
 {
-	std::lock_guard<std::recursive_mutex> l( m_packetq_mutex );
-
-	if ( m_packetq.empty() )
-		return NULL;
+	{
+		std::lock_guard<std::mutex> l( m_mutex );
+		m_running = false;
+		g_scheduler_shutdown = true;
+	}
+	m_cond.notify_all();
 
-	AVPacket *p = m_packetq.front();
-	m_packetq.pop();
-	return p;
+	for ( std::vector< std::thread >::iterator itr=m_workers.begin();
+			itr!=m_workers.end(); ++itr )
+	{
+		if ( (*itr).joinable() )
+			(*itr).join();
+	}
 }
 
-void FeBaseStream::clear_packet_queue()
+void FeVideoScheduler::add( FeVideoImp *v )
 {
-	std::lock_guard<std::recursive_mutex> l( m_packetq_mutex );
-
-	while ( !m_packetq.empty() )
 	{
-		AVPacket *p = m_packetq.front();
-		m_packetq.pop();
-		av_packet_free( &p );
+		std::lock_guard<std::mutex> l( m_mutex );
+
+		//
+		// Start the worker pool the first time a video is played
+		//
+		if ( m_workers.empty() )
+		{
+			int count = std::thread::hardware_concurrency();
+			if (( count < 1 ) || ( count > FE_MAX_VIDEO_WORKERS ))
+				count = FE_MAX_VIDEO_WORKERS;
+
+			try
+			{
+				for ( int i=0; i<count; i++ )
+					m_workers.push_back( std::thread( &FeVideoScheduler::worker, this ) );
+			}
+			catch ( const std::system_error &e )
+			{
+				FeLog() << "System error starting video thread.  Code: " << e.code()
+					<< " - " << e.what() << std::endl;
+			}
+
+			FeDebug() << "Started " << m_workers.size() << " video decode threads." << std::endl;
+			m_load_start = m_clock.getElapsedTime();
+		}
+
+		v->sched_due = m_clock.getElapsedTime();
+		v->sched_busy = false;
+		m_videos.push_back( v );
 	}
-}
 
-void FeBaseStream::push_packet( AVPacket *pkt )
-{
-	std::lock_guard<std::recursive_mutex> l( m_packetq_mutex );
-	m_packetq.push( pkt );
+	m_cond.notify_one();
 }
 
-FeAudioImp::FeAudioImp()
-	: FeBaseStream(),
-	resample_ctx( NULL ),
-	audio_buff( NULL )
+void FeVideoScheduler::remove( FeVideoImp *v )
 {
+	std::unique_lock<std::mutex> l( m_mutex );
+
+	std::vector< FeVideoImp * >::iterator itr = std::find( m_videos.begin(), m_videos.end(), v );
+	if ( itr == m_videos.end() )
+		return;
+
+	while ( v->sched_busy )
+		m_cond.wait( l );
+
+	// look again, as the worker may have dropped v while we were waiting
+	itr = std::find( m_videos.begin(), m_videos.end(), v );
+	if ( itr != m_videos.end() )
+		m_videos.erase( itr );
 }
 
-FeAudioImp::~FeAudioImp()
+void FeVideoScheduler::update_load( const sf::Time &now )
 {
-	std::lock_guard<std::recursive_mutex> l( audio_buff_mutex );
+	// Called with m_mutex held
+	sf::Time elapsed = now - m_load_start;
+	if ( elapsed < sf::milliseconds( 250 ) )
+		return;
 
-	if ( resample_ctx )
+	float load = m_busy_time.asSeconds() / ( elapsed.asSeconds() * m_workers.size() );
+
+	if ( !m_saturated && ( load > FE_SATURATED_LOAD ))
 	{
-		swr_free( &resample_ctx );
-		resample_ctx = NULL;
+		FeDebug() << "Video decoding saturated (load=" << load << ")" << std::endl;
+		m_saturated = true;
 	}
+	else if ( m_saturated && ( load < FE_RECOVERED_LOAD ))
+		m_saturated = false;
 
-	if ( audio_buff )
+	float top( 0.f );
+	for ( std::vector< FeVideoImp * >::iterator itr=m_videos.begin();
+			itr!=m_videos.end(); ++itr )
 	{
-		av_free( audio_buff );
-		audio_buff=NULL;
+		if ( (*itr)->priority > top )
+			top = (*itr)->priority;
 	}
+	m_top_priority = top;
+
+	m_busy_time = sf::Time::Zero;
+	m_load_start = now;
 }
 
-bool FeAudioImp::process_frame( AVFrame *frame, sf::SoundStream::Chunk &data, int &offset )
+void FeVideoScheduler::worker()
 {
-#if HAVE_CH_LAYOUT
-	int nb_channels = codec_ctx->ch_layout.nb_channels;
-#else
-	int nb_channels = codec_ctx->channels;
-#endif
-
-	int data_size = av_samples_get_buffer_size(
-		NULL,
-		nb_channels,
-		frame->nb_samples,
-		codec_ctx->sample_fmt, 1);
+	std::unique_lock<std::mutex> l( m_mutex );
 
-	if ( codec_ctx->sample_fmt == AV_SAMPLE_FMT_S16 )
+	while ( m_running )
 	{
-		std::lock_guard<std::recursive_mutex> l( audio_buff_mutex );
+		sf::Time now = m_clock.getElapsedTime();
+		sf::Time next_due = now + sf::milliseconds( 100 );
+		FeVideoImp *next = NULL;
 
-		memcpy( (audio_buff + offset), frame->data[0], data_size );
-		offset += data_size / sizeof( sf::Int16 );
-		data.sampleCount += data_size / sizeof(sf::Int16);
-		data.samples = audio_buff;
+		update_load( now );
+
+		for ( std::vector< FeVideoImp * >::iterator itr=m_videos.begin();
+				itr!=m_videos.end(); ++itr )
+		{
+			FeVideoImp *v = *itr;
+			if ( v->sched_busy )
+				continue;
+
+			if ( v->sched_due > now )
+			{
+				if ( v->sched_due < next_due )
+					next_due = v->sched_due;
+			}
+			else if ( !next
+					|| ( v->priority > next->priority )
+					|| (( v->priority == next->priority ) && ( v->sched_due < next->sched_due )))
+				next = v;
+		}
+
+		if ( !next )
+		{
+			m_cond.wait_for( l, std::chrono::microseconds(
+				( next_due - now ).asMicroseconds() ) );
+			continue;
+		}
+
+		next->sched_busy = true;
+		l.unlock();
+
+		sf::Time wait;
+		bool keep_going = next->step( wait );
+
+		l.lock();
+		sf::Time done = m_clock.getElapsedTime();
+		m_busy_time += done - now;
+
+		next->sched_busy = false;
+		next->sched_due = done + wait;
+
+		if ( !keep_going )
+		{
+			std::vector< FeVideoImp * >::iterator itr = std::find( m_videos.begin(), m_videos.end(), next );
+			if ( itr != m_videos.end() )
+				m_videos.erase( itr );
+		}
+
+		// wake anyone waiting in remove(), and other workers in case
+		// something else is now due
+		m_cond.notify_all();
+	}
+}
+
+FeMediaImp::FeMediaImp( FeMedia::Type t )
+	: m_type( t ),
+	m_format_ctx( NULL ),
+	m_io_ctx( NULL ),
+	m_read_eof( false ),
+	m_video_loop( false ),
+	m_loop_packets( 0 )
+{
+}
+
+bool FeMediaImp::seek( sf::Time offset )
+{
+	// AV_TIME_BASE is in microseconds
+	int64_t ts = offset.asMicroseconds();
+	if ( m_format_ctx->start_time != AV_NOPTS_VALUE )
+		ts += m_format_ctx->start_time;
+
+	int r = avformat_seek_file( m_format_ctx, -1, INT64_MIN, ts, ts, 0 );
+	if ( r < 0 )
+	{
+		char buff[256];
+		av_strerror( r, buff, 256 );
+		FeLog() << "Error seeking in media file: " << buff << std::endl;
+		return false;
+	}
+
+	m_read_eof = false;
+	m_loop_packets = 0;
+	return true;
+}
+
+void FeMediaImp::close()
+{
+	if (m_format_ctx)
+		avformat_close_input( &m_format_ctx );
+
+	if (m_io_ctx)
+	{
+		if ( m_io_ctx->opaque )
+			delete (sf::InputStream *)(m_io_ctx->opaque);
+
+		av_free( m_io_ctx->buffer );
+		av_free( m_io_ctx );
+		m_io_ctx=NULL;
+	}
+
+
+	m_read_eof=false;
+	m_loop_packets=0;
+}
+
+FeMediaPool::~FeMediaPool()
+{
+	for ( std::vector<AVPacket *>::iterator itr=m_packets.begin();
+			itr != m_packets.end(); ++itr )
+		av_packet_free( &(*itr) );
+
+	for ( std::vector<AVFrame *>::iterator itr=m_frames.begin();
+			itr != m_frames.end(); ++itr )
+		av_frame_free( &(*itr) );
+}
+
+AVPacket *FeMediaPool::alloc_packet()
+{
+	{
+		std::lock_guard<std::mutex> l( m_mutex );
+		if ( !m_packets.empty() )
+		{
+			AVPacket *p = m_packets.back();
+			m_packets.pop_back();
+			return p;
+		}
+	}
+
+	return av_packet_alloc();
+}
+
+void FeMediaPool::free_packet( AVPacket **pkt )
+{
+	if ( !*pkt )
+		return;
+
+	av_packet_unref( *pkt );
+
+	{
+		std::lock_guard<std::mutex> l( m_mutex );
+		if ( m_packets.size() < MAX_POOLED )
+		{
+			m_packets.push_back( *pkt );
+			*pkt = NULL;
+			return;
+		}
+	}
+
+	av_packet_free( pkt );
+}
+
+AVFrame *FeMediaPool::alloc_frame()
+{
+	{
+		std::lock_guard<std::mutex> l( m_mutex );
+		if ( !m_frames.empty() )
+		{
+			AVFrame *f = m_frames.back();
+			m_frames.pop_back();
+			return f;
+		}
+	}
+
+	return av_frame_alloc();
+}
+
+void FeMediaPool::free_frame( AVFrame **f )
+{
+	if ( !*f )
+		return;
+
+	av_frame_unref( *f );
+
+	{
+		std::lock_guard<std::mutex> l( m_mutex );
+		if ( m_frames.size() < MAX_POOLED )
+		{
+			m_frames.push_back( *f );
+			*f = NULL;
+			return;
+		}
+	}
+
+	av_frame_free( f );
+}
+
+FePacketQueue::Block::Block()
+	: buf(),
+	count( 0 ),
+	next( NULL )
+{
+}
+
+FePacketQueue::FePacketQueue()
+	: m_head( new Block() ),
+	m_head_pos( 0 ),
+	m_tail( m_head ),
+	m_spare( NULL )
+{
+}
+
+FePacketQueue::~FePacketQueue()
+{
+	while ( m_head )
+	{
+		Block *next = m_head->next.load( std::memory_order_relaxed );
+		delete m_head;
+		m_head = next;
+	}
+
+	delete m_spare.load( std::memory_order_relaxed );
+}
+
+void FePacketQueue::push( AVPacket *pkt )
+{
+	size_t c = m_tail->count.load( std::memory_order_relaxed );
+	if ( c == BLOCK_SIZE )
+	{
+		Block *b = m_spare.exchange( NULL, std::memory_order_acquire );
+		if ( b )
+		{
+			b->count.store( 0, std::memory_order_relaxed );
+			b->next.store( NULL, std::memory_order_relaxed );
+		}
+		else
+			b = new Block();
+
+		m_tail->next.store( b, std::memory_order_release );
+		m_tail = b;
+		c = 0;
+	}
+
+	m_tail->buf[ c ] = pkt;
+	m_tail->count.store( c + 1, std::memory_order_release );
+}
+
+AVPacket *FePacketQueue::pop()
+{
+	if ( m_head_pos == BLOCK_SIZE )
+	{
+		Block *next = m_head->next.load( std::memory_order_acquire );
+		if ( !next )
+			return NULL;
+
+		// the producer is done with this block, so it can be reused
+		delete m_spare.exchange( m_head, std::memory_order_release );
+		m_head = next;
+		m_head_pos = 0;
+	}
+
+	if ( m_head_pos == m_head->count.load( std::memory_order_acquire ) )
+		return NULL;
+
+	return m_head->buf[ m_head_pos++ ];
+}
+
+FeBaseStream::FeBaseStream( FeMediaPool *p )
+	: at_end( false ),
+	far_behind( false ),
+	codec_ctx( NULL ),
+	codec( NULL ),
+	stream_id( -1 ),
+	pool( p )
+{
+}
+
+FeBaseStream::~FeBaseStream()
+{
+	if ( codec_ctx )
+		avcodec_free_context( &codec_ctx );
+
+	clear_packet_queue();
+
+	codec = NULL;
+	at_end = false;
+	far_behind = false;
+	stream_id = -1;
+}
+
+void FeBaseStream::stop()
+{
+	clear_packet_queue();
+	at_end=false;
+	far_behind = false;
+}
+
+AVPacket *FeBaseStream::pop_packet()
+{
+	return m_packetq.pop();
+}
+
+void FeBaseStream::clear_packet_queue()
+{
+	AVPacket *p;
+	while (( p = m_packetq.pop() ))
+		pool->free_packet( &p );
+}
+
+void FeBaseStream::push_packet( AVPacket *pkt )
+{
+	m_packetq.push( pkt );
+}
+
+void FeBaseStream::push_loop_marker()
+{
+	AVPacket *pkt = pool->alloc_packet();
+	pkt->stream_index = -1;
+	push_packet( pkt );
+}
+
+bool FeBaseStream::is_loop_marker( const AVPacket *pkt )
+{
+	return ( pkt && ( pkt->stream_index < 0 ));
+}
+
+FeAudioImp::FeAudioImp( FeMediaPool *p )
+	: FeBaseStream( p ),
+	resample_ctx( NULL ),
+	audio_buff( NULL ),
+	audio_buff_size( 0 ),
+	chunk_samples( 0 )
+{
+}
+
+FeAudioImp::~FeAudioImp()
+{
+	std::lock_guard<std::recursive_mutex> l( audio_buff_mutex );
+
+	if ( resample_ctx )
+	{
+		swr_free( &resample_ctx );
+		resample_ctx = NULL;
+	}
+
+	g_audio_buffers.release( audio_buff, audio_buff_size );
+	audio_buff=NULL;
+}
+
+bool FeAudioImp::init_buffer()
+{
+#if HAVE_CH_LAYOUT
+	int nb_channels = codec_ctx->ch_layout.nb_channels;
+#else
+	int nb_channels = codec_ctx->channels;
+#endif
+
+	chunk_samples = std::max( 1,
+		codec_ctx->sample_rate * g_audio_buffer_ms / 1000 ) * nb_channels;
+
+	//
+	// A decoded packet can take us past chunk_samples by up to a frame.
+	// Codecs with variable frame sizes don't set frame_size, so guess for
+	// those (reserve() grows the buffer if we guess wrong)
+	//
+	int frame_size = ( codec_ctx->frame_size > 0 ) ? codec_ctx->frame_size : 4096;
+
+	if ( !reserve( chunk_samples + frame_size * nb_channels, 0 ) )
+		return false;
+
+	FeDebug() << "Audio buffer: " << audio_buff_size * sizeof( sf::Int16 )
+		<< " bytes, " << g_audio_buffer_ms << "ms per chunk" << std::endl;
+
+	return true;
+}
+
+bool FeAudioImp::reserve( int size, int keep )
+{
+	if ( audio_buff && ( size <= audio_buff_size ))
+		return true;
+
+	int new_size = std::max( size, audio_buff_size * 3 / 2 );
+	sf::Int16 *b = g_audio_buffers.get( new_size );
+	if ( !b )
+	{
+		FeLog() << "Error allocating audio buffer" << std::endl;
+		return false;
+	}
+
+	if ( audio_buff && ( keep > 0 ))
+		memcpy( b, audio_buff, keep * sizeof( sf::Int16 ) );
+
+	g_audio_buffers.release( audio_buff, audio_buff_size );
+	audio_buff = b;
+	audio_buff_size = new_size;
+	return true;
+}
+
+bool FeAudioImp::process_frame( AVFrame *frame, sf::SoundStream::Chunk &data, int &offset )
+{
+#if HAVE_CH_LAYOUT
+	int nb_channels = codec_ctx->ch_layout.nb_channels;
+#else
+	int nb_channels = codec_ctx->channels;
+#endif
+
+	int data_size = av_samples_get_buffer_size(
+		NULL,
+		nb_channels,
+		frame->nb_samples,
+		codec_ctx->sample_fmt, 1);
+
+	if ( codec_ctx->sample_fmt == AV_SAMPLE_FMT_S16 )
+	{
+		std::lock_guard<std::recursive_mutex> l( audio_buff_mutex );
+
+		if ( !reserve( offset + data_size / (int)sizeof( sf::Int16 ), offset ) )
+			return false;
+
+		memcpy( (audio_buff + offset), frame->data[0], data_size );
+		offset += data_size / sizeof( sf::Int16 );
+		data.sampleCount += data_size / sizeof(sf::Int16);
+		data.samples = audio_buff;
 	}
 	else
 	{
@@ -413,12 +1252,25 @@ bool FeAudioImp::process_frame( AVFrame *frame, sf::SoundStream::Chunk &data, in
 				frame->nb_samples,
 				AV_SAMPLE_FMT_S16, 0 );
 
+			//
+			// The output count isn't capped to what's left in the buffer:
+			// reserve() grows the buffer (keeping the samples already
+			// decoded) so the whole frame, plus anything the resampler has
+			// buffered, converts in one go
+			//
+			int out_count = swr_get_out_samples( resample_ctx, frame->nb_samples );
+			if ( out_count < frame->nb_samples )
+				out_count = frame->nb_samples;
+
+			if ( !reserve( offset + out_count * nb_channels, offset ) )
+				return false;
+
 			uint8_t *tmp_ptr = (uint8_t *)(audio_buff + offset);
 
 			int out_samples = swr_convert(
 				resample_ctx,
 				&tmp_ptr,
-				frame->nb_samples,
+				out_count,
 				(const uint8_t **)frame->data,
 				frame->nb_samples );
 
@@ -438,20 +1290,43 @@ bool FeAudioImp::process_frame( AVFrame *frame, sf::SoundStream::Chunk &data, in
 }
 
 
-FeVideoImp::FeVideoImp( FeMedia *p )
-		: FeBaseStream(),
-		m_video_thread(),
-		m_parent( p ),
-		rgba_buffer(),
-		rgba_linesize(),
+FeVideoImp::FeVideoImp( FeMedia *parent, FeMediaPool *p )
+		: FeBaseStream( p ),
+		m_parent( parent ),
+		m_active( false ),
+		m_qscore( 10 ),
+		m_displayed( 0 ),
+		m_qscore_accum( 0 ),
+		m_detached_frame( NULL ),
+		m_degrading( false ),
+		m_do_flush( false ),
+		m_prev_pts( 0 ),
+		m_prev_duration( 0 ),
+		m_first_pts( AV_NOPTS_VALUE ),
+		m_loop_drain( false ),
+		m_sws_ctx( NULL ),
+		m_packets_sent( 0 ),
+		m_frames_received( 0 ),
 #if FE_HWACCEL
 		hwaccel_output_format( AV_PIX_FMT_NONE ),
 #endif
-		run_video_thread( false ),
+		run_video( false ),
+		priority( 0.f ),
+		target_width( 0 ),
+		target_height( 0 ),
+		gpu_allowed( false ),
+		loop_offset( 0 ),
+		next_frame_time( 0 ),
 		display_texture( NULL ),
 		disptex_width( 0 ),
 		disptex_height( 0 ),
-		display_frame( NULL )
+		sched_busy( false ),
+		display_yuv_frame( NULL ),
+		yuv_displayed( false ),
+		yuv_width( 0 ),
+		yuv_height( 0 ),
+		yuv_full_range( false ),
+		yuv_bt709( false )
 {
 }
 
@@ -459,8 +1334,9 @@ FeVideoImp::~FeVideoImp()
 {
 	stop();
 
-	if (rgba_buffer[0])
-		av_freep(&rgba_buffer[0]);
+	AVFrame *f = display_yuv_frame.exchange( NULL );
+	if ( f )
+		pool->free_frame( &f );
 }
 
 #if FE_HWACCEL
@@ -493,7 +1369,7 @@ bool FeVideoImp::hw_retrieve_data( AVFrame *f )
 	if ( !(av_pix_fmt_desc_get( (AVPixelFormat)f->format )->flags & AV_PIX_FMT_FLAG_HWACCEL) )
 		return false;
 
-	AVFrame *sw_frame = av_frame_alloc();
+	AVFrame *sw_frame = pool->alloc_frame();
 	if ( hwaccel_output_format == AV_PIX_FMT_NONE )
 	{
 		hwaccel_output_format = hw_get_output_format( codec_ctx->hw_frames_ctx );
@@ -514,7 +1390,7 @@ bool FeVideoImp::hw_retrieve_data( AVFrame *f )
 
 	av_frame_unref( f );
 	av_frame_move_ref( f, sw_frame );
-	av_frame_free( &sw_frame );
+	pool->free_frame( &sw_frame );
 
 	return true;
 }
@@ -523,45 +1399,60 @@ bool FeVideoImp::hw_retrieve_data( AVFrame *f )
 
 void FeVideoImp::play()
 {
-	if ( run_video_thread )
-	{
-		// our thread is already playing, so shut it down before
-		// we start it again below
-		run_video_thread = false;
+	FeVideoScheduler *vs = FeVideoScheduler::get();
+	if ( !vs )
+		return;
 
-		if ( m_video_thread.joinable() )
-			m_video_thread.join();
-	}
+	//
+	// Make sure we aren't still scheduled from a previous play, so
+	// shut that down before we start again below
+	//
+	run_video = false;
+	vs->remove( this );
+	finish();
+
+	m_active = true;
+	m_qscore = 10;
+	m_displayed = 0;
+	m_qscore_accum = 0;
+	m_degrading = false;
+	m_do_flush = false;
+	m_prev_pts = 0;
+	m_prev_duration = 0;
+	m_first_pts = AV_NOPTS_VALUE;
+	m_loop_drain = false;
+	m_wait_time = sf::Time::Zero;
+	m_decode_time = sf::Time::Zero;
+	m_first_frame_time = sf::Time::Zero;
+	m_packets_sent = 0;
+	m_frames_received = 0;
+	at_end = false;
 
-	run_video_thread = true;
+	run_video = true;
+	loop_offset = 0;
 	video_timer.restart();
 
-	try
-	{
-		m_video_thread = std::thread( &FeVideoImp::video_thread, this );
-	}
-	catch ( const std::system_error &e )
-	{
-		FeLog() << "System error starting video thread.  Code: " << e.code()
-			<< " - " << e.what() << std::endl;
-	}
+	vs->add( this );
 }
 
 void FeVideoImp::stop()
 {
-	if ( run_video_thread )
-		run_video_thread = false;
+	if ( run_video )
+		run_video = false;
+
+	FeVideoScheduler *vs = FeVideoScheduler::get();
+	if ( vs )
+		vs->remove( this );
 
-	if ( m_video_thread.joinable() )
-		m_video_thread.join();
+	finish();
 
 	FeBaseStream::stop();
 }
 
 void FeVideoImp::signal_stop()
 {
-	if ( run_video_thread )
-		run_video_thread = false;
+	if ( run_video )
+		run_video = false;
 }
 
 namespace
@@ -584,263 +1475,465 @@ namespace
 	}
 }
 
-void FeVideoImp::init_rgba_buffer()
+void FeVideoImp::get_output_size( int &w, int &h )
+{
+	w = codec_ctx->width;
+	h = codec_ctx->height;
+
+	int tw = target_width;
+	int th = target_height;
+
+	if (( tw > 0 ) && ( th > 0 ) && ( w > 0 ) && ( h > 0 ))
+	{
+		// scale so that both dimensions still cover the target
+		float f = std::max( (float)tw / w, (float)th / h );
+		if ( f < 1.f )
+		{
+			w = std::max( 1, (int)( w * f + 0.5f ) );
+			h = std::max( 1, (int)( h * f + 0.5f ) );
+		}
+	}
+}
+
+FeRgbaFrame *FeVideoImp::get_output_frame()
 {
-	std::lock_guard<std::recursive_mutex> l( image_swap_mutex );
+	int w, h;
+	get_output_size( w, h );
+
+	if (( w != disptex_width ) || ( h != disptex_height ))
+	{
+		FeDebug() << "Video output size: " << w << "x" << h << " (native: "
+			<< codec_ctx->width << "x" << codec_ctx->height << ")" << std::endl;
 
-	if (rgba_buffer[0])
-		av_freep(&rgba_buffer[0]);
+		if ( m_sws_ctx )
+		{
+			sws_freeContext( m_sws_ctx );
+			m_sws_ctx = NULL;
+		}
 
-	int ret = av_image_alloc(rgba_buffer, rgba_linesize,
-			disptex_width, disptex_height,
-			AV_PIX_FMT_RGBA, 32);
+		disptex_width = w;
+		disptex_height = h;
+	}
 
-	if (ret < 0)
-		FeLog() << "Error allocating rgba buffer" << std::endl;
+	return rgba_frames.get_back( disptex_width, disptex_height );
+}
+
+bool FeVideoImp::use_yuv_planes( AVFrame *f )
+{
+	if ( !g_gpu_conversion || !gpu_allowed )
+		return false;
+
+	if (( f->format != AV_PIX_FMT_YUV420P ) && ( f->format != AV_PIX_FMT_YUVJ420P ))
+		return false;
+
+	//
+	// The planes get uploaded as RGBA textures holding 4 samples per texel,
+	// so each line has to be a whole number of texels
+	//
+	for ( int i=0; i<3; i++ )
+	{
+		if (( f->linesize[i] <= 0 ) || ( f->linesize[i] % 4 ))
+			return false;
+	}
+
+	return (( f->width > 0 ) && ( f->height > 0 ));
+}
+
+void FeVideoImp::upload_yuv_frame( AVFrame *f )
+{
+	int heights[3] = { f->height, ( f->height + 1 ) / 2, ( f->height + 1 ) / 2 };
+
+	for ( int i=0; i<3; i++ )
+	{
+		//
+		// The texture is exactly linesize bytes wide, so the plane can be
+		// uploaded straight from the decoder's buffer
+		//
+		sf::Vector2u s( f->linesize[i] / 4, heights[i] );
+		if ( yuv_texture[i].getSize() != s )
+			yuv_texture[i].create( s.x, s.y );
+
+		yuv_texture[i].update( f->data[i] );
+	}
+
+	yuv_width = f->width;
+	yuv_height = f->height;
+	yuv_full_range = ( f->format == AV_PIX_FMT_YUVJ420P )
+		|| ( f->color_range == AVCOL_RANGE_JPEG );
+	yuv_bt709 = ( f->colorspace == AVCOL_SPC_BT709 );
+	yuv_displayed = true;
+
+	pool->free_frame( &f );
 }
 
-void FeVideoImp::video_thread()
+bool FeVideoImp::step( sf::Time &wait )
 {
 	const int QMAX = 16;
 	const int QMIN = 0;
-	int qscore( 10 ); // quality scoring
-	int displayed( 0 ), qscore_accum( 0 );
 
-	AVFrame *detached_frame = NULL;
-	bool degrading = false;
-	bool do_flush = false;
+	wait = sf::Time::Zero;
 
-	int64_t prev_pts = 0;
-	int64_t prev_duration = 0;
-	SwsContext *sws_ctx = NULL;
-
-	sf::Time wait_time;
+	if ( !run_video )
+	{
+		finish();
+		return false;
+	}
 
-	if (!rgba_buffer[0])
+	//
+	// If we are falling behind for more than 2 seconds
+	// it can only mean that we are in suspend/hibernation state,
+	// so we flag the video to be restarted on the next tick.
+	// This prevents displaying only keyframes for several seconds on wake.
+	//
+	if ( m_wait_time < sf::seconds( -5.0f ) )
 	{
-		FeLog() << "Error initializing video thread" << std::endl;
-		goto the_end;
+		m_wait_time = sf::seconds( 0 );
+		far_behind = true;
+		run_video = false;
+		finish();
+		return false;
 	}
 
-	while ( run_video_thread )
+	FeVideoScheduler *vs = FeVideoScheduler::get();
+	bool saturated = vs && vs->is_saturated();
+
+	//
+	// First, display queued frame
+	//
+	if ( m_detached_frame )
 	{
-		bool do_process = true;
+		sf::Time due = (sf::Int64)m_detached_frame->pts * time_base;
+		next_frame_time = due.asMicroseconds();
 
-		//
-		// If we are falling behind for more than 2 seconds
-		// it can only mean that we are in suspend/hibernation state,
-		// so we flag the video to be restarted on the next tick.
-		// This prevents displaying only keyframes for several seconds on wake.
-		//
-		if ( wait_time < sf::seconds( -5.0f ) )
+		m_wait_time = due - m_parent->get_video_time();
+
+		if ( m_wait_time >= max_sleep )
 		{
-			wait_time = sf::seconds( 0 );
-			far_behind = true;
-			run_video_thread = false;
+			//
+			// Frame queue is full and nothing to display yet.  Improve quality
+			// if we have time to spare, and check back in a bit
+			//
+			if ( !m_degrading && !saturated )
+			{
+				if ( m_qscore < QMAX )
+					m_qscore++;
+
+				set_avdiscard_from_qscore( codec_ctx, m_qscore );
+			}
+
+			wait = max_sleep;
+			return true;
 		}
 
-		//
-		// First, display queued frame
-		//
-		if ( detached_frame )
+		if ( m_wait_time > sf::milliseconds( 1 ) )
 		{
-			wait_time = (sf::Int64)detached_frame->pts * time_base
-					- m_parent->get_video_time();
-
-			if ( wait_time < max_sleep )
-			{
-				if ( wait_time < -time_base )
+			//
+			// We are ahead and can wait until presentation time
+			//
+			m_degrading = false;
+			wait = m_wait_time;
+			return true;
+		}
 
-				{
-					// If we are falling behind, we may need to start discarding
-					// frames to catch up
-					//
-					if ( qscore > QMIN )
-						qscore--;
-
-					set_avdiscard_from_qscore( codec_ctx, qscore );
-					degrading = true;
-				}
-				else if ( wait_time >= sf::Time::Zero )
-				{
-					//
-					// We are ahead and can sleep until presentation time
-					//
-					sf::sleep( wait_time );
-					degrading = false;
+		if (( m_wait_time < -time_base )
+				|| ( saturated && ( priority < vs->get_top_priority() )))
+		{
+			// If we are falling behind (or the decoders are saturated and
+			// there is a larger video playing), we may need to start
+			// discarding frames to catch up
+			//
+			if ( m_qscore > QMIN )
+				m_qscore--;
 
-				}
+			set_avdiscard_from_qscore( codec_ctx, m_qscore );
+			m_degrading = true;
+		}
+		else if ( m_wait_time >= sf::Time::Zero )
+			m_degrading = false;
 
-				qscore_accum += qscore;
+		m_qscore_accum += m_qscore;
 
 #if FE_HWACCEL
-				hw_retrieve_data( detached_frame );
+		hw_retrieve_data( m_detached_frame );
 #endif
 
-				if ( !sws_ctx )
-				{
-					enum AVPixelFormat pfmt = codec_ctx->pix_fmt;
-#if FE_HWACCEL
-					if ( hwaccel_output_format != AV_PIX_FMT_NONE )
-						pfmt = hwaccel_output_format;
-#endif
-					int sws_flags( SWS_BILINEAR );
-					if ( (codec_ctx->width & 0x7) || (codec_ctx->height & 0x7) )
-						sws_flags |= SWS_ACCURATE_RND;
+		if ( use_yuv_planes( m_detached_frame ) )
+		{
+			//
+			// Hand the decoded frame to the main thread as is, its planes
+			// get uploaded and converted to RGB by a shader when drawn
+			//
+			if ( m_displayed++ == 0 )
+				m_first_frame_time = video_timer.getElapsedTime();
 
-					sws_ctx = sws_getCachedContext( NULL,
-						codec_ctx->width, codec_ctx->height, pfmt,
-						disptex_width, disptex_height, AV_PIX_FMT_RGBA,
-						sws_flags, NULL, NULL, NULL );
+			rgba_frames.discard();
 
-					if ( !sws_ctx )
-					{
-						FeLog() << "Error allocating SwsContext" << std::endl;
-						goto the_end;
-					}
-				}
+			AVFrame *old = display_yuv_frame.exchange( m_detached_frame );
+			if ( old )
+				pool->free_frame( &old );
 
-				std::lock_guard<std::recursive_mutex> l( image_swap_mutex );
-				displayed++;
+			m_detached_frame = NULL;
+			return true;
+		}
 
-				sws_scale( sws_ctx, detached_frame->data, detached_frame->linesize,
-							0, codec_ctx->height, rgba_buffer,
-							rgba_linesize );
+		FeRgbaFrame *out = get_output_frame();
+		if ( !out )
+		{
+			finish();
+			return false;
+		}
 
-				display_frame = rgba_buffer[0];
+		if ( !m_sws_ctx )
+		{
+			enum AVPixelFormat pfmt = codec_ctx->pix_fmt;
+#if FE_HWACCEL
+			if ( hwaccel_output_format != AV_PIX_FMT_NONE )
+				pfmt = hwaccel_output_format;
+#endif
+			int sws_flags( SWS_BILINEAR );
+			if ( (codec_ctx->width & 0x7) || (codec_ctx->height & 0x7) )
+				sws_flags |= SWS_ACCURATE_RND;
 
-				av_frame_free( &detached_frame );
-				detached_frame = NULL;
+			m_sws_ctx = sws_getCachedContext( NULL,
+				codec_ctx->width, codec_ctx->height, pfmt,
+				disptex_width, disptex_height, AV_PIX_FMT_RGBA,
+				sws_flags, NULL, NULL, NULL );
 
-				do_process = false;
+			if ( !m_sws_ctx )
+			{
+				FeLog() << "Error allocating SwsContext" << std::endl;
+				finish();
+				return false;
 			}
-			//
-			// if we didn't do anything above, then we go into the queue
-			// management process below
-			//
 		}
 
-		if ( do_flush )
+		//
+		// Convert into the back frame, the main thread is free to keep
+		// displaying the previous frame while we do
+		//
+		if ( m_displayed++ == 0 )
+			m_first_frame_time = video_timer.getElapsedTime();
+
+		sws_scale( m_sws_ctx, m_detached_frame->data, m_detached_frame->linesize,
+					0, codec_ctx->height, out->data,
+					out->linesize );
+
+		//
+		// The frame's lines are padded out to keep swscale aligned.  The
+		// texture takes tightly packed lines, so close up the gaps
+		//
+		int row_bytes = out->width * 4;
+		if ( out->linesize[0] != row_bytes )
+		{
+			for ( int y=1; y<out->height; y++ )
+				memmove( out->data[0] + y * row_bytes,
+					out->data[0] + y * out->linesize[0], row_bytes );
+		}
+
+		rgba_frames.publish();
+
+		AVFrame *old = display_yuv_frame.exchange( NULL );
+		if ( old )
+			pool->free_frame( &old );
+
+		pool->free_frame( &m_detached_frame );
+		m_detached_frame = NULL;
+		return true;
+	}
+
+	if ( m_do_flush )
+	{
+		// flushed last time we decoded, so this time we are done
+		finish();
+		return false;
+	}
+
+	if ( m_loop_drain )
+	{
+		//
+		// At the end of a loop, take the frames the decoder still has
+		// and then carry straight on with the next loop
+		//
+		AVFrame *raw_frame = pool->alloc_frame();
+		if ( avcodec_receive_frame( codec_ctx, raw_frame ) == 0 )
+		{
+			m_frames_received++;
+			set_frame_pts( raw_frame, NULL );
+			m_detached_frame = raw_frame;
+		}
+		else
 		{
-			// flushed last time we did do_process branch below, so this time we
-			// exit
-			goto the_end;
+			pool->free_frame( &raw_frame );
+			start_next_loop();
 		}
 
-		if ( do_process )
+		return true;
+	}
+
+	//
+	// get next packet
+	//
+	AVPacket *packet = pop_packet();
+	if ( is_loop_marker( packet ) )
+	{
+		pool->free_packet( &packet );
+
+		// start draining the decoder
+		avcodec_send_packet( codec_ctx, NULL );
+		m_loop_drain = true;
+		return true;
+	}
+
+	if ( packet == NULL )
+	{
+		if ( !m_parent->end_of_file() )
 		{
-			if ( !detached_frame )
-			{
-				//
-				// get next packet
-				//
-				AVPacket *packet = pop_packet();
-				if ( packet == NULL )
-				{
-					if ( !m_parent->end_of_file() )
-						m_parent->read_packet();
-					else
-						do_flush = true; // NULL packet will be fed to avcodec_send_packet()
-				}
+			m_parent->read_packet();
+			return true;
+		}
 
-				if (( packet != NULL ) || ( do_flush ))
-				{
-					//
-					// decompress packet and put it in our frame queue
-					//
-					int r = avcodec_send_packet( codec_ctx, packet );
-					if (( r < 0 ) && ( r != AVERROR(EAGAIN) ))
-					{
-						char buff[256];
-						av_strerror( r, buff, 256 );
-						FeLog() << "Error decoding video (sending packet): "
-							<< buff << std::endl;
-					}
+		m_do_flush = true; // NULL packet will be fed to avcodec_send_packet()
+	}
 
-					AVFrame *raw_frame = av_frame_alloc();
-					r = avcodec_receive_frame( codec_ctx, raw_frame );
+	//
+	// decompress packet
+	//
+	sf::Clock decode_clock;
 
-					if ( r != 0 )
-					{
-						if (( r != AVERROR( EAGAIN )) && (!do_flush)) // Ignore EOF on do_flush
-						{
-							char buff[256];
-							av_strerror( r, buff, 256 );
-							FeLog() << "Error decoding video (receiving frame): "
-								<< buff << std::endl;
-						}
-						av_frame_free( &raw_frame );
-					}
-					else
-					{
-						raw_frame->pts = raw_frame->best_effort_timestamp;
+	int r = avcodec_send_packet( codec_ctx, packet );
+	if (( r < 0 ) && ( r != AVERROR(EAGAIN) ))
+	{
+		char buff[256];
+		av_strerror( r, buff, 256 );
+		FeLog() << "Error decoding video (sending packet): "
+			<< buff << std::endl;
+	}
+	else if ( packet )
+		m_packets_sent++;
 
-						if ( raw_frame->pts == AV_NOPTS_VALUE )
-							raw_frame->pts = packet->dts;
+	AVFrame *raw_frame = pool->alloc_frame();
+	r = avcodec_receive_frame( codec_ctx, raw_frame );
 
+	m_decode_time += decode_clock.getElapsedTime();
+
+	if ( r != 0 )
+	{
+		if (( r != AVERROR( EAGAIN )) && (!m_do_flush)) // Ignore EOF on do_flush
+		{
+			char buff[256];
+			av_strerror( r, buff, 256 );
+			FeLog() << "Error decoding video (receiving frame): "
+				<< buff << std::endl;
+		}
+		pool->free_frame( &raw_frame );
+	}
+	else
+	{
+		m_frames_received++;
+		set_frame_pts( raw_frame, packet );
+		m_detached_frame = raw_frame;
+	}
+
+	if ( packet )
+		pool->free_packet( &packet );
+
+	return true;
+}
+
+void FeVideoImp::set_frame_pts( AVFrame *f, AVPacket *packet )
+{
+	f->pts = f->best_effort_timestamp;
+
+	if (( f->pts == AV_NOPTS_VALUE ) && packet )
+		f->pts = packet->dts;
 
 #if (LIBAVUTIL_VERSION_MICRO >= 100 )
-						// This only works on FFmpeg, exclude libav (it doesn't have pkt_duration
-						// Correct for out of bounds pts
-						if ( raw_frame->pts < prev_pts )
-							raw_frame->pts = prev_pts + prev_duration;
+	// This only works on FFmpeg, exclude libav (it doesn't have pkt_duration
+	// Correct for out of bounds pts
+	if ( f->pts < m_prev_pts )
+		f->pts = m_prev_pts + m_prev_duration;
 
-						// Track pts and duration if we need to correct next frame
-						prev_pts = raw_frame->pts;
+	// Track pts and duration if we need to correct next frame
+	m_prev_pts = f->pts;
 #if HAVE_DURATION
-						prev_duration = raw_frame->duration;
+	m_prev_duration = f->duration;
 #else
-						prev_duration = raw_frame->pkt_duration;
+	m_prev_duration = f->pkt_duration;
 #endif
 #endif
 
-						detached_frame = raw_frame;
-
-					}
+	if ( m_first_pts == AV_NOPTS_VALUE )
+		m_first_pts = f->pts;
+}
 
-					if ( packet )
-						av_packet_free( &packet );
-				}
-			}
-			else if ( !degrading )
-			{
-				if ( qscore < QMAX )
-					qscore++;
+void FeVideoImp::start_next_loop()
+{
+	avcodec_flush_buffers( codec_ctx );
+	m_loop_drain = false;
 
-				set_avdiscard_from_qscore( codec_ctx, qscore );
+	//
+	// The next loop starts where the last frame of this one ends.  Its
+	// frames have the same timestamps as this loop's did, so move the
+	// start of the loop on by the length of this one
+	//
+	if ( m_first_pts != AV_NOPTS_VALUE )
+	{
+		sf::Time frame = ( m_prev_duration > 0 )
+			? (sf::Int64)m_prev_duration * time_base
+			: sf::microseconds( max_sleep.asMicroseconds() * 2 );
 
-				//
-				// full frame queue and nothing to display yet, so sleep
-				//
-				sf::sleep( max_sleep );
-			}
-		}
+		loop_offset += ( (sf::Int64)( m_prev_pts - m_first_pts ) * time_base
+			+ frame ).asMicroseconds();
 	}
 
-the_end:
-	//
-	// shutdown the thread
-	//
+	m_prev_pts = 0;
+	m_prev_duration = 0;
+	m_first_pts = AV_NOPTS_VALUE;
+
+	FeDebug() << "Looped video in place" << std::endl;
+}
+
+void FeVideoImp::finish()
+{
+	if ( !m_active )
+		return;
+
+	m_active = false;
 	at_end=true;
 
+	rgba_frames.discard();
+
+	AVFrame *f = display_yuv_frame.exchange( NULL );
+	if ( f )
+		pool->free_frame( &f );
+
+	if ( m_detached_frame )
+		pool->free_frame( &m_detached_frame );
+
+	if ( m_sws_ctx )
 	{
-		std::lock_guard<std::recursive_mutex> l( image_swap_mutex );
-		if (display_frame)
-			display_frame=NULL;
+		sws_freeContext( m_sws_ctx );
+		m_sws_ctx = NULL;
 	}
 
-	if ( detached_frame )
-		av_frame_free( &detached_frame );
-
-	if ( sws_ctx )
-		sws_freeContext(sws_ctx);
+	int average = ( m_displayed == 0 ) ? m_qscore_accum : ( m_qscore_accum / m_displayed );
 
-	int average = ( displayed == 0 ) ? qscore_accum : ( qscore_accum / displayed );
+	//
+	// Packets sent to the decoder that never came out as a frame were
+	// discarded by the decoder because of our qscore
+	//
+	int dropped = m_packets_sent - m_frames_received;
+	if ( dropped < 0 )
+		dropped = 0;
 
-	FeDebug() << "End Video Thread - " << m_parent->FORMAT_CTX_URL << std::endl
+	FeDebug() << "End Video - " << m_parent->FORMAT_CTX_URL << std::endl
 				<< " - bit_rate=" << codec_ctx->bit_rate
 				<< ", width=" << codec_ctx->width << ", height=" << codec_ctx->height << std::endl
-				<< " - displayed=" << displayed << std::endl
+				<< " - displayed=" << m_displayed << ", dropped=" << dropped
+				<< ", first frame after " << m_first_frame_time.asMilliseconds() << "ms" << std::endl
+				<< " - decode time=" << m_decode_time.asMilliseconds() << "ms ("
+				<< ( m_frames_received ? m_decode_time.asMicroseconds() / m_frames_received : 0 )
+				<< "us/frame)" << std::endl
 				<< " - average qscore=" << average
 				<< std::endl;
 }
@@ -849,6 +1942,8 @@ FeMedia::FeMedia( Type t )
 	: sf::SoundStream(),
 	m_audio( NULL ),
 	m_video( NULL ),
+	m_decoded( NULL ),
+	m_decoded_pos( 0 ),
 	m_aspect_ratio( 1.0 )
 {
 	m_imp = new FeMediaImp( t );
@@ -858,93 +1953,379 @@ FeMedia::~FeMedia()
 {
 	close();
 
-	delete m_imp;
+	delete m_imp;
+}
+
+sf::Time FeMedia::get_video_time()
+{
+	//
+	// TODO: would like to sync movie time to audio, however using
+	// getPlayingOffset() here noticably slows things down on my system.
+	//
+	if ( m_video )
+		return m_video->video_timer.getElapsedTime()
+			- sf::microseconds( m_video->loop_offset );
+	else
+		return sf::Time::Zero;
+}
+
+void FeMedia::play()
+{
+	if ( m_video )
+		m_video->play();
+
+	if ( m_audio || m_decoded )
+		sf::SoundStream::play();
+}
+
+void FeMedia::signal_stop()
+{
+	if ( m_audio || m_decoded )
+		sf::SoundStream::signal_stop();
+
+	if ( m_video )
+		m_video->signal_stop();
+}
+
+void FeMedia::stop()
+{
+	if ( m_audio )
+	{
+		sf::SoundStream::stop();
+		m_audio->stop();
+
+		av_seek_frame( m_imp->m_format_ctx, m_audio->stream_id, 0,
+							AVSEEK_FLAG_BACKWARD );
+
+		avcodec_flush_buffers( m_audio->codec_ctx );
+	}
+
+	if ( m_video )
+	{
+		m_video->stop();
+
+		av_seek_frame( m_imp->m_format_ctx, m_video->stream_id, 0,
+							AVSEEK_FLAG_BACKWARD );
+
+		avcodec_flush_buffers( m_video->codec_ctx );
+	}
+
+	if ( m_decoded )
+	{
+		sf::SoundStream::stop();
+		m_decoded_pos = 0;
+	}
+
+	m_imp->m_read_eof = false;
+	m_imp->m_loop_packets = 0;
+}
+
+void FeMedia::close()
+{
+	stop();
+
+	m_decoded = NULL;
+
+	if (m_audio)
+	{
+		delete m_audio;
+		m_audio=NULL;
+	}
+
+	if (m_video)
+	{
+		delete m_video;
+		m_video=NULL;
+	}
+
+	m_imp->close();
+}
+
+bool FeMedia::is_playing()
+{
+	if ((m_video) && (m_video->far_behind))
+		return false;
+
+	if ((m_video) && (!m_video->at_end))
+		return (m_video->run_video);
+
+	return (( m_audio || m_decoded )
+		&& ( sf::SoundStream::getStatus() == sf::SoundStream::Playing ));
+}
+
+bool FeMedia::get_next_frame_due( sf::Time &t )
+{
+	if ( !m_video || !m_video->run_video )
+		return false;
+
+	if ( m_video->display_yuv_frame.load() || m_video->rgba_frames.has_fresh() )
+	{
+		t = sf::Time::Zero;
+		return true;
+	}
+
+	t = sf::microseconds( m_video->next_frame_time ) - get_video_time();
+
+	//
+	// If the frame is late then the decoder hasn't got to it yet, check
+	// back shortly rather than spinning
+	//
+	if ( t < sf::milliseconds( 2 ) )
+		t = sf::milliseconds( 2 );
+
+	return true;
+}
+
+void FeMedia::set_display_texture( sf::Texture *t )
+{
+	if ( !m_video )
+		return;
+
+	m_video->display_texture = t;
+}
+
+void FeMedia::open_decoded( const FeDecodedSound *s )
+{
+	close();
+
+	m_decoded = s;
+	m_decoded_pos = 0;
+	sf::SoundStream::initialize( s->channels, s->sample_rate );
+}
+
+bool FeMedia::decode( const std::string &archive,
+		const std::string &name,
+		sf::Time max_length,
+		FeDecodedSound &out )
+{
+	FeMedia m( Audio );
+	if ( !m.open( archive, name ) || !m.m_audio )
+		return false;
+
+	out.channels = m.getChannelCount();
+	out.sample_rate = m.getSampleRate();
+	out.samples.clear();
+
+	size_t max_samples = (size_t)( max_length.asSeconds()
+		* out.sample_rate * out.channels );
+
+	Chunk c;
+	while ( m.onGetData( c ) )
+	{
+		out.samples.insert( out.samples.end(), c.samples, c.samples + c.sampleCount );
+
+		if ( out.samples.size() > max_samples )
+			return false;
+	}
+
+	return !out.samples.empty();
 }
 
-sf::Time FeMedia::get_video_time()
+void FeMedia::set_priority( float p )
 {
-	//
-	// TODO: would like to sync movie time to audio, however using
-	// getPlayingOffset() here noticably slows things down on my system.
-	//
 	if ( m_video )
-		return m_video->video_timer.getElapsedTime();
-	else
-		return sf::Time::Zero;
+		m_video->priority = p;
 }
 
-void FeMedia::play()
+void FeMedia::set_target_size( const sf::Vector2u &s )
 {
 	if ( m_video )
-		m_video->play();
-
-	if ( m_audio )
-		sf::SoundStream::play();
+	{
+		m_video->target_width = s.x;
+		m_video->target_height = s.y;
+	}
 }
 
-void FeMedia::signal_stop()
+void FeMedia::set_gpu_conversion_allowed( bool a )
 {
-	if ( m_audio )
-		sf::SoundStream::signal_stop();
-
 	if ( m_video )
-		m_video->signal_stop();
+		m_video->gpu_allowed = a;
 }
 
-void FeMedia::stop()
+namespace
 {
-	if ( m_audio )
+	void set_vec4_uniform( sf::Shader *s, const char *name, float x, float y, float z, float w )
 	{
-		sf::SoundStream::stop();
-		m_audio->stop();
+#if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
+		s->setUniform( name, sf::Glsl::Vec4( x, y, z, w ) );
+#else
+		s->setParameter( name, x, y, z, w );
+#endif
+	}
 
-		av_seek_frame( m_imp->m_format_ctx, m_audio->stream_id, 0,
-							AVSEEK_FLAG_BACKWARD );
+	//
+	// Set up the YUV conversion shader to draw a width x height frame from
+	// the plane textures in t (Y, U, V)
+	//
+	void set_yuv_uniforms( sf::Shader *s, const sf::Texture *t,
+		int width, int height, bool full_range, bool bt709, bool smooth )
+	{
+		int cw = ( width + 1 ) / 2;
+		int ch = ( height + 1 ) / 2;
+
+#if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
+		s->setUniform( "texture_y", t[0] );
+		s->setUniform( "texture_u", t[1] );
+		s->setUniform( "texture_v", t[2] );
+		s->setUniform( "bilinear", smooth ? 1.f : 0.f );
+		s->setUniform( "yuv_range", full_range
+			? sf::Glsl::Vec3( 0.f, 1.f, 1.f )
+			: sf::Glsl::Vec3( 16.f / 255.f, 255.f / 219.f, 255.f / 224.f ) );
+#else
+		s->setParameter( "texture_y", t[0] );
+		s->setParameter( "texture_u", t[1] );
+		s->setParameter( "texture_v", t[2] );
+		s->setParameter( "bilinear", smooth ? 1.f : 0.f );
+		if ( full_range )
+			s->setParameter( "yuv_range", 0.f, 1.f, 1.f );
+		else
+			s->setParameter( "yuv_range", 16.f / 255.f, 255.f / 219.f, 255.f / 224.f );
+#endif
 
-		avcodec_flush_buffers( m_audio->codec_ctx );
+		set_vec4_uniform( s, "luma_size", width, height,
+			t[0].getSize().x, t[0].getSize().y );
+		set_vec4_uniform( s, "chroma_size", cw, ch,
+			t[1].getSize().x, t[1].getSize().y );
+
+		// BT.709 for HD content that says so, BT.601 otherwise
+		if ( bt709 )
+			set_vec4_uniform( s, "yuv_coef", 1.5748f, 0.187324f, 0.468124f, 1.8556f );
+		else
+			set_vec4_uniform( s, "yuv_coef", 1.402f, 0.344136f, 0.714136f, 1.772f );
 	}
 
-	if ( m_video )
+	sf::Uint8 clamp_byte( float f )
 	{
-		m_video->stop();
+		return (sf::Uint8)std::min( 255.f, std::max( 0.f, f + 0.5f ) );
+	}
+};
 
-		av_seek_frame( m_imp->m_format_ctx, m_video->stream_id, 0,
-							AVSEEK_FLAG_BACKWARD );
+const sf::Shader *FeMedia::get_yuv_shader( bool smooth )
+{
+	if ( !m_video || !m_video->yuv_displayed )
+		return NULL;
 
-		avcodec_flush_buffers( m_video->codec_ctx );
-	}
+	sf::Shader *s = FeBlend::get_yuv_shader();
+	if ( !s )
+		return NULL;
 
-	m_imp->m_read_eof = false;
+	set_yuv_uniforms( s, m_video->yuv_texture,
+		m_video->yuv_width, m_video->yuv_height,
+		m_video->yuv_full_range, m_video->yuv_bt709, smooth );
+
+	return s;
 }
 
-void FeMedia::close()
+bool FeMedia::check_gpu_conversion()
 {
-	stop();
+	//
+	// Build a limited range BT.601 4:2:0 test frame with a luma gradient
+	// and a different colour in each 8x8 block.  Chroma is compared at the
+	// nearest sample, so the shader's bilinear filtering is left off
+	//
+	const int W=72;
+	const int H=48;
+	const int CW=W/2;
+	const int CH=H/2;
 
-	if (m_audio)
+	std::vector<sf::Uint8> y_plane( W * H ), u_plane( CW * CH ), v_plane( CW * CH );
+	for ( int y=0; y<H; y++ )
+		for ( int x=0; x<W; x++ )
+			y_plane[ y * W + x ] = 16 + ( x * 3 + y * 2 ) % 220;
+
+	for ( int y=0; y<CH; y++ )
 	{
-		delete m_audio;
-		m_audio=NULL;
+		for ( int x=0; x<CW; x++ )
+		{
+			u_plane[ y * CW + x ] = 16 + ( ( x / 4 ) * 37 + ( y / 4 ) * 11 ) % 225;
+			v_plane[ y * CW + x ] = 16 + ( ( x / 4 ) * 13 + ( y / 4 ) * 53 ) % 225;
+		}
 	}
 
-	if (m_video)
+	if ( !sf::Shader::isAvailable() )
 	{
-		delete m_video;
-		m_video=NULL;
+		FeLog() << "GPU video conversion check: shaders are not available" << std::endl;
+		return false;
 	}
 
-	m_imp->close();
-}
+	sf::Shader *s = FeBlend::get_yuv_shader();
+	if ( !s )
+	{
+		FeLog() << "GPU video conversion check: YUV shader failed to compile" << std::endl;
+		return false;
+	}
 
-bool FeMedia::is_playing()
-{
-	if ((m_video) && (m_video->far_behind))
+	sf::Texture planes[3];
+	if ( !planes[0].create( W / 4, H ) || !planes[1].create( CW / 4, CH )
+			|| !planes[2].create( CW / 4, CH ) )
+	{
+		FeLog() << "GPU video conversion check: error creating plane textures" << std::endl;
 		return false;
+	}
 
-	if ((m_video) && (!m_video->at_end))
-		return (m_video->run_video_thread);
+	planes[0].update( &y_plane[0] );
+	planes[1].update( &u_plane[0] );
+	planes[2].update( &v_plane[0] );
+
+	set_yuv_uniforms( s, planes, W, H, false, false, false );
+
+	//
+	// Draw offscreen, the same way FeImage draws a video with the shader
+	//
+	sf::RenderTexture rt;
+	sf::Texture frame;
+	if ( !rt.create( W, H ) || !frame.create( W, H ) )
+	{
+		FeLog() << "GPU video conversion check: error creating render texture" << std::endl;
+		return false;
+	}
+
+	rt.clear( sf::Color::Black );
+	rt.draw( sf::Sprite( frame ), sf::RenderStates( s ) );
+	rt.display();
+
+	sf::Image result = rt.getTexture().copyToImage();
+
+	//
+	// Compare against converting on the CPU (nearest chroma sample)
+	//
+	const int TOLERANCE=3;
+	int bad=0;
+	int worst=0;
+
+	for ( int y=0; y<H; y++ )
+	{
+		for ( int x=0; x<W; x++ )
+		{
+			float yf = ( y_plane[ y * W + x ] - 16.f ) * 255.f / 219.f;
+			float uf = ( u_plane[ ( y / 2 ) * CW + x / 2 ] - 128.f ) * 255.f / 224.f;
+			float vf = ( v_plane[ ( y / 2 ) * CW + x / 2 ] - 128.f ) * 255.f / 224.f;
+
+			sf::Color expected( clamp_byte( yf + 1.402f * vf ),
+				clamp_byte( yf - 0.344136f * uf - 0.714136f * vf ),
+				clamp_byte( yf + 1.772f * uf ) );
+
+			sf::Color c = result.getPixel( x, y );
+			int diff = std::max( std::abs( c.r - expected.r ),
+				std::max( std::abs( c.g - expected.g ), std::abs( c.b - expected.b ) ) );
 
-	return ((m_audio) && (sf::SoundStream::getStatus() == sf::SoundStream::Playing));
+			worst = std::max( worst, diff );
+			if ( diff > TOLERANCE )
+			{
+				if ( bad++ == 0 )
+					FeLog() << "GPU video conversion check: pixel " << x << "," << y
+						<< " is " << (int)c.r << "," << (int)c.g << "," << (int)c.b
+						<< ", expected " << (int)expected.r << "," << (int)expected.g
+						<< "," << (int)expected.b << std::endl;
+			}
+		}
+	}
+
+	FeLog() << "GPU video conversion check: " << ( bad ? "FAILED" : "passed" )
+		<< " (" << bad << " of " << W * H << " pixels off, largest difference "
+		<< worst << ")" << std::endl;
+
+	return ( bad == 0 );
 }
 
 void FeMedia::setVolume(float volume)
@@ -995,9 +2376,189 @@ int64_t fe_media_seek( void *opaque, int64_t offset, int whence )
 	}
 }
 
+namespace
+{
+	//
+	// Stream information for a recently opened file.  avformat_find_stream_info()
+	// can read a lot of the file (and decode some of it) before the first
+	// frame, so when the same file gets opened again (e.g. going back to a
+	// game whose snap was just playing) we reuse what it found last time.
+	//
+	struct FeProbedStream
+	{
+		AVCodecParameters *par;
+		AVRational r_frame_rate;
+		AVRational avg_frame_rate;
+		int64_t start_time;
+		int64_t duration;
+	};
+
+	struct FeProbeInfo
+	{
+		std::string key;
+		long long size;
+		long long mtime;
+		FeAVInputFormat *iformat;
+		int64_t start_time;
+		int64_t duration;
+		std::vector<FeProbedStream> streams;
+	};
+
+	class FeProbeCache
+	{
+	private:
+		std::list<FeProbeInfo> m_entries; // most recently used first
+		std::mutex m_mutex;
+
+		static const size_t MAX_ENTRIES=64;
+
+		void free_entry( FeProbeInfo &e )
+		{
+			for ( std::vector<FeProbedStream>::iterator itr=e.streams.begin();
+					itr != e.streams.end(); ++itr )
+				avcodec_parameters_free( &((*itr).par) );
+		}
+
+		std::list<FeProbeInfo>::iterator find( const std::string &key )
+		{
+			std::list<FeProbeInfo>::iterator itr;
+			for ( itr=m_entries.begin(); itr != m_entries.end(); ++itr )
+			{
+				if ( (*itr).key.compare( key ) == 0 )
+					break;
+			}
+			return itr;
+		}
+
+	public:
+		~FeProbeCache()
+		{
+			for ( std::list<FeProbeInfo>::iterator itr=m_entries.begin();
+					itr != m_entries.end(); ++itr )
+				free_entry( *itr );
+		}
+
+		//
+		// Get the input format of a cached file, or NULL if the file isn't
+		// cached (or has changed since it was)
+		//
+		FeAVInputFormat *get_format( const std::string &key,
+				long long size, long long mtime )
+		{
+			std::lock_guard<std::mutex> l( m_mutex );
+
+			std::list<FeProbeInfo>::iterator itr = find( key );
+			if ( itr == m_entries.end() )
+				return NULL;
+
+			if (( (*itr).size != size ) || ( (*itr).mtime != mtime ))
+			{
+				free_entry( *itr );
+				m_entries.erase( itr );
+				return NULL;
+			}
+
+			m_entries.splice( m_entries.begin(), m_entries, itr );
+			return (*itr).iformat;
+		}
+
+		//
+		// Fill in the stream information of ctx (just opened, not probed)
+		// from the cache.  Returns false if the file's streams don't match
+		// what was cached, in which case it needs to be probed
+		//
+		bool apply( const std::string &key, AVFormatContext *ctx )
+		{
+			std::lock_guard<std::mutex> l( m_mutex );
+
+			std::list<FeProbeInfo>::iterator itr = find( key );
+			if (( itr == m_entries.end() )
+					|| ( (*itr).streams.size() != ctx->nb_streams ))
+				return false;
+
+			for ( unsigned int i=0; i<ctx->nb_streams; i++ )
+			{
+				if ( (*itr).streams[i].par->codec_id != ctx->streams[i]->codecpar->codec_id )
+					return false;
+			}
+
+			for ( unsigned int i=0; i<ctx->nb_streams; i++ )
+			{
+				AVStream *st = ctx->streams[i];
+				const FeProbedStream &ps = (*itr).streams[i];
+
+				if ( avcodec_parameters_copy( st->codecpar, ps.par ) < 0 )
+					return false;
+
+				st->r_frame_rate = ps.r_frame_rate;
+				st->avg_frame_rate = ps.avg_frame_rate;
+				st->start_time = ps.start_time;
+				st->duration = ps.duration;
+			}
+
+			ctx->start_time = (*itr).start_time;
+			ctx->duration = (*itr).duration;
+			return true;
+		}
+
+		void add( const std::string &key, long long size, long long mtime,
+				AVFormatContext *ctx )
+		{
+			std::lock_guard<std::mutex> l( m_mutex );
+
+			std::list<FeProbeInfo>::iterator itr = find( key );
+			if ( itr != m_entries.end() )
+			{
+				free_entry( *itr );
+				m_entries.erase( itr );
+			}
+
+			FeProbeInfo e;
+			e.key = key;
+			e.size = size;
+			e.mtime = mtime;
+			e.iformat = ctx->iformat;
+			e.start_time = ctx->start_time;
+			e.duration = ctx->duration;
+
+			for ( unsigned int i=0; i<ctx->nb_streams; i++ )
+			{
+				AVStream *st = ctx->streams[i];
+
+				FeProbedStream ps;
+				ps.par = avcodec_parameters_alloc();
+				ps.r_frame_rate = st->r_frame_rate;
+				ps.avg_frame_rate = st->avg_frame_rate;
+				ps.start_time = st->start_time;
+				ps.duration = st->duration;
+
+				if ( !ps.par || ( avcodec_parameters_copy( ps.par, st->codecpar ) < 0 ))
+				{
+					avcodec_parameters_free( &ps.par );
+					free_entry( e );
+					return;
+				}
+
+				e.streams.push_back( ps );
+			}
+
+			m_entries.push_front( e );
+
+			if ( m_entries.size() > MAX_ENTRIES )
+			{
+				free_entry( m_entries.back() );
+				m_entries.pop_back();
+			}
+		}
+	};
+
+	FeProbeCache g_probe_cache;
+};
+
 bool FeMedia::open( const std::string &archive,
 	const std::string &name, sf::Texture *outt )
 {
+	sf::Clock open_timer;
 	close();
 
 	sf::InputStream *s = NULL;
@@ -1027,9 +2588,22 @@ bool FeMedia::open( const std::string &archive,
 	else
 		s = new FeFileInputStream( name );
 
+	//
+	// Files are cached by path, size and modification time (of the archive
+	// if the file is in one)
+	//
+	std::string probe_key = archive.empty() ? name : ( archive + "|" + name );
+	long long fsize( 0 ), fmtime( 0 );
+	FeAVInputFormat *iformat = NULL;
+
+	if ( get_file_stats( archive.empty() ? name : archive, fsize, fmtime ) )
+		iformat = g_probe_cache.get_format( probe_key, fsize, fmtime );
+	else
+		probe_key.clear();
+
 	m_imp->m_format_ctx = avformat_alloc_context();
 
-	size_t avio_ctx_buffer_size = 4096;
+	size_t avio_ctx_buffer_size = g_io_buffer_size;
 	uint8_t *avio_ctx_buffer = (uint8_t *)av_malloc( avio_ctx_buffer_size
 			+ AV_INPUT_BUFFER_PADDING_SIZE );
 
@@ -1043,17 +2617,24 @@ bool FeMedia::open( const std::string &archive,
 
 	m_imp->m_format_ctx->pb = m_imp->m_io_ctx;
 
-	if ( avformat_open_input( &(m_imp->m_format_ctx), name.c_str(), NULL, NULL ) < 0 )
+	if ( avformat_open_input( &(m_imp->m_format_ctx), name.c_str(), iformat, NULL ) < 0 )
 	{
 		FeLog() << "Error opening input file: " << name << std::endl;
 		return false;
 	}
 
-	if ( avformat_find_stream_info( m_imp->m_format_ctx, NULL ) < 0 )
+	bool probed = ( iformat && g_probe_cache.apply( probe_key, m_imp->m_format_ctx ) );
+	if ( !probed )
 	{
-		FeLog() << "Error finding stream information in input file: "
-				<< FORMAT_CTX_URL << std::endl;
-		return false;
+		if ( avformat_find_stream_info( m_imp->m_format_ctx, NULL ) < 0 )
+		{
+			FeLog() << "Error finding stream information in input file: "
+					<< FORMAT_CTX_URL << std::endl;
+			return false;
+		}
+
+		if ( !probe_key.empty() )
+			g_probe_cache.add( probe_key, fsize, fmtime, m_imp->m_format_ctx );
 	}
 
 	if ( m_imp->m_type & Audio )
@@ -1082,19 +2663,11 @@ bool FeMedia::open( const std::string &archive,
 			}
 			else
 			{
-				m_audio = new FeAudioImp();
+				m_audio = new FeAudioImp( &m_imp->m_pool );
 				m_audio->stream_id = stream_id;
 				m_audio->codec_ctx = codec_ctx;
 				m_audio->codec = dec;
-
-				//
-				// TODO: Fix buffer sizing, we allocate way
-				// more than we use
-				//
-				m_audio->audio_buff = (sf::Int16 *)av_malloc(
-					MAX_AUDIO_FRAME_SIZE
-					+ AV_INPUT_BUFFER_PADDING_SIZE
-					+ codec_ctx->sample_rate );
+				m_audio->init_buffer();
 
 #if HAVE_CH_LAYOUT
 				int nb_channels = codec_ctx->ch_layout.nb_channels;
@@ -1181,7 +2754,7 @@ bool FeMedia::open( const std::string &archive,
 
 			if ( av_result >=0  )
 			{
-				m_video = new FeVideoImp( this );
+				m_video = new FeVideoImp( this, &m_imp->m_pool );
 
 				m_video->stream_id = stream_id;
 				m_video->codec_ctx = codec_ctx;
@@ -1197,15 +2770,11 @@ bool FeMedia::open( const std::string &archive,
 				if ( m_imp->m_format_ctx->streams[stream_id]->sample_aspect_ratio.num != 0 )
 					m_aspect_ratio = av_q2d( m_imp->m_format_ctx->streams[stream_id]->sample_aspect_ratio );
 
-				// FFALIGN to 32 here to match rgba_buffer's av_image_alloc() alignment
-				m_video->disptex_width = FFALIGN( codec_ctx->width, 32 );
-				m_video->disptex_height = codec_ctx->height;
+				m_video->get_output_size( m_video->disptex_width, m_video->disptex_height );
 
 				m_video->display_texture = outt;
-				if ( outt->getSize() != sf::Vector2u( m_video->disptex_width, m_video->disptex_height ) )
+				if ( outt && ( outt->getSize() != sf::Vector2u( m_video->disptex_width, m_video->disptex_height )))
 					m_video->display_texture->create( m_video->disptex_width, m_video->disptex_height );
-
-				m_video->init_rgba_buffer();
 			}
 		}
 	}
@@ -1213,12 +2782,16 @@ bool FeMedia::open( const std::string &archive,
 	if ( (!m_video) && (!m_audio) )
 		return false;
 
+	FeDebug() << "Opened media file in " << open_timer.getElapsedTime().asMilliseconds()
+		<< "ms" << ( probed ? " (cached stream info)" : "" ) << ": "
+		<< FORMAT_CTX_URL << std::endl;
+
 	return true;
 }
 
 bool FeMedia::end_of_file()
 {
-	std::lock_guard<std::recursive_mutex> l( m_imp->m_read_mutex );
+	std::lock_guard<std::mutex> l( m_imp->m_read_mutex );
 
 	bool retval = ( m_imp->m_read_eof );
 	return retval;
@@ -1226,27 +2799,46 @@ bool FeMedia::end_of_file()
 
 bool FeMedia::read_packet()
 {
-	std::lock_guard<std::recursive_mutex> l( m_imp->m_read_mutex );
+	std::lock_guard<std::mutex> l( m_imp->m_read_mutex );
 
 	if ( m_imp->m_read_eof )
 		return false;
 
-	AVPacket *pkt = av_packet_alloc();
+	AVPacket *pkt = m_imp->m_pool.alloc_packet();
 
 	int r = av_read_frame( m_imp->m_format_ctx, pkt );
 	if ( r < 0 )
 	{
+		m_imp->m_pool.free_packet( &pkt );
+
+		//
+		// When looping video in place, go back to the start of the file
+		// and carry on reading.  The decoders keep running and just get
+		// a marker telling them where the file wrapped around
+		//
+		if ( m_video && m_imp->m_video_loop && ( m_imp->m_loop_packets > 0 )
+				&& m_imp->seek( sf::Time::Zero ))
+		{
+			m_video->push_loop_marker();
+
+			if ( m_audio )
+				m_audio->push_loop_marker();
+
+			return true;
+		}
+
 		m_imp->m_read_eof=true;
-		av_packet_free( &pkt );
 		return false;
 	}
 
+	m_imp->m_loop_packets++;
+
 	if ( ( m_audio ) && ( pkt->stream_index == m_audio->stream_id ) )
 		m_audio->push_packet( pkt );
 	else if ( ( m_video ) && (pkt->stream_index == m_video->stream_id ) )
 		m_video->push_packet( pkt );
 	else
-		av_packet_free( &pkt );
+		m_imp->m_pool.free_packet( &pkt );
 
 	return true;
 }
@@ -1256,13 +2848,25 @@ bool FeMedia::tick()
 	if (( !m_video ) && ( !m_audio ))
 		return false;
 
-	if ( m_video )
+	if ( m_video && m_video->display_texture )
 	{
-		std::lock_guard<std::recursive_mutex> l( m_video->image_swap_mutex );
-		if ( m_video->display_frame )
+		AVFrame *yuv = m_video->display_yuv_frame.exchange( NULL );
+		if ( yuv )
+		{
+			m_video->upload_yuv_frame( yuv );
+			return true;
+		}
+
+		FeRgbaFrame *f = m_video->rgba_frames.acquire();
+		if ( f )
 		{
-			m_video->display_texture->update( m_video->display_frame );
-			m_video->display_frame = NULL;
+			m_video->yuv_displayed = false;
+
+			sf::Vector2u s( f->width, f->height );
+			if ( m_video->display_texture->getSize() != s )
+				m_video->display_texture->create( s.x, s.y );
+
+			m_video->display_texture->update( f->data[0] );
 			return true;
 		}
 	}
@@ -1278,10 +2882,29 @@ bool FeMedia::onGetData( Chunk &data )
 	data.samples = NULL;
 	data.sampleCount = 0;
 
+	if ( m_decoded )
+	{
+		//
+		// Hand out the decoded samples a chunk at a time, straight from
+		// memory
+		//
+		size_t left = m_decoded->samples.size() - m_decoded_pos;
+		if ( left == 0 )
+			return false;
+
+		size_t chunk = (size_t)m_decoded->sample_rate * m_decoded->channels
+			* g_audio_buffer_ms / 1000;
+
+		data.samples = &m_decoded->samples[ m_decoded_pos ];
+		data.sampleCount = std::min( left, std::max( chunk, (size_t)1 ) );
+		m_decoded_pos += data.sampleCount;
+		return true;
+	}
+
 	if ( (!m_audio) || end_of_file() )
 		return false;
 
-	while ( offset < m_audio->codec_ctx->sample_rate )
+	while ( offset < m_audio->chunk_samples )
 	{
 		AVPacket *packet = m_audio->pop_packet();
 		while (( packet == NULL ) && ( !end_of_file() ))
@@ -1298,7 +2921,13 @@ bool FeMedia::onGetData( Chunk &data )
 			return false;
 		}
 
-		int r = avcodec_send_packet( m_audio->codec_ctx, packet );
+		//
+		// At the end of a loop, drain the decoder so the end of this loop
+		// runs straight into the start of the next one
+		//
+		bool loop_end = FeBaseStream::is_loop_marker( packet );
+
+		int r = avcodec_send_packet( m_audio->codec_ctx, loop_end ? NULL : packet );
 		if (( r < 0 ) && ( r != AVERROR(EAGAIN) ))
 		{
 			char buff[256];
@@ -1306,7 +2935,7 @@ bool FeMedia::onGetData( Chunk &data )
 			FeLog() << "Error decoding audio (sending packet): " << buff << std::endl;
 		}
 
-		av_packet_free( &packet );
+		m_imp->m_pool.free_packet( &packet );
 
 		r = AVERROR(EAGAIN);
 
@@ -1314,7 +2943,7 @@ bool FeMedia::onGetData( Chunk &data )
 		// Note that avcodec_receive_frame() may need to return multiple frames per packet
 		// depending on the audio codec.
 		//
-		AVFrame *frame = av_frame_alloc();
+		AVFrame *frame = m_imp->m_pool.alloc_frame();
 		do
 		{
 			r = avcodec_receive_frame( m_audio->codec_ctx, frame );
@@ -1322,11 +2951,14 @@ bool FeMedia::onGetData( Chunk &data )
 			if ( r == 0 )
 			{
 				if ( !m_audio->process_frame( frame, data, offset ) )
+				{
+					m_imp->m_pool.free_frame( &frame );
 					return false;
+				}
 			}
 			else
 			{
-				if ( r != AVERROR(EAGAIN) )
+				if (( r != AVERROR(EAGAIN) ) && ( r != AVERROR_EOF ))
 				{
 					char buff[256];
 					av_strerror( r, buff, 256 );
@@ -1335,9 +2967,12 @@ bool FeMedia::onGetData( Chunk &data )
 			}
 			av_frame_unref( frame );
 
-		} while ( r != AVERROR(EAGAIN) );
+		} while ( r == 0 );
+
+		m_imp->m_pool.free_frame( &frame );
 
-		av_frame_free( &frame );
+		if ( loop_end )
+			avcodec_flush_buffers( m_audio->codec_ctx );
 	}
 
 	return true;
@@ -1345,7 +2980,41 @@ bool FeMedia::onGetData( Chunk &data )
 
 void FeMedia::onSeek( sf::Time timeOffset )
 {
-	// Not implemented
+	//
+	// Called from the sound stream when it starts playing, and when it
+	// gets to the end if it is set to loop.  Media with video is already
+	// positioned by stop() and loops in place (see set_video_loop()), so
+	// only audio-only media gets seeked here
+	//
+	if ( m_decoded )
+	{
+		size_t pos = (size_t)( timeOffset.asSeconds() * m_decoded->sample_rate )
+			* m_decoded->channels;
+
+		m_decoded_pos = std::min( pos, m_decoded->samples.size() );
+		return;
+	}
+
+	if (( !m_audio ) || ( m_video ))
+		return;
+
+	std::lock_guard<std::mutex> l( m_imp->m_read_mutex );
+
+	if ( !m_imp->seek( timeOffset ) )
+	{
+		// don't keep trying to loop back to a position we can't get to
+		setLoop( false );
+		return;
+	}
+
+	m_audio->clear_packet_queue();
+	avcodec_flush_buffers( m_audio->codec_ctx );
+	m_audio->at_end = false;
+}
+
+void FeMedia::set_video_loop( bool loop )
+{
+	m_imp->m_video_loop = loop;
 }
 
 bool FeMedia::is_supported_media_file( const std::string &filename )
@@ -1400,6 +3069,12 @@ sf::Time FeMedia::get_duration() const
 							m_imp->m_format_ctx->streams[ m_video->stream_id ]->duration );
 	}
 
+	if ( m_decoded && m_decoded->channels && m_decoded->sample_rate )
+	{
+		return sf::seconds( (float)m_decoded->samples.size()
+			/ m_decoded->channels / m_decoded->sample_rate );
+	}
+
 	return sf::Time::Zero;
 }
 
@@ -1478,6 +3153,36 @@ void FeMedia::set_current_decoder( const std::string &l )
 	g_decoder = l;
 }
 
+bool FeMedia::get_gpu_conversion()
+{
+	return g_gpu_conversion;
+}
+
+void FeMedia::set_gpu_conversion( bool c )
+{
+	g_gpu_conversion = c;
+}
+
+int FeMedia::get_audio_buffer_ms()
+{
+	return g_audio_buffer_ms;
+}
+
+void FeMedia::set_audio_buffer_ms( int ms )
+{
+	g_audio_buffer_ms = std::max( 10, std::min( ms, 1000 ) );
+}
+
+int FeMedia::get_io_buffer_size()
+{
+	return g_io_buffer_size;
+}
+
+void FeMedia::set_io_buffer_size( int s )
+{
+	g_io_buffer_size = std::max( s, 4096 );
+}
+
 //
 // Try to use a hardware accelerated decoder where readily available...
 //
@@ -24,6 +24,7 @@
 #define MEDIA_HPP
 
 #include <Audio/SoundStream.hpp>
+#include <SFML/System/Vector2.hpp>
 #include <vector>
 #include <string>
 
@@ -34,6 +35,18 @@ class FeVideoImp;
 namespace sf
 {
 	class Texture;
+	class Shader;
+};
+
+//
+// Audio decoded into memory (see FeMedia::decode())
+//
+class FeDecodedSound
+{
+public:
+	std::vector<sf::Int16> samples; // interleaved
+	unsigned int channels;
+	unsigned int sample_rate;
 };
 
 class FeMedia : private sf::SoundStream
@@ -55,6 +68,18 @@ public:
 			const std::string &name,
 			sf::Texture *out_texture=NULL );
 
+	// Set the texture that video frames get displayed in.  Media can be
+	// opened without a texture (e.g. on a background thread, where it
+	// can't be created) and given one here before it is played.  The
+	// texture keeps its contents until the first frame is displayed.
+	//
+	void set_display_texture( sf::Texture *t );
+
+	// Play sound s from memory instead of a file.  s has to stay around
+	// until this media is closed or opened again
+	//
+	void open_decoded( const FeDecodedSound *s );
+
 	using sf::SoundStream::setPosition;
 	using sf::SoundStream::getPosition;
 	using sf::SoundStream::setPitch;
@@ -74,8 +99,45 @@ public:
 	//
 	bool tick();
 
+	// Get how long until tick() will have the next video frame to display.
+	// Returns false if there is no video playing
+	//
+	bool get_next_frame_due( sf::Time &t );
+
 	void setVolume(float volume);
 
+	// Set the priority of this video when decoding, larger videos on screen
+	// should have a higher priority.  Typically the displayed area in pixels
+	//
+	void set_priority( float p );
+
+	// Set the size (in pixels) that the video is displayed at.  Frames
+	// larger than this get scaled down (keeping their aspect ratio) when
+	// they are decoded, so the texture ends up smaller than the video's
+	// native size.  A size of 0,0 uses the native size
+	//
+	void set_target_size( const sf::Vector2u &s );
+
+	// Set whether video loops in place when it gets to the end.  The file
+	// is rewound and decoding carries straight on into the next loop,
+	// without stopping or restarting the video.  Audio-only media loops
+	// using setLoop() instead
+	//
+	void set_video_loop( bool loop );
+
+	// Allow (or disallow) this video's frames to be converted from YUV to
+	// RGB by a shader when drawn (see get_yuv_shader()).  Only takes effect
+	// if GPU conversion is turned on (set_gpu_conversion())
+	//
+	void set_gpu_conversion_allowed( bool a );
+
+	// Returns the shader to draw the display texture with if the current
+	// frame is being displayed as YUV planes, set up for this video.  The
+	// display texture does not hold the frame in that case.  Returns NULL
+	// if the display texture holds the current frame.
+	//
+	const sf::Shader *get_yuv_shader( bool smooth );
+
 	bool is_playing();
 	bool is_multiframe() const;
 	float get_aspect_ratio() const;
@@ -99,6 +161,37 @@ public:
 	static std::string get_current_decoder();
 	static void set_current_decoder( const std::string & );
 
+	// get/set whether video colour conversion is done on the GPU (where
+	// possible)
+	//
+	static bool get_gpu_conversion();
+	static void set_gpu_conversion( bool );
+
+	// Convert a test frame with the GPU conversion shader offscreen and
+	// compare it against converting on the CPU.  Logs the result and
+	// returns true if they match
+	//
+	static bool check_gpu_conversion();
+
+	// get/set the size (in bytes) of the buffer used to read media files
+	//
+	static int get_io_buffer_size();
+	static void set_io_buffer_size( int );
+
+	// get/set how much audio (in milliseconds) is decoded each time the
+	// sound stream needs more.  Applies to media opened afterwards
+	//
+	static int get_audio_buffer_ms();
+	static void set_audio_buffer_ms( int );
+
+	// Decode the audio in a file into memory.  Returns false if the file
+	// can't be decoded or is longer than max_length
+	//
+	static bool decode( const std::string &archive,
+			const std::string &name,
+			sf::Time max_length,
+			FeDecodedSound &out );
+
 protected:
 	// overrides from base class
 	//
@@ -112,6 +205,8 @@ private:
 	FeMediaImp *m_imp;
 	FeAudioImp *m_audio;
 	FeVideoImp *m_video;
+	const FeDecodedSound *m_decoded;
+	size_t m_decoded_pos; // next sample to play from m_decoded
 
 	FeMedia( const FeMedia & );
 	FeMedia &operator=( const FeMedia & );
@@ -22,6 +22,7 @@
 
 #include <string>
 #include <map>
+#include <mutex>
 
 #include "nowide/fstream.hpp"
 #include "rapidjson/document.h"
@@ -36,6 +37,13 @@
 
 const char *FE_IDDB_EXT = ".txt";
 
+namespace
+{
+	// Romlists for several emulators can be built at once, but they all
+	// share the thegamesdb.net cache files, so only scrape one at a time
+	std::mutex g_tgdb_mutex;
+};
+
 //
 // Database of game names -> gamesdb ids for a given sys_name
 //
@@ -680,6 +688,8 @@ void create_single_id_query(
 
 bool FeSettings::thegamesdb_scraper( FeImporterContext &c )
 {
+	std::lock_guard<std::mutex> l( g_tgdb_mutex );
+
 	FeLog() << " - scraping thegamesdb.net..." << std::endl;
 
 	int remaining_allowance = -1;
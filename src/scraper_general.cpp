@@ -26,11 +26,20 @@
 #include "fe_util.hpp"
 
 #include <iomanip>
+#include <cstring>
+#include <cstdlib>
 #include <sstream>
 #include <iostream>
 #include "nowide/fstream.hpp"
 #include <list>
 #include <map>
+#include <set>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <chrono>
 
 extern const char *FE_ROMLIST_SUBDIR;
 
@@ -60,34 +69,6 @@ void build_basic_romlist( FeImporterContext &c )
 	FeLog() << " - Found " << names.size() << " files." << std::endl;
 }
 
-void write_romlist( const std::string &filename,
-				const FeRomInfoListType &romlist )
-{
-
-	FeLog() << " + Writing " << romlist.size() << " entries to: "
-				<< filename << std::endl;
-
-	int i=0;
-	nowide::ofstream outfile( filename.c_str() );
-	if ( outfile.is_open() )
-	{
-		// one line header showing what the columns represent
-		//
-		outfile << "#" << FeRomInfo::indexStrings[i++];
-		while ( i < FeRomInfo::Favourite )
-			outfile << ";" << FeRomInfo::indexStrings[i++];
-		outfile << std::endl;
-
-		// Now output the list
-		//
-		for ( FeRomInfoListType::const_iterator itl=romlist.begin();
-				itl != romlist.end(); ++itl )
-			outfile << (*itl).as_output() << std::endl;
-
-		outfile.close();
-	}
-}
-
 struct myclasscmp
 {
 	bool operator() ( const std::string &lhs, const std::string &rhs ) const
@@ -582,162 +563,832 @@ bool FeSettings::apply_xml_import( FeImporterContext &c )
 	return !cancelled;
 }
 
-bool FeSettings::build_romlist( const std::vector< FeImportTask > &task_list,
-						const std::string &output_name,
-						FeFilter &filter,
-						bool full )
+//
+// Concurrent romlist building
+//
+// The build/import tasks for different emulators are independent of each
+// other until their results get merged into the final romlist, so they are
+// run on a small pool of worker threads.  Each job keeps its own romlist,
+// log output and progress, and the results are merged (and logged) in task
+// order once all of the jobs are done so the output is the same as if the
+// tasks had been run one after another.
+//
+namespace
 {
-	FeRomInfoListType total_romlist;
-	std::string best_name, list_name, path;
+	const unsigned int FE_MAX_IMPORT_WORKERS=4;
 
-	for ( std::vector<FeImportTask>::const_iterator itr=task_list.begin();
-			itr < task_list.end(); ++itr )
+	// Limit on the number of emulators that we run at once to get -listxml
+	// (and similar) info.  These can be memory and cpu hungry processes.
+	const int FE_MAX_EMULATOR_PROCS=2;
+
+	class FeProcessLimiter
 	{
-		if ( (*itr).task_type == FeImportTask::BuildRomlist )
+	public:
+		FeProcessLimiter( int count ) : m_count( count ) {};
+
+		void acquire()
 		{
-			// Build romlist task
-			FeLog() << "*** Generating Collection/Rom List: "
-				<< (*itr).emulator_name << std::endl;
+			std::unique_lock<std::mutex> l( m_mutex );
+			while ( m_count <= 0 )
+				m_cv.wait( l );
+
+			m_count--;
+		}
 
-			FeEmulatorInfo *emu = m_rl.get_emulator( (*itr).emulator_name );
-			if ( emu == NULL )
+		void release()
+		{
 			{
-				FeLog() << " ! Error: Invalid --build-rom-list target: "
-					<<  (*itr).emulator_name << std::endl;
+				std::lock_guard<std::mutex> l( m_mutex );
+				m_count++;
 			}
-			else
-			{
-				FeRomInfoListType romlist;
+			m_cv.notify_one();
+		}
 
-				best_name = emu->get_info( FeEmulatorInfo::Name );
+	private:
+		std::mutex m_mutex;
+		std::condition_variable m_cv;
+		int m_count;
+	};
 
-				FeImporterContext ctx( *emu, romlist );
-				ctx.full = full;
-				ctx.out_name = output_name;
+	FeProcessLimiter g_emulator_procs( FE_MAX_EMULATOR_PROCS );
 
-				build_basic_romlist( ctx );
+	bool runs_emulator( FeEmulatorInfo::InfoSource is )
+	{
+		return (( is == FeEmulatorInfo::Listxml )
+			|| ( is == FeEmulatorInfo::Listsoftware )
+			|| ( is == FeEmulatorInfo::Listsoftware_tgdb )
+			|| ( is == FeEmulatorInfo::Scummvm ));
+	}
 
-				apply_xml_import( ctx );
-				apply_import_extras( ctx, emu->is_mame() );
+	const char *FE_SCAN_INDEX_EXTENSION = ".scan";
 
-				apply_emulator_name( best_name, romlist );
-				total_romlist.splice( total_romlist.end(), romlist );
-			}
+	// FNV-1a, used to fingerprint emulator configurations in the scan index
+	std::string hash_str( const std::string &s )
+	{
+		unsigned long long h = 14695981039346656037ULL;
+		for ( std::string::const_iterator itr=s.begin(); itr!=s.end(); ++itr )
+		{
+			h ^= (unsigned char)(*itr);
+			h *= 1099511628211ULL;
 		}
-		else if ( (*itr).task_type == FeImportTask::ImportRomlist )
+
+		std::ostringstream ss;
+		ss << std::hex << h;
+		return ss.str();
+	}
+
+	std::string stats_str( const std::string &path )
+	{
+		long long size( 0 ), mtime( 0 );
+		get_file_stats( path, size, mtime );
+
+		std::ostringstream ss;
+		ss << size << ":" << mtime;
+		return ss.str();
+	}
+
+	//
+	// Get a signature of everything about the emulator configuration that
+	// can change the romlist entries it builds, other than the rom files
+	// themselves (which are tracked individually).
+	//
+	std::string get_emulator_signature( const FeEmulatorInfo &emu )
+	{
+		std::string sig;
+		const int fields[] = {
+			FeEmulatorInfo::Executable,
+			FeEmulatorInfo::Working_dir,
+			FeEmulatorInfo::Rom_path,
+			FeEmulatorInfo::Rom_extension,
+			FeEmulatorInfo::System,
+			FeEmulatorInfo::Info_source,
+			FeEmulatorInfo::Import_extras
+		};
+
+		for ( unsigned int i=0; i<sizeof(fields)/sizeof(fields[0]); i++ )
 		{
-			// import romlist from file task
-			FeLog() << "*** Importing Collection/Rom List: "
-				<< (*itr).file_name << std::endl;
+			sig += emu.get_info( fields[i] );
+			sig += ";";
+		}
+
+		// A new emulator version can give different -listxml results
+		sig += stats_str( clean_path( emu.get_info( FeEmulatorInfo::Executable ) ) );
+
+		const std::vector< std::string > &extras = emu.get_import_extras();
+		for ( std::vector< std::string >::const_iterator itr = extras.begin();
+				itr != extras.end(); ++itr )
+		{
+			sig += ";";
+			sig += stats_str( emu.clean_path_with_wd( *itr ) );
+		}
+
+		return hash_str( sig );
+	}
+};
 
-			FeRomInfoListType romlist;
-			std::string emu_name;
+//
+// The scan index is saved alongside a romlist when it is built.  It records
+// the size and modification time of each file found in the emulators' rom
+// paths along with the romname of the entry that was built from it (empty
+// if the file didn't result in an entry).
+//
+// When a romlist is rebuilt incrementally, files that haven't changed carry
+// their previous romlist entry forward (including any changes made using
+// "Edit Game") and only new or changed files go through the xml import,
+// import extras and scraping steps.
+//
+class FeScanEntry
+{
+public:
+	FeScanEntry() : size( 0 ), mtime( 0 ) {};
 
-			if ( (*itr).emulator_name.empty() )
+	long long size;
+	long long mtime;
+	std::string romname;
+};
+
+class FeScanEmulator
+{
+public:
+	std::string signature;
+	std::map< std::string, FeScanEntry > files; // keyed by full path
+};
+
+class FeScanIndex
+{
+public:
+	std::map< std::string, FeScanEmulator > emulators;
+
+	bool load( const std::string &filename )
+	{
+		nowide::ifstream infile( filename.c_str() );
+		if ( !infile.is_open() )
+			return false;
+
+		std::string line;
+		while ( getline( infile, line ) )
+		{
+			std::string type, emu;
+			size_t pos=0;
+
+			token_helper( line, pos, type, ";" );
+			token_helper( line, pos, emu, ";" );
+
+			if ( type.compare( "e" ) == 0 )
+				token_helper( line, pos, emulators[ emu ].signature, ";" );
+			else if ( type.compare( "f" ) == 0 )
 			{
-				// deduce the emulator name from the filename provided
-				size_t my_start = (*itr).file_name.find_last_of( "\\/" );
-				if ( my_start == std::string::npos ) // if there is no / we start at the beginning
-					my_start = 0;
-				else
-					my_start += 1;
+				std::string size, mtime, romname;
+				token_helper( line, pos, size, ";" );
+				token_helper( line, pos, mtime, ";" );
+				token_helper( line, pos, romname, ";" );
+
+				// the path is last since it could contain our separator
+				if ( pos >= line.size() )
+					continue;
+
+				FeScanEntry &e = emulators[ emu ].files[ line.substr( pos ) ];
+				e.size = strtoll( size.c_str(), NULL, 10 );
+				e.mtime = strtoll( mtime.c_str(), NULL, 10 );
+				e.romname = romname;
+			}
+		}
 
-				size_t my_end = (*itr).file_name.find_last_of( "." );
-				if ( my_end != std::string::npos )
-					emu_name = (*itr).file_name.substr( my_start, my_end - my_start  );
+		return true;
+	}
+
+	void save( const std::string &filename ) const
+	{
+		nowide::ofstream outfile( filename.c_str() );
+		if ( !outfile.is_open() )
+			return;
+
+		for ( std::map< std::string, FeScanEmulator >::const_iterator ite=emulators.begin();
+				ite != emulators.end(); ++ite )
+		{
+			outfile << "e;" << (*ite).first << ";" << (*ite).second.signature << std::endl;
+
+			for ( std::map< std::string, FeScanEntry >::const_iterator itf=(*ite).second.files.begin();
+					itf != (*ite).second.files.end(); ++itf )
+			{
+				outfile << "f;" << (*ite).first
+					<< ";" << (*itf).second.size
+					<< ";" << (*itf).second.mtime
+					<< ";" << (*itf).second.romname
+					<< ";" << (*itf).first << std::endl;
 			}
-			else
-				emu_name = (*itr).emulator_name;
+		}
+	}
+};
 
-			best_name = emu_name;
+class FeImportJob
+{
+public:
+	FeImportJob()
+		: task_type( FeImportTask::BuildRomlist ),
+		has_emu( false ),
+		full( false ),
+		use_net( true ),
+		incremental( false ),
+		has_scan( false ),
+		ok( true ),
+		progress( 0 ),
+		queue( NULL )
+	{
+	};
+
+	FeImportTask::TaskType task_type;
+	std::string emulator_name;
+	std::string file_name;
+	std::string out_name;
+
+	// FeEmulatorInfo pointers from FeRomList::get_emulator() aren't stable
+	// (the emulator list grows as emulators get loaded) so each job gets
+	// its own copy, resolved before the workers are started
+	FeEmulatorInfo emu;
+	bool has_emu;
+
+	bool full;
+	bool use_net;
+
+	// Incremental rebuilds: the previous romlist entries and scan index
+	// for this emulator.  On return, scan holds the updated scan index
+	bool incremental;
+	FeRomInfoListType previous;
+	FeScanEmulator scan;
+	bool has_scan; // true if this job produced a scan index entry
+
+	// Results
+	FeRomInfoListType romlist;
+	std::string best_name;
+	std::string user_message;
+	std::ostringstream log;
+	bool ok; // false if cancelled
+
+	std::atomic<int> progress;
+	FeImportJobQueue *queue;
+};
 
-			if ( tail_compare( (*itr).file_name, ".txt" ) )
+class FeImportJobQueue
+{
+public:
+	FeImportJobQueue( FeSettings &fes, std::vector<FeImportJob> &jobs )
+		: m_fes( fes ),
+		m_jobs( jobs ),
+		m_next( 0 ),
+		m_done( 0 ),
+		m_cancelled( false )
+	{
+	};
+
+	// Run all of the jobs to completion.  Progress is reported through uiu
+	// on the calling thread (the UI is not ours to touch from the workers).
+	//
+	// Returns false if the user cancelled
+	//
+	bool run( UiUpdate uiu, void *uid )
+	{
+		if ( m_jobs.empty() )
+			return true;
+
+		if ( m_jobs.size() == 1 )
+		{
+			// Nothing to run alongside, so just do the work here
+			FeImportJob &j = m_jobs.front();
+			j.queue = NULL;
+			m_fes.run_import_job( j, uiu, uid );
+			return j.ok;
+		}
+
+		unsigned int count = std::thread::hardware_concurrency();
+		if ( count < 2 )
+			count = 2;
+		if ( count > FE_MAX_IMPORT_WORKERS )
+			count = FE_MAX_IMPORT_WORKERS;
+		if ( count > m_jobs.size() )
+			count = m_jobs.size();
+
+		for ( std::vector<FeImportJob>::iterator itr=m_jobs.begin(); itr!=m_jobs.end(); ++itr )
+			(*itr).queue = this;
+
+		std::vector<std::thread> workers;
+		for ( unsigned int i=0; i<count; i++ )
+			workers.push_back( std::thread( &FeImportJobQueue::worker, this ) );
+
+		//
+		// The workers don't write to the console themselves (their output
+		// would get mixed together), so their combined progress is shown
+		// from here
+		//
+		int last_percent = -1;
+		std::cout << "    ";
+
+		while ( m_done < m_jobs.size() )
+		{
+			int p=0;
+			for ( std::vector<FeImportJob>::iterator itr=m_jobs.begin(); itr!=m_jobs.end(); ++itr )
+				p += (*itr).progress;
+
+			p /= (int)m_jobs.size();
+
+			if ( p != last_percent )
+			{
+				last_percent = p;
+				std::cout << "\b\b\b\b" << std::setw(3) << p << '%' << std::flush;
+			}
+
+			if ( uiu )
 			{
-				// Attract-Mode format list
-				//
-				FeRomList temp_list( m_config_path );
-				temp_list.load_from_file( (*itr).file_name, ";" );
+				std::string aux;
+				{
+					std::lock_guard<std::mutex> l( m_mutex );
+					aux = m_aux;
+				}
+
+				if ( uiu( uid, p, aux ) == false )
+					m_cancelled = true;
+			}
+
+			std::this_thread::sleep_for( std::chrono::milliseconds( 10 ) );
+		}
+
+		std::cout << std::endl;
+
+		for ( std::vector<std::thread>::iterator itr=workers.begin(); itr!=workers.end(); ++itr )
+			(*itr).join();
+
+		return !m_cancelled;
+	}
+
+	// UiUpdate callback given to the jobs running on the worker threads
+	static bool worker_ui_update( void *d, int p, const std::string &aux )
+	{
+		FeImportJob *j = (FeImportJob *)d;
+		j->progress = p;
+
+		if ( !aux.empty() )
+		{
+			std::lock_guard<std::mutex> l( j->queue->m_mutex );
+			j->queue->m_aux = aux;
+		}
 
-				FeRomInfoListType &entries = temp_list.get_list();
+		return !j->queue->m_cancelled;
+	}
+
+private:
+	FeImportJobQueue( const FeImportJobQueue & );
+	FeImportJobQueue &operator=( const FeImportJobQueue & );
 
-				for ( FeRomInfoListType::iterator itr = entries.begin(); itr != entries.end(); ++itr )
-					romlist.push_back( *itr );
+	void worker()
+	{
+		FeImportJob *j;
+		while (( j = get_next() ) != NULL )
+		{
+			if ( m_cancelled )
+				j->ok = false;
+			else
+			{
+				fe_set_thread_log( &j->log );
+				m_fes.run_import_job( *j, worker_ui_update, j );
+				fe_set_thread_log( NULL );
 			}
-			else if ( tail_compare( (*itr).file_name, ".lst" ) )
+
+			j->progress = 100;
+			m_done++;
+		}
+	}
+
+	FeImportJob *get_next()
+	{
+		std::lock_guard<std::mutex> l( m_mutex );
+		if ( m_next < m_jobs.size() )
+			return &(m_jobs[ m_next++ ]);
+
+		return NULL;
+	}
+
+	FeSettings &m_fes;
+	std::vector<FeImportJob> &m_jobs;
+	std::mutex m_mutex;
+	std::string m_aux;
+	size_t m_next;
+	std::atomic<size_t> m_done;
+	std::atomic<bool> m_cancelled;
+};
+
+namespace
+{
+	//
+	// Load the previous romlist and scan index for an incremental rebuild,
+	// handing each job the entries that were built for its emulator last time
+	//
+	void load_previous_build( const std::string &config_dir,
+		const std::string &romlist_path,
+		std::vector<FeImportJob> &jobs )
+	{
+		std::string scan_path = romlist_path.substr(
+			0, romlist_path.size() - strlen( FE_ROMLIST_FILE_EXTENSION ) ) + FE_SCAN_INDEX_EXTENSION;
+
+		FeScanIndex scan;
+		if ( !file_exists( romlist_path ) || !scan.load( scan_path ) )
+			return;
+
+		FeRomList loader( config_dir );
+		loader.load_from_file( romlist_path, ";" );
+		FeRomInfoListType &prev = loader.get_list();
+
+		for ( std::vector<FeImportJob>::iterator itr=jobs.begin(); itr!=jobs.end(); ++itr )
+		{
+			if (( (*itr).task_type != FeImportTask::BuildRomlist ) || !(*itr).has_emu )
+				continue;
+
+			const std::string &name = (*itr).emu.get_info( FeEmulatorInfo::Name );
+
+			std::map< std::string, FeScanEmulator >::iterator its = scan.emulators.find( name );
+			if ( its == scan.emulators.end() )
+				continue;
+
+			(*itr).incremental = true;
+			(*itr).scan = (*its).second;
+
+			for ( FeRomInfoListType::iterator itp=prev.begin(); itp!=prev.end(); )
 			{
-				// Mamewah/Wahcade! format list
-				//
-				import_mamewah( (*itr).file_name, emu_name, romlist );
+				if ( name.compare( (*itp).get_info( FeRomInfo::Emulator ) ) == 0 )
+				{
+					FeRomInfoListType::iterator next = itp;
+					++next;
+					(*itr).previous.splice( (*itr).previous.end(), prev, itp );
+					itp = next;
+				}
+				else
+					++itp;
 			}
-			else if ( tail_compare( (*itr).file_name, ".xml" ) )
+		}
+	}
+
+	void save_scan_index( const std::string &romlist_path,
+		const std::vector<FeImportJob> &jobs )
+	{
+		std::string scan_path = romlist_path.substr(
+			0, romlist_path.size() - strlen( FE_ROMLIST_FILE_EXTENSION ) ) + FE_SCAN_INDEX_EXTENSION;
+
+		FeScanIndex scan;
+		for ( std::vector<FeImportJob>::const_iterator itr=jobs.begin(); itr!=jobs.end(); ++itr )
+		{
+			if ( (*itr).has_scan )
+				scan.emulators[ (*itr).emu.get_info( FeEmulatorInfo::Name ) ] = (*itr).scan;
+		}
+
+		if ( scan.emulators.empty() )
+			delete_file( scan_path );
+		else
+			scan.save( scan_path );
+	}
+};
+
+void FeSettings::run_import_job( FeImportJob &job, UiUpdate uiu, void *uid )
+{
+	if ( job.task_type == FeImportTask::BuildRomlist )
+	{
+		// Build romlist task
+		FeLog() << "*** Generating Collection/Rom List: "
+			<< job.emulator_name << std::endl;
+
+		if ( !job.has_emu )
+		{
+			FeLog() << " ! Error: Invalid --build-rom-list target: "
+				<<  job.emulator_name << std::endl;
+			return;
+		}
+
+		job.best_name = job.emu.get_info( FeEmulatorInfo::Name );
+
+		FeImporterContext ctx( job.emu, job.romlist );
+		ctx.uiupdate = uiu;
+		ctx.uiupdatedata = uid;
+		ctx.full = job.full;
+		ctx.out_name = job.out_name;
+		ctx.use_net = job.use_net;
+
+		build_basic_romlist( ctx );
+
+		// Entries built from files that rom path scanning can't account for
+		// (scummvm, or everything mame knows about with "full") aren't tracked
+		//
+		job.has_scan = !job.full
+			&& ( job.emu.get_info_source() != FeEmulatorInfo::Scummvm );
+
+		FeScanEmulator new_scan;
+		FeRomInfoListType carried;
+
+		if ( job.has_scan )
+		{
+			new_scan.signature = get_emulator_signature( job.emu );
+
+			if ( job.incremental
+					&& ( new_scan.signature.compare( job.scan.signature ) != 0 ))
 			{
-				FeEmulatorInfo temp_emu( emu_name );
-				FeImporterContext ctx( temp_emu, romlist );
-				ctx.full = true; // Flag that all xml entries go into romlist
+				FeLog() << " - Emulator configuration has changed, rebuilding all entries." << std::endl;
+				job.incremental = false;
+			}
 
-				FeListXMLParser mamep( ctx );
-				if ( mamep.parse_file( (*itr).file_name ) )
-					apply_emulator_name( emu_name, romlist );
+			std::multimap< std::string, FeRomInfoListType::iterator > prev_map;
+			if ( job.incremental )
+			{
+				for ( FeRomInfoListType::iterator itr=job.previous.begin();
+						itr!=job.previous.end(); ++itr )
+					prev_map.insert( std::pair< std::string, FeRomInfoListType::iterator >(
+						(*itr).get_info( FeRomInfo::Romname ), itr ) );
 			}
-			else
+
+			// romnames whose previous entries have been carried forward
+			std::set< std::string > carried_names;
+
+			for ( FeRomInfoListType::iterator itr=job.romlist.begin(); itr!=job.romlist.end(); )
 			{
-				FeLog() << " ! Error: Unsupported --import-rom-list file: "
-					<<  (*itr).file_name << std::endl;
+				const std::string &path = (*itr).get_info( FeRomInfo::BuildFullPath );
+
+				FeScanEntry &e = new_scan.files[ path ];
+				get_file_stats( path, e.size, e.mtime );
+
+				std::map< std::string, FeScanEntry >::iterator its = job.scan.files.find( path );
+				if ( job.incremental && ( its != job.scan.files.end() )
+						&& ( (*its).second.size == e.size )
+						&& ( (*its).second.mtime == e.mtime ))
+				{
+					e.romname = (*its).second.romname;
+
+					std::pair< std::multimap< std::string, FeRomInfoListType::iterator >::iterator,
+						std::multimap< std::string, FeRomInfoListType::iterator >::iterator > range
+							= prev_map.equal_range( e.romname );
+
+					// Unchanged, and either it didn't give us an entry last time or
+					// we have the entry(s) from last time.  Several files can give
+					// the same romname (foo.zip and foo.7z, say), the entries are
+					// carried forward with the first of them and the rest are
+					// dropped along with it
+					//
+					if ( e.romname.empty() || ( range.first != range.second )
+							|| ( carried_names.find( e.romname ) != carried_names.end() ))
+					{
+						if ( !e.romname.empty() )
+							carried_names.insert( e.romname );
+
+						for ( std::multimap< std::string, FeRomInfoListType::iterator >::iterator itp=range.first;
+								itp != range.second; ++itp )
+							carried.splice( carried.end(), job.previous, (*itp).second );
+
+						prev_map.erase( range.first, range.second );
+
+						itr = job.romlist.erase( itr );
+						continue;
+					}
+				}
+
+				++itr;
 			}
 
-			FeLog() << "[Import " << (*itr).file_name << "] - Imported "
-				<< romlist.size() << " entries." << std::endl;
+			if ( job.incremental )
+				FeLog() << " - Reusing " << carried.size() << " unchanged entries, "
+					<< job.romlist.size() << " new or changed file(s) to process." << std::endl;
+		}
 
-			FeEmulatorInfo *emu = m_rl.get_emulator( emu_name );
-			if ( emu == NULL )
+		if ( job.incremental && job.romlist.empty() )
+		{
+			// Nothing new, so we don't need to run the emulator etc.
+			job.ok = true;
+		}
+		else
+		{
+			if ( runs_emulator( job.emu.get_info_source() ) )
 			{
-				FeLog() << " * Warning: The emulator specified with --import-rom-list was not found: "
-					<<  emu_name << std::endl;
+				g_emulator_procs.acquire();
+				job.ok = apply_xml_import( ctx );
+				g_emulator_procs.release();
 			}
 			else
+				job.ok = apply_xml_import( ctx );
+
+			apply_import_extras( ctx, job.emu.is_mame() );
+			apply_emulator_name( job.best_name, job.romlist );
+		}
+
+		if ( job.has_scan )
+		{
+			// Record the romname of the entry built from each processed file
+			//
+			for ( FeRomInfoListType::const_iterator itr=job.romlist.begin();
+					itr!=job.romlist.end(); ++itr )
 			{
-				FeImporterContext ctx( *emu, romlist );
-				apply_import_extras( ctx, true );
+				std::map< std::string, FeScanEntry >::iterator its
+					= new_scan.files.find( (*itr).get_info( FeRomInfo::BuildFullPath ) );
+
+				if ( its != new_scan.files.end() )
+					(*its).second.romname = (*itr).get_info( FeRomInfo::Romname );
 			}
 
-			total_romlist.splice( total_romlist.end(), romlist );
+			job.scan = new_scan;
 		}
-		else // scrape artwork
+
+		job.romlist.splice( job.romlist.begin(), carried );
+		job.previous.clear();
+
+		job.user_message = ctx.user_message;
+	}
+	else // ImportRomlist
+	{
+		// import romlist from file task
+		FeLog() << "*** Importing Collection/Rom List: "
+			<< job.file_name << std::endl;
+
+		FeRomInfoListType &romlist = job.romlist;
+		const std::string &emu_name = job.best_name;
+
+		if ( tail_compare( job.file_name, ".txt" ) )
 		{
-			FeEmulatorInfo *emu = m_rl.get_emulator( (*itr).emulator_name );
-			if ( emu == NULL )
-				return false;
+			// Attract-Mode format list
+			//
+			FeRomList temp_list( m_config_path );
+			temp_list.load_from_file( job.file_name, ";" );
 
-			FeLog() << "*** Scraping artwork for: " << (*itr).emulator_name << std::endl;
+			FeRomInfoListType &entries = temp_list.get_list();
 
-			FeRomInfoListType romlist;
-			std::string fn = get_config_dir() + FE_ROMLIST_SUBDIR + (*itr).emulator_name + FE_ROMLIST_FILE_EXTENSION;
+			for ( FeRomInfoListType::iterator itr = entries.begin(); itr != entries.end(); ++itr )
+				romlist.push_back( *itr );
+		}
+		else if ( tail_compare( job.file_name, ".lst" ) )
+		{
+			// Mamewah/Wahcade! format list
+			//
+			import_mamewah( job.file_name, emu_name, romlist );
+		}
+		else if ( tail_compare( job.file_name, ".xml" ) )
+		{
+			FeEmulatorInfo temp_emu( emu_name );
+			FeImporterContext ctx( temp_emu, romlist );
+			ctx.full = true; // Flag that all xml entries go into romlist
 
-			FeImporterContext ctx( *emu, romlist );
-			ctx.use_net = false;
+			FeListXMLParser mamep( ctx );
+			if ( mamep.parse_file( job.file_name ) )
+				apply_emulator_name( emu_name, romlist );
+		}
+		else
+		{
+			FeLog() << " ! Error: Unsupported --import-rom-list file: "
+				<<  job.file_name << std::endl;
+		}
 
-			if ( file_exists( fn ) )
+		FeLog() << "[Import " << job.file_name << "] - Imported "
+			<< romlist.size() << " entries." << std::endl;
+
+		if ( !job.has_emu )
+		{
+			FeLog() << " * Warning: The emulator specified with --import-rom-list was not found: "
+				<<  emu_name << std::endl;
+		}
+		else
+		{
+			FeImporterContext ctx( job.emu, romlist );
+			apply_import_extras( ctx, true );
+		}
+	}
+}
+
+bool FeSettings::build_romlist( const std::vector< FeImportTask > &task_list,
+						const std::string &output_name,
+						FeFilter &filter,
+						bool full,
+						bool update )
+{
+	FeRomInfoListType total_romlist;
+	std::string best_name, list_name, path;
+
+	//
+	// Set up the build and import tasks to be run concurrently
+	//
+	int job_count=0;
+	for ( std::vector<FeImportTask>::const_iterator itr=task_list.begin();
+			itr < task_list.end(); ++itr )
+	{
+		if ( (*itr).task_type != FeImportTask::ScrapeArtwork )
+			job_count++;
+	}
+
+	std::vector<FeImportJob> jobs( job_count );
+	std::vector<FeImportJob>::iterator itj = jobs.begin();
+
+	for ( std::vector<FeImportTask>::const_iterator itr=task_list.begin();
+			itr < task_list.end(); ++itr )
+	{
+		if ( (*itr).task_type == FeImportTask::ScrapeArtwork )
+			continue;
+
+		FeImportJob &j = *itj;
+		++itj;
+
+		j.task_type = (*itr).task_type;
+		j.emulator_name = (*itr).emulator_name;
+		j.file_name = (*itr).file_name;
+		j.full = full;
+		j.out_name = output_name;
+
+		if ( j.task_type == FeImportTask::ImportRomlist )
+		{
+			if ( j.emulator_name.empty() )
 			{
-				FeRomList loader( get_config_dir() );
-				loader.load_from_file( fn, ";" );
-				ctx.romlist.swap( loader.get_list() );
+				// deduce the emulator name from the filename provided
+				size_t my_start = j.file_name.find_last_of( "\\/" );
+				if ( my_start == std::string::npos ) // if there is no / we start at the beginning
+					my_start = 0;
+				else
+					my_start += 1;
+
+				size_t my_end = j.file_name.find_last_of( "." );
+				if ( my_end != std::string::npos )
+					j.best_name = j.file_name.substr( my_start, my_end - my_start  );
 			}
 			else
-			{
-				build_basic_romlist( ctx );
-				apply_xml_import( ctx );
-			}
+				j.best_name = j.emulator_name;
+		}
+
+		FeEmulatorInfo *emu = m_rl.get_emulator(
+			( j.task_type == FeImportTask::ImportRomlist ) ? j.best_name : j.emulator_name );
+
+		if ( emu )
+		{
+			j.emu = *emu;
+			j.has_emu = true;
+		}
+	}
+
+	path = get_config_dir();
+	confirm_directory( path, FE_ROMLIST_SUBDIR );
 
-			ctx.scrape_art = true;
-			confirm_directory( get_config_dir(), FE_SCRAPER_SUBDIR );
+	path += FE_ROMLIST_SUBDIR;
+
+	if ( update && !output_name.empty() )
+		load_previous_build( get_config_dir(),
+			path + output_name + FE_ROMLIST_FILE_EXTENSION, jobs );
+
+	FeImportJobQueue q( *this, jobs );
+	q.run( NULL, NULL );
+
+	//
+	// Merge the results in task order
+	//
+	for ( std::vector<FeImportJob>::iterator itr=jobs.begin(); itr!=jobs.end(); ++itr )
+	{
+		FeLog() << (*itr).log.str();
+
+		if (( (*itr).task_type == FeImportTask::ImportRomlist ) || (*itr).has_emu )
+			best_name = (*itr).best_name;
+
+		total_romlist.splice( total_romlist.end(), (*itr).romlist );
+	}
+
+	//
+	// Artwork scraping runs after everything else is built, one emulator
+	// at a time
+	//
+	for ( std::vector<FeImportTask>::const_iterator itr=task_list.begin();
+			itr < task_list.end(); ++itr )
+	{
+		if ( (*itr).task_type != FeImportTask::ScrapeArtwork )
+			continue;
+
+		FeEmulatorInfo *emu = m_rl.get_emulator( (*itr).emulator_name );
+		if ( emu == NULL )
+			return false;
+
+		FeLog() << "*** Scraping artwork for: " << (*itr).emulator_name << std::endl;
+
+		FeRomInfoListType romlist;
+		std::string fn = get_config_dir() + FE_ROMLIST_SUBDIR + (*itr).emulator_name + FE_ROMLIST_FILE_EXTENSION;
 
-			// do the mame-specific scrapers first, followed
-			// by the more general thegamesdb scraper.
-			general_mame_scraper( ctx );
-			thegamesdb_scraper( ctx );
+		FeImporterContext ctx( *emu, romlist );
+		ctx.use_net = false;
 
-			FeLog() << "*** Scraping done." << std::endl;
+		if ( file_exists( fn ) )
+		{
+			FeRomList loader( get_config_dir() );
+			loader.load_from_file( fn, ";" );
+			ctx.romlist.swap( loader.get_list() );
+		}
+		else
+		{
+			build_basic_romlist( ctx );
+			apply_xml_import( ctx );
 		}
+
+		ctx.scrape_art = true;
+		confirm_directory( get_config_dir(), FE_SCRAPER_SUBDIR );
+
+		// do the mame-specific scrapers first, followed
+		// by the more general thegamesdb scraper.
+		general_mame_scraper( ctx );
+		thegamesdb_scraper( ctx );
+
+		FeLog() << "*** Scraping done." << std::endl;
 	}
 
 	// return now if all we did was scrape artwork
@@ -779,11 +1430,6 @@ bool FeSettings::build_romlist( const std::vector< FeImportTask > &task_list,
 	if ( task_list.size() > 1 )
 		best_name = "multi";
 
-	path = get_config_dir();
-	confirm_directory( path, FE_ROMLIST_SUBDIR );
-
-	path += FE_ROMLIST_SUBDIR;
-
 	// if we weren't given a specific output name, then we come up with a name
 	// that doesn't exist already
 	//
@@ -792,7 +1438,11 @@ bool FeSettings::build_romlist( const std::vector< FeImportTask > &task_list,
 	else
 		list_name = path + output_name + FE_ROMLIST_FILE_EXTENSION;
 
+	FeLog() << " + Writing " << total_romlist.size() << " entries to: "
+				<< list_name << std::endl;
+
 	write_romlist( list_name, total_romlist );
+	save_scan_index( list_name, jobs );
 
 	return true;
 }
@@ -810,35 +1460,58 @@ bool FeSettings::build_romlist( const std::vector<std::string> &emu_list, const
 	bool cancelled = false;
 	std::string user_message;
 
+	int job_count=0;
 	for ( std::vector<std::string>::const_iterator itr = emu_list.begin();
-		!cancelled && ( itr != emu_list.end() ); ++itr )
+		itr != emu_list.end(); ++itr )
+	{
+		if ( m_rl.get_emulator( *itr ) )
+			job_count++;
+	}
+
+	std::vector<FeImportJob> jobs( job_count );
+	std::vector<FeImportJob>::iterator itj = jobs.begin();
+
+	for ( std::vector<std::string>::const_iterator itr = emu_list.begin();
+		itr != emu_list.end(); ++itr )
 	{
 		FeEmulatorInfo *emu = m_rl.get_emulator( *itr );
 		if ( emu == NULL )
 			continue;
 
-		FeLog() << "*** Generating Collection/Rom List: "
-			<< emu->get_info( FeEmulatorInfo::Name ) << std::endl;
+		FeImportJob &j = *itj;
+		++itj;
 
-		FeRomInfoListType romlist;
+		j.emulator_name = *itr;
+		j.emu = *emu;
+		j.has_emu = true;
+		j.out_name = out_name;
+		j.use_net = use_net;
+	}
 
-		FeImporterContext ctx( *emu, romlist );
-		ctx.uiupdate = uiu;
-		ctx.uiupdatedata = uid;
-		ctx.out_name = out_name;
-		ctx.use_net = use_net;
+	std::string filename = get_config_dir();
+	confirm_directory( filename, FE_ROMLIST_SUBDIR );
 
-		build_basic_romlist( ctx );
-		if ( !apply_xml_import( ctx ) )
-			cancelled = true;
+	filename += FE_ROMLIST_SUBDIR;
+	filename += out_name;
+	filename += FE_ROMLIST_FILE_EXTENSION;
+
+	load_previous_build( get_config_dir(), filename, jobs );
 
-		apply_import_extras( ctx, emu->is_mame() );
-		apply_emulator_name( *itr, romlist );
+	FeImportJobQueue q( *this, jobs );
+	if ( !q.run( uiu, uid ) )
+		cancelled = true;
 
-		total_romlist.splice( total_romlist.end(), romlist );
+	for ( std::vector<FeImportJob>::iterator itr=jobs.begin(); itr!=jobs.end(); ++itr )
+	{
+		FeLog() << (*itr).log.str();
+
+		if ( !(*itr).ok )
+			cancelled = true;
 
-		if ( !ctx.user_message.empty() )
-			user_message = ctx.user_message;
+		total_romlist.splice( total_romlist.end(), (*itr).romlist );
+
+		if ( !(*itr).user_message.empty() )
+			user_message = (*itr).user_message;
 	}
 
 	if ( cancelled )
@@ -850,17 +1523,14 @@ bool FeSettings::build_romlist( const std::vector<std::string> &emu_list, const
 	FeLog() << " - Removing any duplicate entries..." << std::endl;
 	total_romlist.unique();
 
-	std::string filename = get_config_dir();
-	confirm_directory( filename, FE_ROMLIST_SUBDIR );
-
 	if ( uiu )
 		uiu( uid, 100, "" );
 
-	filename += FE_ROMLIST_SUBDIR;
-	filename += out_name;
-	filename += FE_ROMLIST_FILE_EXTENSION;
+	FeLog() << " + Writing " << total_romlist.size() << " entries to: "
+				<< filename << std::endl;
 
 	write_romlist( filename, total_romlist );
+	save_scan_index( filename, jobs );
 
 	if ( user_message.empty() )
 		get_resource( "Wrote $1 entries to Collection/Rom List",
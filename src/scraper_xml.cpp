@@ -22,6 +22,7 @@
 
 #include "scraper_xml.hpp"
 #include "fe_util.hpp"
+#include "fe_base.hpp" // logging
 #include "zip.hpp"
 
 #include <cstring>
@@ -125,6 +126,8 @@ FeListXMLParser::FeListXMLParser( FeImporterContext &ctx )
 	: FeXMLParser( ctx.uiupdate, ctx.uiupdatedata ),
 	m_ctx( ctx ),
 	m_count( 0 ),
+	m_last_percent( 0 ),
+	m_console( !fe_has_thread_log() ),
 	m_displays( 0 ),
 	m_collect_data( false ),
 	m_chd( false ),
@@ -395,24 +398,24 @@ void FeListXMLParser::end_element( const char *element )
 
 			m_count++;
 
-			static int last_percent( 0 );
 			if ( !m_ctx.full && ( !m_ctx.romlist.empty() ))
 			{
 				int per = m_ctx.progress_past
 					+ m_count * m_ctx.progress_range
 					/ m_ctx.romlist.size();
 
-				if ( per != last_percent )
+				if ( per != m_last_percent )
 				{
-					last_percent = per;
+					m_last_percent = per;
 
-					std::cout << "\b\b\b\b" << std::setw(3)
-						<< last_percent << '%' << std::flush;
+					if ( m_console )
+						std::cout << "\b\b\b\b" << std::setw(3)
+							<< m_last_percent << '%' << std::flush;
 
 					if ( m_ui_update )
 					{
 						if ( m_ui_update( m_ui_update_data,
-								last_percent,
+								m_last_percent,
 								(*m_itr).get_info( FeRomInfo::Title ) ) == false )
 							set_continue_parse( false );
 					}
@@ -445,18 +448,21 @@ void FeListXMLParser::end_element( const char *element )
 void FeListXMLParser::pre_parse()
 {
 	m_count=0;
+	m_last_percent=0;
 
 	m_map.clear();
 	for ( FeRomInfoListType::iterator itr=m_ctx.romlist.begin();
 			itr != m_ctx.romlist.end(); ++itr )
 		m_map[ (*itr).get_info( FeRomInfo::Romname ).c_str() ] = itr;
 
-	std::cout << "    ";
+	if ( m_console )
+		std::cout << "    ";
 }
 
 void FeListXMLParser::post_parse()
 {
-	std::cout << std::endl;
+	if ( m_console )
+		std::cout << std::endl;
 
 	if ( !m_discarded.empty() )
 	{
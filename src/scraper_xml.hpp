@@ -84,6 +84,8 @@ private:
 	std::map<const char *, FeRomInfoListType::iterator, FeMapComp> m_map;
 	std::vector<FeRomInfoListType::iterator> m_discarded;
 	int m_count;
+	int m_last_percent;
+	bool m_console; // show progress on the console
 	int m_displays;
 	bool m_collect_data;
 	bool m_chd;
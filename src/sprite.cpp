@@ -56,14 +56,21 @@
 // Headers
 ////////////////////////////////////////////////////////////
 #include "sprite.hpp"
+#include "fe_batch.hpp"
+#include "fe_blend.hpp"
+#include "fe_util.hpp" // for FE_VERSION_INT macro
 #include <SFML/Graphics/Texture.hpp>
 #include <SFML/Graphics/RenderTarget.hpp>
+#include <SFML/Graphics/Shader.hpp>
 #include <cstdlib>
 
 
 ////////////////////////////////////////////////////////////
 FeSprite::FeSprite() :
 m_vertices( sf::TrianglesStrip, 4 ),
+m_quad( sf::TrianglesStrip, 4 ),
+m_needsSlicing( false ),
+m_color( sf::Color::White ),
 m_texture    (NULL),
 m_textureRect(),
 m_pinch( 0.f, 0.f ),
@@ -75,6 +82,9 @@ m_skew( 0.f, 0.f )
 ////////////////////////////////////////////////////////////
 FeSprite::FeSprite(const sf::Texture& texture) :
 m_vertices( sf::TrianglesStrip, 4 ),
+m_quad( sf::TrianglesStrip, 4 ),
+m_needsSlicing( false ),
+m_color( sf::Color::White ),
 m_texture    (NULL),
 m_textureRect(),
 m_pinch( 0.f, 0.f ),
@@ -87,6 +97,9 @@ m_skew( 0.f, 0.f )
 ////////////////////////////////////////////////////////////
 FeSprite::FeSprite(const sf::Texture& texture, const sf::IntRect& rectangle) :
 m_vertices( sf::TrianglesStrip, 4 ),
+m_quad( sf::TrianglesStrip, 4 ),
+m_needsSlicing( false ),
+m_color( sf::Color::White ),
 m_texture    (NULL),
 m_textureRect(),
 m_pinch( 0.f, 0.f ),
@@ -123,9 +136,14 @@ void FeSprite::setTextureRect(const sf::IntRect& rectangle)
 ////////////////////////////////////////////////////////////
 void FeSprite::setColor(const sf::Color& color)
 {
+	m_color = color;
+
     // Update the vertices' color
     for ( unsigned int i=0; i < m_vertices.getVertexCount(); i++ )
 		m_vertices[i].color = color;
+
+	for ( unsigned int i=0; i < m_quad.getVertexCount(); i++ )
+		m_quad[i].color = color;
 }
 
 
@@ -146,7 +164,7 @@ const sf::IntRect& FeSprite::getTextureRect() const
 ////////////////////////////////////////////////////////////
 const sf::Color& FeSprite::getColor() const
 {
-    return m_vertices[0].color;
+    return m_color;
 }
 
 
@@ -173,10 +191,75 @@ void FeSprite::draw(sf::RenderTarget& target, sf::RenderStates states) const
 	{
 		states.transform *= getTransform();
 		states.texture = m_texture;
-		target.draw( m_vertices, states );
+
+		const sf::Shader *ps = getPinchShader( states );
+		if ( ps )
+		{
+			states.shader = ps;
+			target.draw( m_quad, states );
+		}
+		else
+			target.draw( getSlicedVertices(), states );
+	}
+}
+
+////////////////////////////////////////////////////////////
+void FeSprite::drawBatched( FeDrawBatch &batch, sf::RenderStates states ) const
+{
+	if (m_texture)
+	{
+		// the pinch shader's parameters are different for each sprite
+		if ( isPinched() && !states.shader && FeBlend::get_pinch_shader() )
+		{
+			batch.draw( *this, states );
+			return;
+		}
+
+		states.texture = m_texture;
+		batch.add( getSlicedVertices(), getTransform(), states );
 	}
 }
 
+////////////////////////////////////////////////////////////
+bool FeSprite::isPinched() const
+{
+	return (( m_pinch.x != 0.f ) || ( m_pinch.y != 0.f ));
+}
+
+////////////////////////////////////////////////////////////
+const sf::Shader *FeSprite::getPinchShader( const sf::RenderStates &states ) const
+{
+	// the pinch shader can't be combined with any other shader
+	if ( !isPinched() || states.shader )
+		return NULL;
+
+	sf::Shader *s = FeBlend::get_pinch_shader();
+	if ( !s )
+		return NULL;
+
+	float left   = static_cast<float>(m_textureRect.left);
+	float top    = static_cast<float>(m_textureRect.top);
+
+	sf::Vector2f tl = m_quad[0].position;
+	sf::Vector2f bl = m_quad[1].position;
+	sf::Vector2f tr = m_quad[2].position;
+	sf::Vector2f br = m_quad[3].position;
+
+#if ( SFML_VERSION_INT >= FE_VERSION_INT( 2, 4, 0 ))
+	s->setUniform( "corner_top", sf::Glsl::Vec4( tl.x, tl.y, tr.x, tr.y ) );
+	s->setUniform( "corner_bottom", sf::Glsl::Vec4( bl.x, bl.y, br.x, br.y ) );
+	s->setUniform( "tex_rect", sf::Glsl::Vec4( left, top,
+		left + m_textureRect.width, top + m_textureRect.height ) );
+#else
+	s->setParameter( "corner_top", tl.x, tl.y, tr.x, tr.y );
+	s->setParameter( "corner_bottom", bl.x, bl.y, br.x, br.y );
+	s->setParameter( "tex_rect", left, top,
+		left + m_textureRect.width, top + m_textureRect.height );
+#endif
+
+	return s;
+}
+
 float FeSprite::getSkewX() const
 {
 	return m_skew.x;
@@ -244,92 +327,46 @@ void FeSprite::updateGeometry()
 {
 	sf::FloatRect bounds = getLocalBounds();
 
-	//
-	// Compute some values that we will use for applying the
-	// texture coordinates.
-	//
-	float left   = static_cast<float>(m_textureRect.left);
-	float right  = left + m_textureRect.width;
-	float top    = static_cast<float>(m_textureRect.top);
-	float bottom = top + m_textureRect.height;
-	sf::Color vert_colour = m_vertices[0].color;
-
 	sf::Vector2f scale = getScale();
 	sf::Vector2f sskew = m_skew;
 	sskew.x /= scale.x;
 	sskew.y /= scale.y;
 
-	if (( m_pinch.x != 0.f ) || ( m_pinch.y != 0.f ))
+	if ( isPinched() )
 	{
 		sf::Vector2f spinch = m_pinch;
 		spinch.x /= scale.x;
 		spinch.y /= scale.y;
 
 		//
-		// If we are pinching the image, then we slice it up into
-		// a triangle strip going from left to right across the image.
-		// This gives a smooth transition for the image texture
-		// across the whole surface.  There is probably a better way
-		// to do this...
+		// The pinch shader draws a pinched image as a single quad with
+		// these corners.  The image only gets sliced up on the CPU if it
+		// turns out that it can't be drawn that way (see getSlicedVertices())
 		//
+		m_quad[0].position = sf::Vector2f( 0, 0 );
+		m_quad[1].position = sf::Vector2f( sskew.x + spinch.x, bounds.height );
+		m_quad[2].position = sf::Vector2f( bounds.width, spinch.y + sskew.y );
+		m_quad[3].position = sf::Vector2f(
+						sskew.x + bounds.width - spinch.x, bounds.height - spinch.y + sskew.y );
 
-		// SLICES needs to be an odd number... We draw our surface using
-		// SLICES+3 vertices
-		//
-		const int SLICES = 253;
-
-		float bws = (float)bounds.width / SLICES;
-		float pys = (float)spinch.y / SLICES;
-		float sys = (float)sskew.y / SLICES;
-		float bpxs = bws - (float)spinch.x * 2 / SLICES;
-
-		m_vertices.resize( SLICES + 3 );
-		m_vertices.setPrimitiveType( sf::TrianglesStrip );
-
-		//
-		// First do the vertex coordinates
-		//
-		m_vertices[0].position = sf::Vector2f(0, 0 );
-		m_vertices[1].position = sf::Vector2f(sskew.x + spinch.x, bounds.height );
-
-		for ( int i=1; i<SLICES; i++ )
+		for ( unsigned int i=0; i < m_quad.getVertexCount(); i++ )
 		{
-			if ( i%2 )
-			{
-				m_vertices[1 + i].position = sf::Vector2f(
-						bws * i, (pys + sys) * i );
-			}
-			else
-			{
-				m_vertices[1 + i].position = sf::Vector2f(
-						sskew.x + spinch.x + bpxs * i, bounds.height - ( pys - sys ) * i );
-			}
+			m_quad[i].texCoords = m_quad[i].position;
+			m_quad[i].color = m_color;
 		}
-		m_vertices[SLICES + 1].position = sf::Vector2f( bounds.width, spinch.y + sskew.y );
-		m_vertices[SLICES + 2].position = sf::Vector2f(
-						sskew.x + bounds.width - spinch.x, bounds.height - spinch.y + sskew.y );
-
-		//
-		// Now do the texture coordinates
-		//
-		float tws = (float)m_textureRect.width / SLICES;
 
-		m_vertices[0].texCoords = sf::Vector2f(left, top );
-		m_vertices[1].texCoords = sf::Vector2f(left, bottom );
-
-		for ( int i=1; i<SLICES; i++ )
-			m_vertices[1 + i].texCoords = sf::Vector2f(
-						left + tws * i,
-						( i % 2 ) ? top : bottom );
-
-		m_vertices[SLICES + 1].texCoords = sf::Vector2f(right, top );
-		m_vertices[SLICES + 2].texCoords = sf::Vector2f(right, bottom );
+		m_needsSlicing = true;
 	}
 	else
 	{
 		//
 		// If we aren't pinching the image, then we draw it on two triangles.
 		//
+		float left   = static_cast<float>(m_textureRect.left);
+		float right  = left + m_textureRect.width;
+		float top    = static_cast<float>(m_textureRect.top);
+		float bottom = top + m_textureRect.height;
+
 		m_vertices.resize( 4 );
 		m_vertices.setPrimitiveType( sf::TrianglesStrip );
 
@@ -342,12 +379,107 @@ void FeSprite::updateGeometry()
 		m_vertices[1].texCoords = sf::Vector2f(left, bottom);
 		m_vertices[2].texCoords = sf::Vector2f(right, top);
 		m_vertices[3].texCoords = sf::Vector2f(right, bottom);
+
+		for ( unsigned int i=0; i< m_vertices.getVertexCount(); i++ )
+			m_vertices[i].color = m_color;
+
+		m_needsSlicing = false;
+	}
+}
+
+////////////////////////////////////////////////////////////
+const sf::VertexArray &FeSprite::getSlicedVertices() const
+{
+	if ( !m_needsSlicing )
+		return m_vertices;
+
+	m_needsSlicing = false;
+
+	sf::FloatRect bounds = getLocalBounds();
+
+	//
+	// Compute some values that we will use for applying the
+	// texture coordinates.
+	//
+	float left   = static_cast<float>(m_textureRect.left);
+	float right  = left + m_textureRect.width;
+	float top    = static_cast<float>(m_textureRect.top);
+	float bottom = top + m_textureRect.height;
+
+	sf::Vector2f scale = getScale();
+	sf::Vector2f sskew = m_skew;
+	sskew.x /= scale.x;
+	sskew.y /= scale.y;
+
+	sf::Vector2f spinch = m_pinch;
+	spinch.x /= scale.x;
+	spinch.y /= scale.y;
+
+	//
+	// If we are pinching the image, then we slice it up into
+	// a triangle strip going from left to right across the image.
+	// This gives a smooth transition for the image texture
+	// across the whole surface.  There is probably a better way
+	// to do this...
+	//
+
+	// SLICES needs to be an odd number... We draw our surface using
+	// SLICES+3 vertices
+	//
+	const int SLICES = 253;
+
+	float bws = (float)bounds.width / SLICES;
+	float pys = (float)spinch.y / SLICES;
+	float sys = (float)sskew.y / SLICES;
+	float bpxs = bws - (float)spinch.x * 2 / SLICES;
+
+	m_vertices.resize( SLICES + 3 );
+	m_vertices.setPrimitiveType( sf::TrianglesStrip );
+
+	//
+	// First do the vertex coordinates
+	//
+	m_vertices[0].position = sf::Vector2f(0, 0 );
+	m_vertices[1].position = sf::Vector2f(sskew.x + spinch.x, bounds.height );
+
+	for ( int i=1; i<SLICES; i++ )
+	{
+		if ( i%2 )
+		{
+			m_vertices[1 + i].position = sf::Vector2f(
+					bws * i, (pys + sys) * i );
+		}
+		else
+		{
+			m_vertices[1 + i].position = sf::Vector2f(
+					sskew.x + spinch.x + bpxs * i, bounds.height - ( pys - sys ) * i );
+		}
 	}
+	m_vertices[SLICES + 1].position = sf::Vector2f( bounds.width, spinch.y + sskew.y );
+	m_vertices[SLICES + 2].position = sf::Vector2f(
+					sskew.x + bounds.width - spinch.x, bounds.height - spinch.y + sskew.y );
+
+	//
+	// Now do the texture coordinates
+	//
+	float tws = (float)m_textureRect.width / SLICES;
+
+	m_vertices[0].texCoords = sf::Vector2f(left, top );
+	m_vertices[1].texCoords = sf::Vector2f(left, bottom );
+
+	for ( int i=1; i<SLICES; i++ )
+		m_vertices[1 + i].texCoords = sf::Vector2f(
+					left + tws * i,
+					( i % 2 ) ? top : bottom );
+
+	m_vertices[SLICES + 1].texCoords = sf::Vector2f(right, top );
+	m_vertices[SLICES + 2].texCoords = sf::Vector2f(right, bottom );
 
 	//
 	// Finally, update the vertex colour
 	//
 	for ( unsigned int i=0; i< m_vertices.getVertexCount(); i++ )
-		m_vertices[i].color = vert_colour;
+		m_vertices[i].color = m_color;
 
+	return m_vertices;
 }
@@ -66,8 +66,11 @@
 namespace sf
 {
 	class Texture;
+	class Shader;
 };
 
+class FeDrawBatch;
+
 ////////////////////////////////////////////////////////////
 /// \brief Drawable representation of a texture, with its
 ///        own transformations, color, etc.
@@ -229,6 +232,9 @@ public :
 	void setPinchY( float y );
 	void setScale( const sf::Vector2f &s );
 
+	// Queue the sprite in batch rather than drawing it directly
+	void drawBatched( FeDrawBatch &batch, sf::RenderStates states ) const;
+
 	using sf::Transformable::getRotation;
 	using sf::Transformable::setRotation;
 	using sf::Transformable::setPosition;
@@ -251,10 +257,30 @@ private :
     ////////////////////////////////////////////////////////////
     void updateGeometry();
 
+    ////////////////////////////////////////////////////////////
+    /// \brief Get the vertices to draw on the CPU path, slicing
+    ///        up a pinched sprite if that hasn't been done yet
+    ///
+    ////////////////////////////////////////////////////////////
+    const sf::VertexArray &getSlicedVertices() const;
+
+    ////////////////////////////////////////////////////////////
+    /// \brief Get the pinch shader (with this sprite's parameters
+    ///        set) if the sprite is pinched and can be drawn as a
+    ///        single quad, NULL otherwise
+    ///
+    ////////////////////////////////////////////////////////////
+    const sf::Shader *getPinchShader( const sf::RenderStates &states ) const;
+
+	bool isPinched() const;
+
     ////////////////////////////////////////////////////////////
     // Member data
     ////////////////////////////////////////////////////////////
-	sf::VertexArray m_vertices;
+	mutable sf::VertexArray m_vertices; ///< CPU geometry (sliced up when pinched)
+	sf::VertexArray m_quad;            ///< corners of a pinched sprite, for the pinch shader
+	mutable bool m_needsSlicing;
+	sf::Color m_color;
 	const sf::Texture* m_texture;     ///< Texture of the sprite
 	sf::IntRect        m_textureRect; ///< Rectangle defining the area of the source texture to display
 	sf::Vector2f m_pinch;
@@ -23,10 +23,198 @@
 #include "tp.hpp"
 #include <iostream>
 #include <cmath>
+#include <list>
+#include <map>
 
 // included for SFML_VERSION_INT macros
 #include "fe_util.hpp"
 
+namespace
+{
+	//
+	// Metrics for the ASCII glyphs of a font at one character size, so
+	// fitting text doesn't have to ask the font about every character
+	//
+	class FeGlyphTable
+	{
+	public:
+		static const sf::Uint32 TABLE_SIZE=128;
+
+		FeGlyphTable( const sf::Font *font, unsigned int charsize )
+			: m_font( font ),
+			m_charsize( charsize ),
+			m_glyph_set( TABLE_SIZE, false ),
+			m_glyphs( TABLE_SIZE ),
+			m_kerning_set( TABLE_SIZE * TABLE_SIZE, false ),
+			m_kerning( TABLE_SIZE * TABLE_SIZE, 0.f )
+		{
+		}
+
+		const sf::Glyph &get_glyph( sf::Uint32 c )
+		{
+			if ( c >= TABLE_SIZE )
+				return m_font->getGlyph( c, m_charsize, false );
+
+			if ( !m_glyph_set[c] )
+			{
+				m_glyphs[c] = m_font->getGlyph( c, m_charsize, false );
+				m_glyph_set[c] = true;
+			}
+
+			return m_glyphs[c];
+		}
+
+		float get_kerning( sf::Uint32 first, sf::Uint32 second )
+		{
+			if (( first >= TABLE_SIZE ) || ( second >= TABLE_SIZE ))
+				return m_font->getKerning( first, second, m_charsize );
+
+			size_t idx = first * TABLE_SIZE + second;
+			if ( !m_kerning_set[idx] )
+			{
+				m_kerning[idx] = m_font->getKerning( first, second, m_charsize );
+				m_kerning_set[idx] = true;
+			}
+
+			return m_kerning[idx];
+		}
+
+	private:
+		const sf::Font *m_font;
+		unsigned int m_charsize;
+		std::vector<bool> m_glyph_set;
+		std::vector<sf::Glyph> m_glyphs;
+		std::vector<bool> m_kerning_set;
+		std::vector<float> m_kerning;
+	};
+
+	typedef std::map< std::pair<const sf::Font *, unsigned int>, FeGlyphTable * > FeGlyphTableMap;
+	FeGlyphTableMap g_glyph_tables;
+
+	FeGlyphTable &get_glyph_table( const sf::Font *font, unsigned int charsize )
+	{
+		std::pair<const sf::Font *, unsigned int> key( font, charsize );
+
+		FeGlyphTableMap::iterator itr = g_glyph_tables.find( key );
+		if ( itr != g_glyph_tables.end() )
+			return *(itr->second);
+
+		FeGlyphTable *t = new FeGlyphTable( font, charsize );
+		g_glyph_tables[ key ] = t;
+		return *t;
+	}
+
+	//
+	// Everything the line breaks of a text depend on
+	//
+	struct FeTextLayoutKey
+	{
+		size_t hash;
+		const sf::Font *font;
+		unsigned int charsize;
+		int style;
+		sf::Vector2f size;
+		sf::Vector2f scale;
+		float line_spacing;
+		int margin;
+		int first_line;
+		int align;
+		std::basic_string<sf::Uint32> str;
+
+		void set_hash()
+		{
+			// FNV-1a
+			hash = 2166136261u;
+			for ( size_t i=0; i<str.size(); i++ )
+				hash = ( hash ^ str[i] ) * 16777619u;
+
+			hash = ( hash ^ charsize ) * 16777619u;
+			hash = ( hash ^ (size_t)first_line ) * 16777619u;
+		}
+
+		bool operator==( const FeTextLayoutKey &o ) const
+		{
+			return (( hash == o.hash ) && ( font == o.font )
+				&& ( charsize == o.charsize ) && ( style == o.style )
+				&& ( size == o.size ) && ( scale == o.scale )
+				&& ( line_spacing == o.line_spacing ) && ( margin == o.margin )
+				&& ( first_line == o.first_line ) && ( align == o.align )
+				&& ( str == o.str ));
+		}
+	};
+
+	struct FeTextLayout
+	{
+		FeTextLayoutKey key;
+		std::vector< std::pair<int, int> > lines; // first and last character of each line
+		int first_line; // the first line hint after laying out
+	};
+
+	class FeTextLayoutCache
+	{
+	private:
+		typedef std::list<FeTextLayout> FeLayoutList;
+		typedef std::multimap<size_t, FeLayoutList::iterator> FeLayoutIndex;
+
+		FeLayoutList m_entries; // most recently used first
+		FeLayoutIndex m_index;
+
+		static const size_t MAX_ENTRIES=512;
+
+	public:
+		const FeTextLayout *find( const FeTextLayoutKey &key )
+		{
+			std::pair<FeLayoutIndex::iterator, FeLayoutIndex::iterator> r
+				= m_index.equal_range( key.hash );
+
+			for ( FeLayoutIndex::iterator itr=r.first; itr != r.second; ++itr )
+			{
+				if ( itr->second->key == key )
+				{
+					m_entries.splice( m_entries.begin(), m_entries, itr->second );
+					return &(m_entries.front());
+				}
+			}
+
+			return NULL;
+		}
+
+		void add( const FeTextLayout &l )
+		{
+			m_entries.push_front( l );
+			m_index.insert( std::pair<size_t, FeLayoutList::iterator>( l.key.hash, m_entries.begin() ));
+
+			if ( m_entries.size() > MAX_ENTRIES )
+			{
+				FeLayoutList::iterator last = m_entries.end();
+				--last;
+
+				std::pair<FeLayoutIndex::iterator, FeLayoutIndex::iterator> r
+					= m_index.equal_range( last->key.hash );
+
+				for ( FeLayoutIndex::iterator itr=r.first; itr != r.second; ++itr )
+				{
+					if ( itr->second == last )
+					{
+						m_index.erase( itr );
+						break;
+					}
+				}
+
+				m_entries.erase( last );
+			}
+		}
+
+		void clear()
+		{
+			m_index.clear();
+			m_entries.clear();
+		}
+	};
+
+	FeTextLayoutCache g_layout_cache;
+};
+
 FeTextPrimative::FeTextPrimative( )
 	: m_texts( 1, sf::Text() ),
 	m_align( Centre ),
@@ -127,12 +315,13 @@ void FeTextPrimative::fit_string(
 	unsigned int charsize = m_texts[0].getCharacterSize();
 	unsigned int spacing = charsize;
 	float width = m_bgRect.getLocalBounds().width / m_texts[0].getScale().x;
+	FeGlyphTable &gt = get_glyph_table( font, charsize );
 
 	int running_total( 0 );
 	int running_width( 0 );
 	int kerning( 0 );
 
-	const sf::Glyph *g = &font->getGlyph( s[i], charsize, false );
+	const sf::Glyph *g = &gt.get_glyph( s[i] );
 
 	if ( font->getLineSpacing( spacing ) > spacing )
 		spacing = font->getLineSpacing( spacing );
@@ -154,11 +343,11 @@ void FeTextPrimative::fit_string(
 		{
 			if ( i > first_char )
 			{
-				kerning = font->getKerning( s[std::max( 0, i - 1 )], s[i], charsize );
+				kerning = gt.get_kerning( s[std::max( 0, i - 1 )], s[i] );
 				running_total += kerning;
 			}
 
-			g = &font->getGlyph( s[i], charsize, false );
+			g = &gt.get_glyph( s[i] );
 			running_width = std::max( running_width, (int)( running_total + g->bounds.left + g->bounds.width ));
 			running_total += g->advance;
 
@@ -181,9 +370,9 @@ void FeTextPrimative::fit_string(
 		if (( m_first_line < 0 ) && ( j > 0 ) && ( running_width <= width ))
 		{
 			j--;
-			kerning = font->getKerning( s[j], s[std::min( j + 1, (int)s.size() - 1 )], charsize );
+			kerning = gt.get_kerning( s[j], s[std::min( j + 1, (int)s.size() - 1 )] );
 			running_total += kerning;
-			g = &font->getGlyph( s[j], charsize, false );
+			g = &gt.get_glyph( s[j] );
 			running_width = std::max( running_width, (int)( running_total + g->bounds.left + g->bounds.width ));
 			running_total += g->advance;
 		}
@@ -239,10 +428,6 @@ sf::Vector2f FeTextPrimative::setString(
 			const std::basic_string<sf::Uint32> &t,
 			int position )
 {
-	//
-	// Cut the string if it is too big to fit our dimension
-	//
-	int first_char, last_char;
 	int disp_cpos( position );
 
 	if ( m_first_line >= 0 )
@@ -253,6 +438,90 @@ sf::Vector2f FeTextPrimative::setString(
 
 	const sf::Font *font = getFont();
 
+	//
+	// The line breaks only depend on the text and how it is shown, so
+	// reuse them if the text was laid out the same way before.  Layouts
+	// with an edit cursor are always worked out
+	//
+	FeTextLayout layout;
+	bool cached = false;
+	bool use_cache = ( position < 0 );
+
+	if ( use_cache )
+	{
+		layout.key.font = font;
+		layout.key.charsize = m_texts[0].getCharacterSize();
+		layout.key.style = m_texts[0].getStyle();
+		sf::FloatRect bounds = m_bgRect.getLocalBounds();
+		layout.key.size = sf::Vector2f( bounds.width, bounds.height );
+		layout.key.scale = m_texts[0].getScale();
+		layout.key.line_spacing = m_line_spacing;
+		layout.key.margin = m_margin;
+		layout.key.first_line = m_first_line;
+		layout.key.align = m_align & ( Top | Bottom | Middle );
+		layout.key.str = t;
+		layout.key.set_hash();
+
+		const FeTextLayout *l = g_layout_cache.find( layout.key );
+		if ( l )
+		{
+			layout.lines = l->lines;
+			m_first_line = l->first_line;
+			cached = true;
+		}
+	}
+
+	if ( !cached )
+	{
+		layout_lines( t, position, layout.lines );
+
+		if ( use_cache )
+		{
+			layout.first_line = m_first_line;
+			g_layout_cache.add( layout );
+		}
+	}
+
+	int first_char = layout.lines[0].first;
+	int last_char = layout.lines[0].second;
+	m_texts[0].setString( t.substr( first_char, last_char - first_char + 1 ));
+
+	disp_cpos -= first_char;
+
+	for ( size_t i=1; i < layout.lines.size(); i++ )
+	{
+		first_char = layout.lines[i].first;
+		last_char = layout.lines[i].second;
+
+		m_texts.push_back( m_texts[0] );
+		m_texts.back().setString( t.substr( first_char, last_char - first_char + 1 ));
+	}
+
+	set_positions(); // We need to set the positions now for findCharacterPos() to work below
+
+	// We apply kerning to cursor position
+	if ( disp_cpos >= 0 )
+	{
+		int kerning = font->getKerning( m_texts[0].getString()[std::max( 0, disp_cpos - 1 )],
+							            m_texts[0].getString()[disp_cpos],
+							            m_texts[0].getCharacterSize() ) * m_texts[0].getScale().x;
+		return m_texts[0].findCharacterPos( disp_cpos ) + sf::Vector2f( kerning, 0.0 );
+	}
+	else
+		return sf::Vector2f( 0, 0 );
+}
+
+void FeTextPrimative::layout_lines(
+			const std::basic_string<sf::Uint32> &t,
+			int &position,
+			std::vector< std::pair<int, int> > &lines )
+{
+	//
+	// Cut the string if it is too big to fit our dimension
+	//
+	int first_char, last_char;
+	const sf::Font *font = getFont();
+
 	//
 	// We cut the first line of text here
 	//
@@ -268,9 +537,8 @@ sf::Vector2f FeTextPrimative::setString(
 		}
 	}
 
-	m_texts[0].setString( t.substr( first_char, last_char - first_char + 1 ));
-
-	disp_cpos -= first_char;
+	lines.clear();
+	lines.push_back( std::pair<int, int>( first_char, last_char ));
 
 	//
 	// If we are word wrapping calculate the rest of lines
@@ -308,26 +576,12 @@ sf::Vector2f FeTextPrimative::setString(
 		{
 			if ( position >= (int)t.size() ) break;
 			fit_string( t, position, first_char, last_char );
-			m_texts.push_back( m_texts[0] );
-			m_texts.back().setString( t.substr( first_char, last_char - first_char + 1 ));
+			lines.push_back( std::pair<int, int>( first_char, last_char ));
 			actual_line_count++;
 		}
 
 		m_first_line = std::max( 0, m_first_line - line_count + actual_line_count );
 	}
-
-	set_positions(); // We need to set the positions now for findCharacterPos() to work below
-
-	// We apply kerning to cursor position
-	if ( disp_cpos >= 0 )
-	{
-		int kerning = font->getKerning( m_texts[0].getString()[std::max( 0, disp_cpos - 1 )],
-							            m_texts[0].getString()[disp_cpos],
-							            m_texts[0].getCharacterSize() ) * m_texts[0].getScale().x;
-		return m_texts[0].findCharacterPos( disp_cpos ) + sf::Vector2f( kerning, 0.0 );
-	}
-	else
-		return sf::Vector2f( 0, 0 );
 }
 
 void FeTextPrimative::set_positions() const
@@ -388,6 +642,17 @@ void FeTextPrimative::set_positions() const
 	m_needs_pos_set = false;
 }
 
+void FeTextPrimative::clear_layout_cache()
+{
+	g_layout_cache.clear();
+
+	for ( FeGlyphTableMap::iterator itr=g_glyph_tables.begin();
+			itr != g_glyph_tables.end(); ++itr )
+		delete itr->second;
+
+	g_glyph_tables.clear();
+}
+
 int FeTextPrimative::getActualWidth()
 {
 	float w = 0;
@@ -103,6 +103,12 @@ public:
 
 	int getActualWidth(); // return the width of the actual text
 
+	//
+	// Forget the cached text layouts and glyph metrics.  This has to be
+	// called whenever a font gets deleted or reloaded
+	//
+	static void clear_layout_cache();
+
 private:
 	sf::RectangleShape m_bgRect;
 	mutable std::vector<sf::Text> m_texts;
@@ -135,6 +141,16 @@ private:
 			int &first_char,
 			int &last_char );
 
+	//
+	// Break "s" into the lines to be displayed, filling "lines" with the
+	// first and last character of each line.  "position" is as for
+	// fit_string()
+	//
+	void layout_lines(
+			const std::basic_string<sf::Uint32> &s,
+			int &position,
+			std::vector< std::pair<int, int> > &lines );
+
 	void set_positions() const;
 
 	// override from base